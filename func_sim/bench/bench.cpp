@@ -0,0 +1,431 @@
+/**
+ * bench.cpp - Microbenchmarks of the functional memory and the ELF parser.
+ * The ELF parser is also measured on synthetic images with thousands
+ * of sections and hundreds of megabytes of data.
+ * Every benchmark runs a fixed number of operations on fixed addresses
+ * several times, the results are printed in JSON.
+ * Copyright 2015 MIPT-MIPS iLab project
+ */
+
+// Generic C
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <sys/stat.h>
+
+// Generic C++
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <chrono>
+
+// uArchSim modules
+#include <func_memory.h>
+#include <elf_parser.h>
+#include <elf_gen.h>
+
+using namespace std;
+
+// the ELF files of the samples and the kernels used by default
+static const char* default_elf_files[] = {
+    "../func_memory/mips_bin_exmpl.out",
+    "../func_memory/mips_bin_exmpl_be.out",
+    "../func_memory/mips_bss_exmpl.out",
+    "../../tests/samples/memcpy.out",
+    "../../tests/samples/matmul.out",
+    "../../tests/samples/linked_list.out",
+    "../../tests/samples/quicksort.out",
+    "../../tests/samples/crc32.out",
+    "../../tests/samples/string_search.out"
+};
+
+// the synthetic ELF files written before the benchmarks: thousands of
+// small sections in a sparse layout and a 256 MB image
+struct SyntheticElf
+{
+    const char* file_name;
+    uint32 num_sections;
+    uint64 section_size;
+    uint32 num_symbols;
+    uint64 gap;
+};
+static const SyntheticElf synthetic_elf_files[] = {
+    { "synthetic_sections.out", 4096, 4096, 16384, 4096},
+    { "synthetic_256mb.out", 64, 4 << 20, 1024, 0}
+};
+
+static const uint64 seed = 0x2015;
+
+// the results of the reads go here, so they are not optimized away
+static volatile uint64 sink;
+
+struct BenchResult
+{
+    string name;
+    uint64 ops;           // operations per repetition
+    vector<double> times; // seconds of each repetition
+};
+
+// xorshift64, the same sequence on every run and host
+static uint64 nextRandom( uint64& state)
+{
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+// The value quoted as a JSON string, the names of the ELF files come from the command line
+static string jsonString( const string& value)
+{
+    ostringstream oss;
+    oss << '"';
+    for ( size_t i = 0; i < value.size(); ++i)
+    {
+        unsigned char c = value[ i];
+        if ( c == '"' || c == '\\')
+            oss << '\\' << c;
+        else if ( c < 0x20)
+            oss << "\\u00" << "0123456789abcdef"[ c >> 4] << "0123456789abcdef"[ c & 0xf];
+        else
+            oss << c;
+    }
+    oss << '"';
+    return oss.str();
+}
+
+static double secondsSince( chrono::steady_clock::time_point start)
+{
+    return chrono::duration<double>( chrono::steady_clock::now() - start).count();
+}
+
+class Bench
+{
+        const uint32 repetitions;
+        const string filter;
+        const bool verbose; // the progress goes to stderr
+        vector<BenchResult> results;
+
+    public:
+        Bench( uint32 repetitions, const string& filter, bool verbose)
+            : repetitions( repetitions), filter( filter), verbose( verbose)
+        { }
+
+        // Runs body( repetition) which does ops operations and returns its time
+        template<typename Body>
+        void run( const string& name, uint64 ops, Body body)
+        {
+            if ( name.find( filter) == string::npos)
+                return;
+
+            BenchResult result;
+            result.name = name;
+            result.ops = ops;
+            body( 0); // warm up the caches and the allocator
+            for ( uint32 i = 0; i < repetitions; ++i)
+                result.times.push_back( body( i));
+            results.push_back( result);
+            if ( verbose)
+                cerr << name << " done" << endl;
+        }
+
+        void writeJson( ostream& out) const
+        {
+            out << "{" << endl
+                << "  \"repetitions\": " << repetitions << "," << endl
+                << "  \"benchmarks\": [" << endl;
+            for ( size_t i = 0; i < results.size(); ++i)
+            {
+                vector<double> times = results[ i].times;
+                sort( times.begin(), times.end());
+                double best = times.front();
+                double median = times[ times.size() / 2];
+                double ops = results[ i].ops;
+
+                out << "    { \"name\": " << jsonString( results[ i].name)
+                    << ", \"ops\": " << results[ i].ops
+                    << ", \"min_ns_per_op\": " << best * 1e9 / ops
+                    << ", \"median_ns_per_op\": " << median * 1e9 / ops
+                    << ", \"ops_per_second\": " << ops / median
+                    << " }" << ( i + 1 < results.size() ? "," : "") << endl;
+            }
+            out << "  ]" << endl
+                << "}" << endl;
+        }
+};
+
+static const uint64 region_addr = 0x10000000;
+
+// the memory of the access benchmarks is not loaded from a file
+static const vector<ElfSection> no_sections;
+
+// the addresses of the accesses: sequential in 1 MB or random in 16 MB
+static void makeAddresses( bool random, unsigned short width, uint64 num,
+                           vector<uint64>& addrs)
+{
+    addrs.resize( num);
+    uint64 state = seed;
+    uint64 region = random ? ( 16 << 20) : ( 1 << 20);
+    for ( uint64 i = 0; i < num; ++i)
+    {
+        uint64 offset = random ? nextRandom( state) : i * width;
+        addrs[ i] = region_addr + ( offset % region) / width * width;
+    }
+}
+
+static void benchAccesses( Bench& bench)
+{
+    const uint64 num = 1 << 20;
+    const unsigned short widths[] = { 1, 2, 4, 8};
+
+    FuncMemory memory( no_sections);
+    vector<uint8> zeros( 16 << 20);
+    memory.writeBlock( region_addr, &zeros[ 0], zeros.size());
+
+    for ( int random = 0; random < 2; ++random)
+    {
+        for ( size_t w = 0; w < sizeof( widths) / sizeof( widths[ 0]); ++w)
+        {
+            unsigned short width = widths[ w];
+            vector<uint64> addrs;
+            makeAddresses( random != 0, width, num, addrs);
+
+            ostringstream suffix;
+            suffix << ( random ? "_rand_" : "_seq_") << width;
+
+            bench.run( "read" + suffix.str(), num, [ & ]( uint32)
+            {
+                chrono::steady_clock::time_point start = chrono::steady_clock::now();
+                uint64 sum = 0;
+                for ( uint64 i = 0; i < num; ++i)
+                    sum += memory.read( addrs[ i], width);
+                sink = sum;
+                return secondsSince( start);
+            });
+
+            bench.run( "write" + suffix.str(), num, [ & ]( uint32)
+            {
+                chrono::steady_clock::time_point start = chrono::steady_clock::now();
+                for ( uint64 i = 0; i < num; ++i)
+                    memory.write( i, addrs[ i], width);
+                return secondsSince( start);
+            });
+        }
+    }
+
+    // each access crosses the border of two pages inside the 16 MB
+    vector<uint64> addrs( num);
+    uint64 borders = ( 16 << 20) / memory.pageSize() - 1;
+    for ( uint64 i = 0; i < num; ++i)
+        addrs[ i] = region_addr + ( i % borders + 1) * memory.pageSize() - 3;
+
+    bench.run( "read_straddle_8", num, [ & ]( uint32)
+    {
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        uint64 sum = 0;
+        for ( uint64 i = 0; i < num; ++i)
+            sum += memory.read( addrs[ i], 8);
+        sink = sum;
+        return secondsSince( start);
+    });
+
+    bench.run( "write_straddle_8", num, [ & ]( uint32)
+    {
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        for ( uint64 i = 0; i < num; ++i)
+            memory.write( i, addrs[ i], 8);
+        return secondsSince( start);
+    });
+}
+
+// one write to each page of a new memory, i.e. one allocation per operation
+static void benchAlloc( Bench& bench)
+{
+    const uint64 footprints_mb[] = { 1, 16, 128};
+    for ( size_t f = 0; f < sizeof( footprints_mb) / sizeof( footprints_mb[ 0]); ++f)
+    {
+        uint64 footprint = footprints_mb[ f] << 20;
+        uint64 page_size = FuncMemory( no_sections).pageSize();
+        uint64 pages = footprint / page_size;
+
+        ostringstream name;
+        name << "alloc_" << footprints_mb[ f] << "mb";
+        bench.run( name.str(), pages, [ & ]( uint32)
+        {
+            FuncMemory memory( no_sections);
+            chrono::steady_clock::time_point start = chrono::steady_clock::now();
+            for ( uint64 page = 0; page < pages; ++page)
+                memory.write( 1, region_addr + page * page_size, 1);
+            return secondsSince( start);
+        });
+    }
+}
+
+static string baseName( const string& file_name)
+{
+    size_t slash = file_name.rfind( '/');
+    return slash == string::npos ? file_name : file_name.substr( slash + 1);
+}
+
+static void benchElf( Bench& bench, const vector<string>& elf_files)
+{
+    for ( size_t f = 0; f < elf_files.size(); ++f)
+    {
+        const char* file_name = elf_files[ f].c_str();
+        string name = baseName( elf_files[ f]);
+
+        // the huge files are parsed fewer times
+        struct stat file_stat;
+        uint64 file_size = stat( file_name, &file_stat) == 0 ? file_stat.st_size : 0;
+        const uint64 num = max<uint64>( 1, min<uint64>( 100, ( 64 << 20) / ( file_size + 1)));
+
+        bench.run( "parse_sections_" + name, num, [ & ]( uint32)
+        {
+            chrono::steady_clock::time_point start = chrono::steady_clock::now();
+            for ( uint64 i = 0; i < num; ++i)
+            {
+                vector<ElfSection> sections;
+                ElfSection::getAllElfSections( file_name, sections);
+            }
+            return secondsSince( start);
+        });
+
+        bench.run( "construct_" + name, num, [ & ]( uint32)
+        {
+            chrono::steady_clock::time_point start = chrono::steady_clock::now();
+            for ( uint64 i = 0; i < num; ++i)
+            {
+                FuncMemory memory( file_name);
+                sink = memory.startPC();
+            }
+            return secondsSince( start);
+        });
+
+        // the text dump of a huge image does not fit the host memory
+        if ( file_size > ( 16 << 20))
+            continue;
+
+        bench.run( "dump_" + name, num, [ & ]( uint32)
+        {
+            FuncMemory memory( file_name);
+            chrono::steady_clock::time_point start = chrono::steady_clock::now();
+            for ( uint64 i = 0; i < num; ++i)
+                sink = memory.dump().size();
+            return secondsSince( start);
+        });
+    }
+}
+
+static bool writeSyntheticElfs( vector<string>& elf_files)
+{
+    for ( size_t i = 0; i < sizeof( synthetic_elf_files) / sizeof( synthetic_elf_files[ 0]); ++i)
+    {
+        ElfGenConfig config;
+        config.num_sections = synthetic_elf_files[ i].num_sections;
+        config.section_size = synthetic_elf_files[ i].section_size;
+        config.num_symbols = synthetic_elf_files[ i].num_symbols;
+        config.gap = synthetic_elf_files[ i].gap;
+        config.start_addr = 0x10000000;
+        config.seed = seed;
+
+        string error;
+        if ( !ElfGen::generate( synthetic_elf_files[ i].file_name, config, error))
+        {
+            cerr << "ERROR: " << error << endl;
+            return false;
+        }
+        elf_files.push_back( synthetic_elf_files[ i].file_name);
+    }
+    return true;
+}
+
+static void removeSyntheticElfs()
+{
+    for ( size_t i = 0; i < sizeof( synthetic_elf_files) / sizeof( synthetic_elf_files[ 0]); ++i)
+        remove( synthetic_elf_files[ i].file_name);
+}
+
+static void printUsage( const char* program)
+{
+    cout << "This program runs the microbenchmarks of the functional memory" << endl
+         << "and the ELF parser and prints the results in JSON." << endl
+         << endl
+         << "Usage: \"" << program << " [-r <repetitions>] [-f <name filter>]"
+         << " [-o <output file>] [-n] [-v] [<ELF binary> ...]\"" << endl
+         << "Without ELF binaries the samples and the synthetic images are used," << endl
+         << "\"-n\" skips the synthetic images, \"-v\" prints each finished benchmark." << endl;
+}
+
+int main( int argc, char* argv[])
+{
+    uint32 repetitions = 5;
+    string filter;
+    const char* output = NULL;
+    vector<string> elf_files;
+    bool synthetic = true;
+    bool verbose = false;
+
+    for ( int arg = 1; arg < argc; ++arg)
+    {
+        if ( !strcmp( argv[ arg], "--help"))
+        {
+            printUsage( argv[ 0]);
+            return 0;
+        } else if ( arg + 1 < argc && !strcmp( argv[ arg], "-r"))
+        {
+            repetitions = strtoul( argv[ ++arg], NULL, 10);
+        } else if ( arg + 1 < argc && !strcmp( argv[ arg], "-f"))
+        {
+            filter = argv[ ++arg];
+        } else if ( arg + 1 < argc && !strcmp( argv[ arg], "-o"))
+        {
+            output = argv[ ++arg];
+        } else if ( !strcmp( argv[ arg], "-n"))
+        {
+            synthetic = false;
+        } else if ( !strcmp( argv[ arg], "-v"))
+        {
+            verbose = true;
+        } else
+        {
+            elf_files.push_back( argv[ arg]);
+        }
+    }
+    if ( repetitions == 0)
+        repetitions = 1;
+    if ( !elf_files.empty())
+        synthetic = false;
+    else
+        elf_files.assign( default_elf_files,
+                          default_elf_files + sizeof( default_elf_files) / sizeof( default_elf_files[ 0]));
+    if ( synthetic && !writeSyntheticElfs( elf_files))
+    {
+        removeSyntheticElfs();
+        exit( EXIT_FAILURE);
+    }
+
+    Bench bench( repetitions, filter, verbose);
+    benchAccesses( bench);
+    benchAlloc( bench);
+    benchElf( bench, elf_files);
+    if ( synthetic)
+        removeSyntheticElfs();
+
+    if ( output == NULL)
+    {
+        bench.writeJson( cout);
+        return 0;
+    }
+
+    ofstream file( output);
+    if ( !file)
+    {
+        cerr << "ERROR: Could not open file " << output << endl;
+        exit( EXIT_FAILURE);
+    }
+    bench.writeJson( file);
+    return 0;
+}
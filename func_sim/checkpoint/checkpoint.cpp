@@ -0,0 +1,449 @@
+/**
+ * checkpoint.cpp - Implementation of the module saving the architectural
+ * state (memory, registers, CP0 and PC) to a file and restoring it from there.
+ * Copyright 2015 MIPT-MIPS iLab project
+ */
+
+// Generic C
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <zlib.h>
+
+// Generic C++
+#include <sstream>
+#include <vector>
+
+// uArchSim modules
+#include <checkpoint.h>
+
+using namespace std;
+
+static const char CHECKPOINT_MAGIC[ 8] = { 'M', 'I', 'P', 'S', 'C', 'K', 'P', 'T'};
+static const uint32 CHECKPOINT_VERSION = 4;
+
+// All the fields are stored in the host byte order,
+// so a checkpoint can be restored only on a host of the same endianness.
+struct CheckpointHeader
+{
+    char magic[ 8];
+    uint32 version;
+    uint32 addr_bits;
+    uint32 page_bits;
+    uint32 offset_bits;
+    uint32 big_endian;
+    uint64 page_size;
+    uint64 pc;
+    uint32 regs[ REG_NUM];
+    uint64 num_pages;
+
+    // the layout of the guest address space
+    uint64 heap_start;
+    uint64 heap_end;
+    uint64 mmap_top;
+    uint32 region_checks;
+    uint32 num_regions;
+
+    // CP0: the registers and the timer with the cycles of the saved run
+    uint32 cp0_status;
+    uint32 cp0_cause;
+    uint32 cp0_epc;
+    uint32 cp0_badvaddr;
+    uint32 cp0_compare;
+    uint32 cp0_count_base;
+    uint64 cp0_count_cycle;
+    uint64 cp0_timer_cycle;
+};
+
+// followed by the compressed data of the page
+struct CheckpointPage
+{
+    uint64 addr;
+    uint64 compressed_size;
+    uint64 crc; // CRC-32 of the raw data, so equal pages are found without decompression
+};
+
+// the regions follow the pages, each of them is followed by its name
+struct CheckpointRegion
+{
+    uint64 start_addr;
+    uint64 size;
+    uint32 prot;
+    uint32 name_size;
+};
+
+// the names are short, a longer one is a sign of a broken file
+static const uint32 MAX_REGION_NAME = 256;
+
+static bool writePages( FILE* file, const FuncMemory& memory,
+                        const vector<uint64>& pages, string& error)
+{
+    uint64 page_size = memory.pageSize();
+    vector<uint8> raw( page_size);
+    vector<uint8> compressed( compressBound( page_size));
+
+    for ( size_t i = 0; i < pages.size(); ++i)
+    {
+        memory.readBlock( pages[ i], &raw[ 0], page_size);
+
+        uLongf compressed_size = compressed.size();
+        if ( compress2( &compressed[ 0], &compressed_size,
+                        &raw[ 0], page_size, Z_BEST_SPEED) != Z_OK)
+        {
+            error = "could not compress a page";
+            return false;
+        }
+
+        CheckpointPage page;
+        page.addr = pages[ i];
+        page.compressed_size = compressed_size;
+        page.crc = crc32( 0, &raw[ 0], page_size);
+        if ( fwrite( &page, sizeof( page), 1, file) != 1
+             || fwrite( &compressed[ 0], 1, compressed_size, file) != compressed_size)
+        {
+            error = strerror( errno);
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool writeRegions( FILE* file, const vector<MemoryRegion>& regions, string& error)
+{
+    for ( size_t i = 0; i < regions.size(); ++i)
+    {
+        CheckpointRegion region;
+        memset( &region, 0, sizeof( region));
+        region.start_addr = regions[ i].start_addr;
+        region.size = regions[ i].size;
+        region.prot = regions[ i].prot;
+        region.name_size = regions[ i].name.size();
+        if ( fwrite( &region, sizeof( region), 1, file) != 1
+             || fwrite( regions[ i].name.data(), 1, region.name_size, file) != region.name_size)
+        {
+            error = strerror( errno);
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Checkpoint::save( const char* file_name,
+                       const FuncMemory& memory, const RF& rf, const CP0& cp0, uint64 pc,
+                       string& error)
+{
+    vector<uint64> pages;
+    memory.getAllocatedPages( pages);
+
+    CheckpointHeader header;
+    memset( &header, 0, sizeof( header));
+    memcpy( header.magic, CHECKPOINT_MAGIC, sizeof( header.magic));
+    header.version = CHECKPOINT_VERSION;
+    header.addr_bits = memory.addrBits();
+    header.page_bits = memory.pageBits();
+    header.offset_bits = memory.offsetBits();
+    header.big_endian = memory.isBigEndian();
+    header.page_size = memory.pageSize();
+    header.pc = pc;
+    for ( size_t i = 0; i < REG_NUM; ++i)
+        header.regs[ i] = rf.read( ( RegNum)i);
+    header.num_pages = pages.size();
+    header.heap_start = memory.heapStart();
+    header.heap_end = memory.programBreak();
+    header.mmap_top = memory.mmapTop();
+    header.region_checks = memory.regionChecks();
+    header.num_regions = memory.getRegions().size();
+    header.cp0_status = cp0.status;
+    header.cp0_cause = cp0.cause;
+    header.cp0_epc = cp0.epc;
+    header.cp0_badvaddr = cp0.badvaddr;
+    header.cp0_compare = cp0.compare;
+    header.cp0_count_base = cp0.count_base;
+    header.cp0_count_cycle = cp0.count_cycle;
+    header.cp0_timer_cycle = cp0.timer_cycle;
+
+    FILE* file = fopen( file_name, "wb");
+    if ( !file)
+    {
+        error = string( "Could not open file ") + file_name + ": " + strerror( errno);
+        return false;
+    }
+
+    bool ok = fwrite( &header, sizeof( header), 1, file) == 1;
+    if ( !ok)
+        error = strerror( errno);
+    else
+        ok = writePages( file, memory, pages, error)
+             && writeRegions( file, memory.getRegions(), error);
+
+    if ( fclose( file) != 0 && ok)
+    {
+        error = strerror( errno);
+        ok = false;
+    }
+
+    if ( !ok)
+        error = string( "Could not write file ") + file_name + ": " + error;
+    return ok;
+}
+
+static bool readPages( FILE* file, FuncMemory& memory, uint64 num_pages, string& error)
+{
+    uint64 page_size = memory.pageSize();
+    vector<uint8> raw( page_size);
+    vector<uint8> compressed;
+
+    for ( uint64 i = 0; i < num_pages; ++i)
+    {
+        CheckpointPage page;
+        if ( fread( &page, sizeof( page), 1, file) != 1
+             || page.compressed_size > compressBound( page_size))
+        {
+            error = "broken page header";
+            return false;
+        }
+
+        compressed.resize( page.compressed_size);
+        if ( fread( &compressed[ 0], 1, page.compressed_size, file) != page.compressed_size)
+        {
+            error = "unexpected end of file";
+            return false;
+        }
+
+        uLongf raw_size = page_size;
+        if ( uncompress( &raw[ 0], &raw_size, &compressed[ 0], page.compressed_size) != Z_OK
+             || raw_size != page_size)
+        {
+            error = "could not decompress a page";
+            return false;
+        }
+
+        memory.writeBlock( page.addr, &raw[ 0], page_size);
+    }
+    return true;
+}
+
+static bool readRegions( FILE* file, uint32 num_regions,
+                         vector<MemoryRegion>& regions, string& error)
+{
+    for ( uint32 i = 0; i < num_regions; ++i)
+    {
+        CheckpointRegion saved;
+        if ( fread( &saved, sizeof( saved), 1, file) != 1
+             || saved.name_size > MAX_REGION_NAME)
+        {
+            error = "broken region header";
+            return false;
+        }
+
+        MemoryRegion region;
+        region.start_addr = saved.start_addr;
+        region.size = saved.size;
+        region.prot = saved.prot;
+        region.name.resize( saved.name_size);
+        if ( saved.name_size != 0
+             && fread( &region.name[ 0], 1, saved.name_size, file) != saved.name_size)
+        {
+            error = "unexpected end of file";
+            return false;
+        }
+        regions.push_back( region);
+    }
+    return true;
+}
+
+// Brings back the regions after the pages are written,
+// since the checks would not let the pages out of the regions in
+static bool restoreLayout( FILE* file, const CheckpointHeader& header,
+                           FuncMemory& memory, string& error)
+{
+    vector<MemoryRegion> regions;
+    if ( !readRegions( file, header.num_regions, regions, error))
+        return false;
+
+    if ( !memory.restoreRegions( regions, header.heap_start, header.heap_end, header.mmap_top))
+    {
+        error = "broken layout of the regions";
+        return false;
+    }
+    memory.setRegionChecks( header.region_checks != 0);
+    return true;
+}
+
+FuncMemory* Checkpoint::restore( const char* file_name, RF& rf, CP0& cp0, uint64& pc,
+                                 string& error)
+{
+    FILE* file = fopen( file_name, "rb");
+    if ( !file)
+    {
+        error = string( "Could not open file ") + file_name + ": " + strerror( errno);
+        return NULL;
+    }
+
+    CheckpointHeader header;
+    FuncMemory* memory = NULL;
+
+    if ( fread( &header, sizeof( header), 1, file) != 1
+         || memcmp( header.magic, CHECKPOINT_MAGIC, sizeof( header.magic)) != 0)
+    {
+        error = "not a checkpoint file";
+    } else if ( header.version != CHECKPOINT_VERSION)
+    {
+        ostringstream oss;
+        oss << "unsupported checkpoint version " << header.version;
+        error = oss.str();
+    } else if ( !FuncMemory::checkGeometry( header.addr_bits, header.page_bits,
+                                            header.offset_bits, error))
+    {
+        error = "broken memory geometry: " + error;
+    } else
+    {
+        // the memory is empty, all its content comes from the file
+        memory = new FuncMemory( vector<ElfSection>(), header.addr_bits,
+                                 header.page_bits, header.offset_bits,
+                                 header.big_endian != 0);
+
+        if ( memory->pageSize() != header.page_size)
+            error = "page size does not match";
+
+        if ( memory->pageSize() != header.page_size
+             || !readPages( file, *memory, header.num_pages, error)
+             || !restoreLayout( file, header, *memory, error))
+        {
+            delete memory;
+            memory = NULL;
+        } else
+        {
+            // the restored state is the initial one
+            memory->clearDirtyPages();
+            memory->setResetPoint();
+        }
+    }
+
+    fclose( file);
+
+    if ( !memory)
+    {
+        error = string( "Could not restore checkpoint ") + file_name + ": " + error;
+        return NULL;
+    }
+
+    for ( size_t i = 0; i < REG_NUM; ++i)
+        rf.write( ( RegNum)i, header.regs[ i]);
+    cp0.status = header.cp0_status;
+    cp0.cause = header.cp0_cause;
+    cp0.epc = header.cp0_epc;
+    cp0.badvaddr = header.cp0_badvaddr;
+    cp0.compare = header.cp0_compare;
+    cp0.count_base = header.cp0_count_base;
+    cp0.count_cycle = header.cp0_count_cycle;
+    cp0.timer_cycle = header.cp0_timer_cycle;
+    pc = header.pc;
+
+    return memory;
+}
+
+bool Checkpoint::diff( const char* file_name, const FuncMemory& memory,
+                       vector<MemoryRange>& ranges, string& error)
+{
+    FILE* file = fopen( file_name, "rb");
+    if ( !file)
+    {
+        error = string( "Could not open file ") + file_name + ": " + strerror( errno);
+        return false;
+    }
+
+    CheckpointHeader header;
+    bool ok = fread( &header, sizeof( header), 1, file) == 1
+              && memcmp( header.magic, CHECKPOINT_MAGIC, sizeof( header.magic)) == 0
+              && header.version == CHECKPOINT_VERSION;
+    if ( !ok)
+        error = "not a checkpoint file of a supported version";
+    else if ( header.page_size != memory.pageSize())
+    {
+        error = "page size does not match";
+        ok = false;
+    }
+
+    uint64 page_size = memory.pageSize();
+    vector<uint8> raw( page_size);
+    vector<uint8> mem_raw( page_size);
+    vector<uint8> compressed;
+
+    vector<uint64> pages;
+    memory.getAllocatedPages( pages);
+    size_t next_page = 0;
+
+    for ( uint64 i = 0; ok && i < header.num_pages; ++i)
+    {
+        CheckpointPage page;
+        if ( fread( &page, sizeof( page), 1, file) != 1
+             || page.compressed_size > compressBound( page_size))
+        {
+            error = "broken page header";
+            ok = false;
+            break;
+        }
+
+        // the pages of the memory missing in the checkpoint differ entirely
+        for ( ; next_page < pages.size() && pages[ next_page] < page.addr; ++next_page)
+            FuncMemory::addRange( pages[ next_page], page_size, ranges);
+
+        // the pages missing in the memory or equal by CRC are not decompressed
+        bool in_memory = next_page < pages.size() && pages[ next_page] == page.addr;
+        if ( in_memory)
+        {
+            ++next_page;
+            memory.readBlock( page.addr, &mem_raw[ 0], page_size);
+        } else
+        {
+            FuncMemory::addRange( page.addr, page_size, ranges);
+        }
+
+        if ( !in_memory || crc32( 0, &mem_raw[ 0], page_size) == page.crc)
+        {
+            ok = fseek( file, page.compressed_size, SEEK_CUR) == 0;
+            if ( !ok)
+                error = "unexpected end of file";
+            continue;
+        }
+
+        compressed.resize( page.compressed_size);
+        uLongf raw_size = page_size;
+        if ( fread( &compressed[ 0], 1, page.compressed_size, file) != page.compressed_size
+             || uncompress( &raw[ 0], &raw_size, &compressed[ 0], page.compressed_size) != Z_OK
+             || raw_size != page_size)
+        {
+            error = "could not decompress a page";
+            ok = false;
+            break;
+        }
+
+        FuncMemory::diffBytes( &raw[ 0], &mem_raw[ 0], page_size, page.addr, ranges);
+    }
+
+    for ( ; ok && next_page < pages.size(); ++next_page)
+        FuncMemory::addRange( pages[ next_page], page_size, ranges);
+
+    fclose( file);
+
+    if ( !ok)
+        error = string( "Could not compare with checkpoint ") + file_name + ": " + error;
+    return ok;
+}
+
+void ResetPoint::set( FuncMemory& memory, const RF& rf, const CP0& cp0, uint64 pc)
+{
+    memory.setResetPoint();
+    this->rf = rf;
+    this->cp0 = cp0;
+    this->pc = pc;
+}
+
+void ResetPoint::reset( FuncMemory& memory, RF& rf, CP0& cp0, uint64& pc) const
+{
+    memory.reset();
+    rf = this->rf;
+    cp0 = this->cp0;
+    pc = this->pc;
+}
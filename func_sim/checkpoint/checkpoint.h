@@ -0,0 +1,71 @@
+/**
+ * checkpoint.h - Header of the module saving the architectural state
+ * (memory, registers, CP0 and PC) to a file and restoring it from there.
+ * Copyright 2015 MIPT-MIPS iLab project
+ */
+
+// protection from multi-include
+#ifndef CHECKPOINT__CHECKPOINT_H
+#define CHECKPOINT__CHECKPOINT_H
+
+// Generic C++
+#include <string>
+
+// uArchSim modules
+#include <types.h>
+#include <func_memory.h>
+#include <rf.h>
+#include <cp0.h>
+
+//
+// The checkpoint file contains only the allocated pages of the memory,
+// each of them is compressed separately, and the layout of the guest
+// address space: the regions, the heap and the place of the next mapping.
+//
+class Checkpoint
+{
+    public:
+        // Returns false and the description of the problem on failure
+        static bool save( const char* file_name,
+                          const FuncMemory& memory, const RF& rf, const CP0& cp0, uint64 pc,
+                          string& error /*used as output*/);
+
+        // Creates the memory with the saved geometry and content and restores
+        // the registers, CP0 and PC. Count and the timer of CP0 go on
+        // from the cycles of the saved run. Returns NULL and the description
+        // of the problem on failure.
+        static FuncMemory* restore( const char* file_name,
+                                    RF& rf /*used as output*/,
+                                    CP0& cp0 /*used as output*/,
+                                    uint64& pc /*used as output*/,
+                                    string& error /*used as output*/);
+
+        // Finds the bytes of the memory that differ from the saved ones.
+        // The pages with equal CRC are not decompressed.
+        // Returns false and the description of the problem on failure.
+        static bool diff( const char* file_name, const FuncMemory& memory,
+                          vector<MemoryRange>& ranges /*used as output*/,
+                          string& error /*used as output*/);
+};
+
+//
+// The state that back-to-back runs of a program start from.
+// The memory reverts only the pages written since the reset point,
+// the registers, CP0 and PC are copied.
+//
+class ResetPoint
+{
+        RF rf;
+        CP0 cp0;
+        uint64 pc;
+
+    public:
+        ResetPoint() : pc( 0) { }
+
+        // Makes the current state the one reset returns to
+        void set( FuncMemory& memory, const RF& rf, const CP0& cp0, uint64 pc);
+        void reset( FuncMemory& memory, RF& rf /*used as output*/,
+                    CP0& cp0 /*used as output*/, uint64& pc /*used as output*/) const;
+};
+
+#endif // #ifndef CHECKPOINT__CHECKPOINT_H
@@ -0,0 +1,215 @@
+// generic C
+#include <cassert>
+#include <cstdlib>
+#include <cstdio>
+
+// Google Test library
+#include <gtest/gtest.h>
+
+// uArchSim modules
+#include <checkpoint.h>
+
+static const char * valid_elf_file = "./mips_bin_exmpl.out";
+static const char * checkpoint_file = "./test_checkpoint.ckpt";
+
+TEST( Checkpoint, Save_And_Restore)
+{
+    FuncMemory func_mem( valid_elf_file);
+    RF rf;
+    CP0 cp0;
+
+    // change the state after the loading
+    func_mem.write( 0xdeadbeef, 0x4100c0, sizeof( uint32));
+    func_mem.write( 0x12345678, 0x7ffff000, sizeof( uint32));
+    rf.write( REG_SP, 0x7ffff000);
+    rf.write( REG_T3, 0x4100cc);
+    rf.write( REG_HI, 42);
+
+    // the checkpoint is taken in a handler with the timer set
+    cp0.write( CP0_STATUS, STATUS_IE | STATUS_IM_TIMER, 0);
+    cp0.write( CP0_COMPARE, 5000, 1000);
+    cp0.raise( EXC_TLBS, 0x4000a0, true, 0x1234);
+
+    string error;
+    ASSERT_TRUE( Checkpoint::save( checkpoint_file, func_mem, rf, cp0, 0x4000b4, error));
+
+    RF restored_rf;
+    CP0 restored_cp0;
+    uint64 pc = 0;
+    FuncMemory* restored_mem = Checkpoint::restore( checkpoint_file, restored_rf,
+                                                    restored_cp0, pc, error);
+    ASSERT_TRUE( restored_mem != NULL);
+
+    // the handler returns where the saved run would, the timer fires at the same cycle
+    ASSERT_TRUE( restored_cp0.inException());
+    ASSERT_EQ( restored_cp0.excCode(), EXC_TLBS);
+    ASSERT_EQ( restored_cp0.read( CP0_EPC, 2000), 0x40009cu);
+    ASSERT_EQ( restored_cp0.read( CP0_BADVADDR, 2000), 0x1234u);
+    ASSERT_EQ( restored_cp0.read( CP0_COUNT, 2000), cp0.read( CP0_COUNT, 2000));
+    ASSERT_EQ( restored_cp0.eret(), cp0.eret());
+    ASSERT_EQ( restored_cp0.nextEvent(), cp0.nextEvent());
+
+    ASSERT_EQ( pc, 0x4000b4ull);
+    for ( size_t i = 0; i < REG_NUM; ++i)
+        ASSERT_EQ( restored_rf.read( ( RegNum)i), rf.read( ( RegNum)i));
+
+    ASSERT_EQ( restored_mem->read( 0x4100c0), 0xdeadbeefull);
+    ASSERT_EQ( restored_mem->read( 0x7ffff000), 0x12345678ull);
+    ASSERT_EQ( restored_mem->dump(), func_mem.dump());
+
+    // only the allocated pages are saved and they are compressed
+    vector<uint64> pages;
+    restored_mem->getAllocatedPages( pages);
+    FILE* file = fopen( checkpoint_file, "rb");
+    fseek( file, 0, SEEK_END);
+    ASSERT_LT( ( uint64)ftell( file), pages.size() * restored_mem->pageSize());
+    fclose( file);
+
+    delete restored_mem;
+    remove( checkpoint_file);
+}
+
+TEST( Checkpoint, Save_And_Restore_Regions)
+{
+    FuncMemory func_mem( valid_elf_file);
+    RF rf;
+    CP0 cp0;
+    uint64 sp = func_mem.setupStack( vector<string>( 1, valid_elf_file), vector<string>());
+    ASSERT_NE( sp, 0u);
+    ASSERT_TRUE( func_mem.setProgramBreak( func_mem.programBreak() + 0x2100));
+    uint64 map = func_mem.mapAnonymous( 0x3000, MEM_READ | MEM_WRITE);
+    ASSERT_NE( map, 0u);
+
+    string error;
+    ASSERT_TRUE( Checkpoint::save( checkpoint_file, func_mem, rf, cp0, 0, error));
+    uint64 pc = 0;
+    FuncMemory* restored_mem = Checkpoint::restore( checkpoint_file, rf, cp0, pc, error);
+    ASSERT_TRUE( restored_mem != NULL);
+
+    // the regions, the heap and the mappings go on as before
+    ASSERT_EQ( restored_mem->getRegions().size(), func_mem.getRegions().size());
+    for ( size_t i = 0; i < func_mem.getRegions().size(); ++i)
+    {
+        const MemoryRegion& saved = func_mem.getRegions()[ i];
+        const MemoryRegion& restored = restored_mem->getRegions()[ i];
+        ASSERT_EQ( restored.name, saved.name);
+        ASSERT_EQ( restored.start_addr, saved.start_addr);
+        ASSERT_EQ( restored.size, saved.size);
+        ASSERT_EQ( restored.prot, saved.prot);
+    }
+    ASSERT_EQ( restored_mem->heapStart(), func_mem.heapStart());
+    ASSERT_EQ( restored_mem->programBreak(), func_mem.programBreak());
+    ASSERT_TRUE( restored_mem->regionChecks());
+    ASSERT_EQ( restored_mem->mapAnonymous( 0x1000, MEM_READ), map - 0x1000);
+    ASSERT_EQ( restored_mem->read( sp), 1u); // argc
+
+    // the pages keep their protection
+    uint64 code = func_mem.startPC();
+    ASSERT_EQ( restored_mem->pageProt( code), ( uint32)( MEM_READ | MEM_EXEC));
+    ASSERT_EQ( restored_mem->pageProt( map), ( uint32)( MEM_READ | MEM_WRITE));
+    ASSERT_EQ( restored_mem->pageProt( sp), ( uint32)( MEM_READ | MEM_WRITE));
+    ASSERT_FALSE( restored_mem->tryWrite( 0, code, 4));
+    uint32 word = 0;
+    ASSERT_TRUE( restored_mem->tryFetch( code, word));
+    ASSERT_FALSE( restored_mem->tryFetch( sp, word));
+
+    // the checks are on: nothing out of the regions is allocated
+    uint64 value = 0;
+    ASSERT_FALSE( restored_mem->tryWrite( 1, 0x300000, 4));
+    ASSERT_FALSE( restored_mem->tryRead( 0x300000, 4, value));
+
+    delete restored_mem;
+    remove( checkpoint_file);
+}
+
+TEST( Checkpoint, Restore_Wrong_File)
+{
+    RF rf;
+    CP0 cp0;
+    uint64 pc = 0;
+    string error;
+
+    ASSERT_TRUE( Checkpoint::restore( "./1234567890/qwertyuiop", rf, cp0, pc, error) == NULL);
+    ASSERT_NE( error.find( "Could not open file"), string::npos);
+
+    // the file exists, but it is not a checkpoint
+    ASSERT_TRUE( Checkpoint::restore( valid_elf_file, rf, cp0, pc, error) == NULL);
+    ASSERT_NE( error.find( "not a checkpoint file"), string::npos);
+
+    // the geometry of the memory in the file is not allocated
+    FuncMemory func_mem( valid_elf_file);
+    ASSERT_TRUE( Checkpoint::save( checkpoint_file, func_mem, rf, cp0, 0, error));
+    FILE* file = fopen( checkpoint_file, "r+b");
+    uint32 geometry[ 2] = { 1, 2}; // page_bits and offset_bits after the magic, version and addr_bits
+    fseek( file, 16, SEEK_SET);
+    fwrite( geometry, sizeof( geometry), 1, file);
+    fclose( file);
+    ASSERT_TRUE( Checkpoint::restore( checkpoint_file, rf, cp0, pc, error) == NULL);
+    ASSERT_NE( error.find( "broken memory geometry"), string::npos);
+    remove( checkpoint_file);
+}
+
+TEST( Checkpoint, Reset_Point)
+{
+    FuncMemory func_mem( valid_elf_file);
+    RF rf;
+    CP0 cp0;
+    uint64 pc = func_mem.startPC();
+    rf.write( REG_SP, 0x7ffff000);
+
+    ResetPoint start;
+    start.set( func_mem, rf, cp0, pc);
+
+    // two short runs starting from the same state
+    for ( size_t run = 0; run < 2; ++run)
+    {
+        ASSERT_EQ( func_mem.read( 0x4100c0), 0x03020100ull);
+        ASSERT_EQ( rf.read( REG_SP), 0x7ffff000u);
+        ASSERT_EQ( pc, func_mem.startPC());
+        ASSERT_FALSE( cp0.inException());
+
+        func_mem.write( 0xdeadbeef, 0x4100c0, sizeof( uint32));
+        cp0.raise( EXC_SYS, pc, false);
+        rf.write( REG_SP, 0x7fffeff0);
+        rf.write( REG_T0, run + 1);
+        pc += 8;
+
+        start.reset( func_mem, rf, cp0, pc);
+    }
+    ASSERT_EQ( rf.read( REG_T0), 0u);
+}
+
+TEST( Checkpoint, Diff_With_Memory)
+{
+    FuncMemory func_mem( valid_elf_file);
+    RF rf;
+    CP0 cp0;
+    func_mem.write( 0x12345678, 0x7ffff000, sizeof( uint32));
+
+    string error;
+    ASSERT_TRUE( Checkpoint::save( checkpoint_file, func_mem, rf, cp0, 0, error));
+
+    vector<MemoryRange> ranges;
+    ASSERT_TRUE( Checkpoint::diff( checkpoint_file, func_mem, ranges, error));
+    ASSERT_TRUE( ranges.empty());
+
+    // two changed bytes and a new page
+    func_mem.write( 0x12ff56ff, 0x7ffff000, sizeof( uint32));
+    func_mem.write( 1, 0x300000, 1);
+    ASSERT_TRUE( Checkpoint::diff( checkpoint_file, func_mem, ranges, error));
+    ASSERT_EQ( ranges.size(), 3u);
+    ASSERT_EQ( ranges[ 0].start_addr, 0x300000u);
+    ASSERT_EQ( ranges[ 0].size, func_mem.pageSize());
+    ASSERT_EQ( ranges[ 1].start_addr, 0x7ffff000u);
+    ASSERT_EQ( ranges[ 1].size, 1u);
+    ASSERT_EQ( ranges[ 2].start_addr, 0x7ffff002u);
+
+    remove( checkpoint_file);
+}
+
+int main( int argc, char* argv[])
+{
+    ::testing::InitGoogleTest( &argc, argv);
+    ::testing::FLAGS_gtest_death_test_style = "threadsafe";
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,135 @@
+/**
+ * cosim.cpp - Implementation of the lockstep co-simulation checker.
+ * Copyright 2015 MIPT-MIPS iLab project
+ */
+
+// Generic C++
+#include <sstream>
+#include <iomanip>
+#include <vector>
+
+// uArchSim modules
+#include <cosim.h>
+
+CosimChecker::CosimChecker( ReferenceModel& reference,
+                            uint32 queue_bits, size_t batch_size)
+    : queue( queue_bits),
+      reference( reference),
+      batch_size( batch_size),
+      finished( false),
+      num_checked( 0),
+      diverged( false)
+{
+    assert( batch_size != 0);
+    checker_thread = std::thread( &CosimChecker::run, this);
+}
+
+CosimChecker::~CosimChecker()
+{
+    finish();
+}
+
+void CosimChecker::run()
+{
+    vector<TraceRecord> batch( batch_size);
+    size_t num = 0;
+    while ( ( num = queue.popBatch( &batch[ 0], batch_size)) != 0)
+    {
+        for ( size_t i = 0; i < num; ++i)
+        {
+            TraceRecord expected;
+            string reason = reference.step( expected)
+                            ? compare( expected, batch[ i])
+                            : "the reference model has finished";
+            if ( !reason.empty())
+            {
+                diverged = true;
+                mismatch.index = num_checked;
+                mismatch.expected = expected;
+                mismatch.actual = batch[ i];
+                mismatch.reason = reason;
+
+                // drain the queue so the blocked timing model can go on
+                queue.stop();
+                while ( queue.popBatch( &batch[ 0], batch_size) != 0)
+                    ;
+                return;
+            }
+            ++num_checked;
+        }
+    }
+
+    // all the retired instructions match, the program must have ended as well
+    TraceRecord expected;
+    if ( reference.step( expected))
+    {
+        diverged = true;
+        mismatch.index = num_checked;
+        mismatch.expected = expected;
+        mismatch.actual = TraceRecord();
+        mismatch.reason = "the timing model has finished early";
+    }
+}
+
+bool CosimChecker::finish()
+{
+    if ( !finished)
+    {
+        queue.close();
+        checker_thread.join();
+        finished = true;
+    }
+    return !diverged;
+}
+
+string CosimChecker::compare( const TraceRecord& expected, const TraceRecord& actual)
+{
+    if ( expected.pc != actual.pc)
+        return "PC";
+    if ( expected.instr != actual.instr)
+        return "instruction";
+    if ( expected.next_pc != actual.next_pc)
+        return "next PC";
+    if ( expected.dst_reg != actual.dst_reg)
+        return "destination register";
+    if ( expected.dst_reg != TRACE_NO_REG && expected.dst_value != actual.dst_value)
+        return "destination register value";
+
+    // only the stores change the state, the loads are checked by their destinations
+    bool expected_store = expected.mem_size != 0 && expected.is_store;
+    bool actual_store = actual.mem_size != 0 && actual.is_store;
+    if ( expected_store != actual_store)
+        return "memory write";
+    if ( expected_store && ( expected.mem_addr != actual.mem_addr
+                             || expected.mem_size != actual.mem_size))
+        return "memory write address";
+    if ( expected_store && expected.mem_value != actual.mem_value)
+        return "memory write value";
+
+    return "";
+}
+
+static void printRecord( ostream& out, const char* name, const TraceRecord& record)
+{
+    out << name << ": pc 0x" << record.pc
+        << " instr 0x" << setw( 8) << record.instr << setw( 0)
+        << " next_pc 0x" << record.next_pc;
+    if ( record.dst_reg != TRACE_NO_REG)
+        out << " $" << dec << ( uint32)record.dst_reg << hex
+            << " = 0x" << record.dst_value;
+    if ( record.mem_size != 0)
+        out << ( record.is_store ? " store " : " load ") << dec << ( uint32)record.mem_size << hex
+            << " bytes [0x" << record.mem_addr << "] = 0x" << record.mem_value;
+    out << endl;
+}
+
+string CosimChecker::report( const CosimMismatch& mismatch)
+{
+    ostringstream oss;
+    oss << "Divergence at instruction " << mismatch.index
+        << " in " << mismatch.reason << endl;
+    oss << hex << setfill( '0');
+    printRecord( oss, "expected", mismatch.expected);
+    printRecord( oss, "actual  ", mismatch.actual);
+    return oss.str();
+}
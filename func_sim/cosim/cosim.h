@@ -0,0 +1,95 @@
+/**
+ * cosim.h - Header of the lockstep co-simulation checker. The instructions
+ * retired by the timing model are compared one by one with the ones executed
+ * by an independent functional model, the comparison runs on its own thread
+ * and gets the retired instructions in batches through a queue.
+ * Copyright 2015 MIPT-MIPS iLab project
+ */
+
+// protection from multi-include
+#ifndef COSIM__COSIM_H
+#define COSIM__COSIM_H
+
+// Generic C++
+#include <string>
+#include <thread>
+
+// uArchSim modules
+#include <types.h>
+#include <trace_record.h>
+#include <trace_queue.h>
+
+using namespace std;
+
+// The functional model the timing model is checked against,
+// usually a simulator with its own FuncMemory and registers
+class ReferenceModel
+{
+    public:
+        virtual ~ReferenceModel() { }
+
+        // Executes the next instruction and describes it in the record.
+        // Returns false if the program has finished.
+        virtual bool step( TraceRecord& record /*used as output*/) = 0;
+};
+
+struct CosimMismatch
+{
+    uint64 index;         // number of the instruction in the retired stream
+    TraceRecord expected; // executed by the reference model
+    TraceRecord actual;   // retired by the timing model
+    string reason;        // the first field that differs
+};
+
+class CosimChecker
+{
+        TraceQueue<TraceRecord> queue;
+        ReferenceModel& reference;
+        const size_t batch_size;
+
+        std::thread checker_thread;
+        bool finished;
+
+        // written by the checker thread, read after it is joined
+        uint64 num_checked;
+        bool diverged;
+        CosimMismatch mismatch;
+
+        void run();
+
+        // the checker is not copyable
+        CosimChecker( const CosimChecker&);
+        CosimChecker& operator=( const CosimChecker&);
+
+    public:
+        // The queue holds ( 1 << queue_bits) records, the checker takes
+        // up to batch_size of them at once.
+        CosimChecker( ReferenceModel& reference,
+                      uint32 queue_bits = 16, size_t batch_size = 256);
+        virtual ~CosimChecker();
+
+        // Called by the timing model for each retired instruction.
+        // Returns false after a divergence is found, so the run can stop.
+        inline bool retire( const TraceRecord& record)
+        {
+            return !queue.isStopped() && queue.push( record);
+        }
+
+        // Waits until all the retired instructions are checked.
+        // Returns false if the models have diverged or the reference
+        // model has instructions left after the last retired one.
+        bool finish();
+
+        // Valid after finish
+        inline uint64 checked() const { return num_checked; }
+        inline bool hasDiverged() const { return diverged; }
+        inline const CosimMismatch& getMismatch() const { return mismatch; }
+
+        // Returns the description of the first differing field or an empty string
+        static string compare( const TraceRecord& expected, const TraceRecord& actual);
+
+        // Both records of the mismatch field by field
+        static string report( const CosimMismatch& mismatch);
+};
+
+#endif // #ifndef COSIM__COSIM_H
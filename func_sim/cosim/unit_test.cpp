@@ -0,0 +1,157 @@
+// generic C
+#include <cassert>
+#include <cstdlib>
+
+// Google Test library
+#include <gtest/gtest.h>
+
+// uArchSim modules
+#include <cosim.h>
+
+//
+// A program of num instructions: each one writes its number to $t0,
+// each 4th one stores it to the memory
+//
+static void makeRecord( uint64 i, TraceRecord& record)
+{
+    record = TraceRecord();
+    record.pc = 0x400000 + 4 * i;
+    record.next_pc = record.pc + 4;
+    record.instr = 0x24080000 | ( i & 0xffff); // addiu $t0, $zero, i
+    record.dst_reg = 8;
+    record.dst_value = i;
+    if ( i % 4 == 0)
+    {
+        record.mem_size = 4;
+        record.is_store = true;
+        record.mem_addr = 0x10000000 + 4 * i;
+        record.mem_value = i;
+    }
+}
+
+class CountingModel : public ReferenceModel
+{
+        uint64 next;
+        const uint64 num;
+
+    public:
+        CountingModel( uint64 num) : next( 0), num( num) { }
+
+        bool step( TraceRecord& record)
+        {
+            if ( next == num)
+                return false;
+            makeRecord( next++, record);
+            return true;
+        }
+};
+
+TEST( Cosim, Equal_Streams)
+{
+    const uint64 num = 100000;
+    CountingModel reference( num);
+    CosimChecker checker( reference, 8, 64);
+
+    TraceRecord record;
+    for ( uint64 i = 0; i < num; ++i)
+    {
+        makeRecord( i, record);
+        ASSERT_TRUE( checker.retire( record));
+    }
+
+    ASSERT_TRUE( checker.finish());
+    ASSERT_EQ( checker.checked(), num);
+}
+
+TEST( Cosim, Stop_At_First_Divergence)
+{
+    const uint64 num = 100000;
+    const uint64 wrong = 54321;
+    CountingModel reference( num);
+    CosimChecker checker( reference, 8, 64);
+
+    // the timing model stores a wrong value, then goes on until it is told to stop
+    TraceRecord record;
+    uint64 retired = 0;
+    for ( uint64 i = 0; i < num; ++i, ++retired)
+    {
+        makeRecord( i, record);
+        if ( i == wrong - 1 || i == wrong)
+            record.mem_value = 0xdead;
+        if ( !checker.retire( record))
+            break;
+    }
+
+    ASSERT_FALSE( checker.finish());
+    ASSERT_LT( retired, num);
+    ASSERT_EQ( checker.checked(), wrong - 1);
+
+    const CosimMismatch& mismatch = checker.getMismatch();
+    ASSERT_EQ( mismatch.index, wrong - 1);
+    ASSERT_EQ( mismatch.reason, "memory write value");
+    ASSERT_EQ( mismatch.expected.mem_value, wrong - 1);
+    ASSERT_EQ( mismatch.actual.mem_value, 0xdeadu);
+
+    string report = CosimChecker::report( mismatch);
+    ASSERT_NE( report.find( "instruction 54320"), string::npos);
+    ASSERT_NE( report.find( "= 0xdead"), string::npos);
+}
+
+TEST( Cosim, Compare_Fields)
+{
+    TraceRecord expected, actual;
+    makeRecord( 1, expected);
+    makeRecord( 1, actual);
+    ASSERT_EQ( CosimChecker::compare( expected, actual), "");
+
+    actual.dst_value = 2;
+    ASSERT_EQ( CosimChecker::compare( expected, actual), "destination register value");
+
+    // the loads are not compared by themselves
+    makeRecord( 1, actual);
+    actual.mem_size = 4;
+    actual.mem_addr = 0x1234;
+    ASSERT_EQ( CosimChecker::compare( expected, actual), "");
+
+    actual.is_store = true;
+    ASSERT_EQ( CosimChecker::compare( expected, actual), "memory write");
+
+    // the timing model retires more instructions than the program has
+    CountingModel reference( 1);
+    CosimChecker checker( reference);
+    makeRecord( 0, actual);
+    checker.retire( actual);
+    checker.retire( actual);
+    ASSERT_FALSE( checker.finish());
+    ASSERT_EQ( checker.getMismatch().reason, "the reference model has finished");
+}
+
+TEST( Cosim, Timing_Model_Finished_Early)
+{
+    const uint64 num = 1000;
+    CountingModel reference( num);
+    CosimChecker checker( reference, 8, 64);
+
+    // the timing model stops one instruction before the end of the program
+    TraceRecord record;
+    for ( uint64 i = 0; i < num - 1; ++i)
+    {
+        makeRecord( i, record);
+        ASSERT_TRUE( checker.retire( record));
+    }
+
+    ASSERT_FALSE( checker.finish());
+    ASSERT_EQ( checker.checked(), num - 1);
+
+    const CosimMismatch& mismatch = checker.getMismatch();
+    ASSERT_EQ( mismatch.index, num - 1);
+    ASSERT_EQ( mismatch.reason, "the timing model has finished early");
+    ASSERT_EQ( mismatch.expected.pc, 0x400000u + 4 * ( num - 1));
+}
+
+int main( int argc, char* argv[])
+{
+    ::testing::InitGoogleTest( &argc, argv);
+    ::testing::FLAGS_gtest_death_test_style = "threadsafe";
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,154 @@
+/**
+ * cp0.cpp - Implementation of the system control coprocessor (CP0):
+ * the exceptions and the timer interrupt.
+ * Copyright 2015 MIPT-MIPS iLab project
+ */
+
+// Generic C
+#include <cstdlib>
+
+// Generic C++
+#include <iostream>
+
+// uArchSim modules
+#include <cp0.h>
+
+using namespace std;
+
+void CP0::reset( uint64 cycle)
+{
+    status = 0;
+    cause = 0;
+    epc = 0;
+    badvaddr = 0;
+    compare = 0;
+    count_base = 0;
+    count_cycle = cycle;
+    rebase_count( cycle);
+}
+
+// Starts counting from the current Count at the cycle
+// and finds the next cycle when it equals Compare
+void CP0::rebase_count( uint64 cycle)
+{
+    count_base = read( CP0_COUNT, cycle);
+    count_cycle = cycle;
+
+    // Count equal to Compare now matches after a wraparound
+    uint64 delta = ( uint32)( compare - count_base);
+    timer_cycle = cycle + ( delta == 0 ? 1ull << 32 : delta);
+}
+
+uint32 CP0::read( Cp0Reg reg, uint64 cycle) const
+{
+    switch ( reg)
+    {
+        case CP0_BADVADDR:
+            return badvaddr;
+        case CP0_COUNT:
+            return count_base + ( uint32)( cycle - count_cycle);
+        case CP0_COMPARE:
+            return compare;
+        case CP0_STATUS:
+            return status;
+        case CP0_CAUSE:
+            return cause;
+        case CP0_EPC:
+            return epc;
+        default:
+            cerr << "ERROR: CP0 register " << reg << " is not supported" << endl;
+            exit( EXIT_FAILURE);
+    }
+}
+
+void CP0::write( Cp0Reg reg, uint32 value, uint64 cycle)
+{
+    switch ( reg)
+    {
+        case CP0_BADVADDR:
+            // read-only
+            break;
+        case CP0_COUNT:
+            count_base = value;
+            count_cycle = cycle;
+            rebase_count( cycle);
+            break;
+        case CP0_COMPARE:
+            // the write acknowledges the timer interrupt
+            compare = value;
+            cause &= ~( CAUSE_TI | CAUSE_IP_TIMER);
+            rebase_count( cycle);
+            break;
+        case CP0_STATUS:
+            status = value;
+            break;
+        case CP0_CAUSE:
+            cause = ( cause & ~CAUSE_IP_SW) | ( value & CAUSE_IP_SW);
+            break;
+        case CP0_EPC:
+            epc = value;
+            break;
+        default:
+            cerr << "ERROR: CP0 register " << reg << " is not supported" << endl;
+            exit( EXIT_FAILURE);
+    }
+}
+
+uint64 CP0::raise( ExcCode code, uint64 pc, bool in_delay_slot, uint64 bad_addr)
+{
+    // an exception in a handler does not change the return address
+    if ( ( status & STATUS_EXL) == 0)
+    {
+        // the branch is executed again after the handler
+        epc = in_delay_slot ? pc - 4 : pc;
+        cause = in_delay_slot ? ( cause | CAUSE_BD) : ( cause & ~CAUSE_BD);
+    }
+    cause = ( cause & ~CAUSE_EXC_MASK) | ( code << CAUSE_EXC_SHIFT);
+
+    switch ( code)
+    {
+        case EXC_MOD:
+        case EXC_TLBL:
+        case EXC_TLBS:
+        case EXC_ADEL:
+        case EXC_ADES:
+            badvaddr = bad_addr;
+            break;
+        default:
+            break;
+    }
+
+    status |= STATUS_EXL;
+    return exceptionVector();
+}
+
+uint64 CP0::eret()
+{
+    status &= ~STATUS_EXL;
+    return epc;
+}
+
+bool CP0::checkInterrupts( uint64 cycle, uint64& pc, bool in_delay_slot)
+{
+    if ( cycle >= timer_cycle)
+    {
+        // the request stays until Compare is written
+        cause |= CAUSE_TI | CAUSE_IP_TIMER;
+        rebase_count( cycle);
+    }
+
+    if ( !interruptPending())
+        return false;
+
+    pc = raise( EXC_INT, pc, in_delay_slot);
+    return true;
+}
+
+bool CP0::syscall( const FuncMemory& memory, uint64& pc, bool in_delay_slot)
+{
+    if ( ( memory.pageProt( exceptionVector()) & MEM_EXEC) == 0)
+        return false;
+
+    pc = raise( EXC_SYS, pc, in_delay_slot);
+    return true;
+}
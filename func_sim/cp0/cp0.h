@@ -0,0 +1,194 @@
+/**
+ * cp0.h - Header of the system control coprocessor (CP0) of MIPS32:
+ * the registers of the exceptions (Status, Cause, EPC, BadVAddr)
+ * and of the timer (Count, Compare), and the checks the instructions
+ * use to raise precise exceptions.
+ * Copyright 2015 MIPT-MIPS iLab project
+ */
+
+// protection from multi-include
+#ifndef CP0__CP0_H
+#define CP0__CP0_H
+
+// uArchSim modules
+#include <types.h>
+#include <func_memory.h>
+
+// the numbers of the registers used by mfc0 and mtc0
+enum Cp0Reg
+{
+    CP0_BADVADDR = 8,
+    CP0_COUNT = 9,
+    CP0_COMPARE = 11,
+    CP0_STATUS = 12,
+    CP0_CAUSE = 13,
+    CP0_EPC = 14
+};
+
+// the codes of Cause.ExcCode
+enum ExcCode
+{
+    EXC_INT = 0,   // interrupt
+    EXC_MOD = 1,   // store to a page without the write permission
+    EXC_TLBL = 2,  // load or fetch of a page the memory does not allow
+    EXC_TLBS = 3,  // store to a page without data
+    EXC_ADEL = 4,  // misaligned load or fetch
+    EXC_ADES = 5,  // misaligned store
+    EXC_SYS = 8,   // syscall
+    EXC_BP = 9,    // break
+    EXC_RI = 10,   // reserved instruction
+    EXC_OV = 12,   // overflow of add, addi and sub
+    EXC_NONE = 32  // not a code of Cause: there is no exception
+};
+
+enum GuestAccess
+{
+    ACCESS_LOAD,
+    ACCESS_STORE,
+    ACCESS_FETCH
+};
+
+// the bits of Status
+static const uint32 STATUS_IE = 1 << 0;
+static const uint32 STATUS_EXL = 1 << 1;
+static const uint32 STATUS_UM = 1 << 4;
+static const uint32 STATUS_IM_TIMER = 1 << 15;
+static const uint32 STATUS_BEV = 1 << 22;
+
+// the bits of Cause
+static const uint32 CAUSE_EXC_SHIFT = 2;
+static const uint32 CAUSE_EXC_MASK = 0x1f << CAUSE_EXC_SHIFT;
+static const uint32 CAUSE_IP_MASK = 0xff00;
+static const uint32 CAUSE_IP_SW = 0x0300; // the software interrupts are written by mtc0
+static const uint32 CAUSE_IP_TIMER = 1 << 15;
+static const uint32 CAUSE_TI = 1 << 30;
+static const uint32 CAUSE_BD = 1u << 31;
+
+// the general exception vectors with Status.BEV off and on
+static const uint64 EXCEPTION_VECTOR = 0x80000180;
+static const uint64 EXCEPTION_VECTOR_BEV = 0xbfc00380;
+
+class CP0
+{
+        uint32 status;
+        uint32 cause;
+        uint32 epc;
+        uint32 badvaddr;
+        uint32 compare;
+
+        // Count is not incremented each cycle, it is found from the cycle:
+        // it was count_base at count_cycle
+        uint32 count_base;
+        uint64 count_cycle;
+        uint64 timer_cycle; // the next cycle when Count equals Compare
+
+        void rebase_count( uint64 cycle);
+
+        // a checkpoint stores the registers and the timer as they are
+        friend class Checkpoint;
+
+    public:
+        // The simulator has no boot ROM, the handlers are in the RAM,
+        // so Status.BEV is off after the reset
+        explicit CP0( uint64 cycle = 0) { reset( cycle); }
+        void reset( uint64 cycle = 0);
+
+        // mfc0 and mtc0, the cycle is the one of the instruction
+        uint32 read( Cp0Reg reg, uint64 cycle) const;
+        void write( Cp0Reg reg, uint32 value, uint64 cycle);
+
+        // The handler of the exceptions with the current Status.BEV
+        inline uint64 exceptionVector() const
+        {
+            return ( status & STATUS_BEV) != 0 ? EXCEPTION_VECTOR_BEV : EXCEPTION_VECTOR;
+        }
+
+        // Records the exception of the instruction at pc, which is not done,
+        // so the exception is precise. Returns the address of the handler.
+        // The bad address is kept for the address errors and the faults.
+        uint64 raise( ExcCode code, uint64 pc, bool in_delay_slot, uint64 bad_addr = 0);
+        // eret: returns the pc to continue from
+        uint64 eret();
+
+        // The simulator emulates the syscalls of a program that has no handler
+        // of the exceptions. The guest has one if the page of the vector
+        // is executable: then EXC_SYS is raised and true and the handler
+        // are returned in pc. Otherwise the syscall is for the simulator to do.
+        bool syscall( const FuncMemory& memory, uint64& pc /*used as output*/, bool in_delay_slot);
+
+        // The run loop does nothing about the interrupts before this cycle,
+        // so the usual path of an instruction has no checks at all.
+        // It is read again after mtc0, eret and an exception.
+        inline uint64 nextEvent() const
+        {
+            return interruptPending() ? 0 : timer_cycle;
+        }
+        // Called from the cycle of nextEvent() on, before the instruction
+        // at pc is executed. Returns true and the handler in pc
+        // if an interrupt is taken.
+        bool checkInterrupts( uint64 cycle, uint64& pc /*used as output*/, bool in_delay_slot);
+
+        inline bool interruptPending() const
+        {
+            return ( status & ( STATUS_IE | STATUS_EXL)) == STATUS_IE
+                   && ( cause & status & CAUSE_IP_MASK) != 0;
+        }
+        inline ExcCode excCode() const
+        {
+            return ( ExcCode)( ( cause & CAUSE_EXC_MASK) >> CAUSE_EXC_SHIFT);
+        }
+        inline bool inException() const { return ( status & STATUS_EXL) != 0; }
+
+        // The overflow is found from the sum itself,
+        // so add and addi cost one predicted branch more than addu and addiu
+        static inline bool addOverflows( uint32 a, uint32 b, uint32& sum /*used as output*/)
+        {
+            sum = a + b;
+            return ( ( ~( a ^ b) & ( a ^ sum)) >> 31) != 0;
+        }
+        static inline bool subOverflows( uint32 a, uint32 b, uint32& diff /*used as output*/)
+        {
+            diff = a - b;
+            return ( ( ( a ^ b) & ( a ^ diff)) >> 31) != 0;
+        }
+
+        // The load, store or fetch of a guest instruction: the alignment test
+        // and one lookup of the page by the memory. Returns EXC_NONE,
+        // or the exception to raise and nothing is done.
+        static inline ExcCode load( const FuncMemory& memory, uint64 addr, uint32 size,
+                                    uint64& value /*used as output*/)
+        {
+            if ( ( addr & ( size - 1)) != 0)
+                return EXC_ADEL;
+            return accessFault( memory.readAccess( addr, size, value), ACCESS_LOAD);
+        }
+        static inline ExcCode store( FuncMemory& memory, uint64 addr, uint32 size, uint64 value)
+        {
+            if ( ( addr & ( size - 1)) != 0)
+                return EXC_ADES;
+            return accessFault( memory.writeAccess( value, addr, size), ACCESS_STORE);
+        }
+        static inline ExcCode fetch( const FuncMemory& memory, uint64 addr,
+                                     uint32& value /*used as output*/)
+        {
+            if ( ( addr & 3) != 0)
+                return EXC_ADEL;
+            return accessFault( memory.fetchAccess( addr, value), ACCESS_FETCH);
+        }
+
+        // The exception of the fault of a memory access
+        static inline ExcCode accessFault( MemoryFault fault, GuestAccess access)
+        {
+            switch ( fault)
+            {
+                case FAULT_NONE:
+                    return EXC_NONE;
+                case FAULT_PROTECTION:
+                    return access == ACCESS_STORE ? EXC_MOD : EXC_TLBL;
+                default:
+                    return access == ACCESS_STORE ? EXC_TLBS : EXC_TLBL;
+            }
+        }
+};
+
+#endif // #ifndef CP0__CP0_H
@@ -0,0 +1,232 @@
+// generic C
+#include <cassert>
+#include <cstdlib>
+
+// Generic C++
+#include <algorithm>
+
+// Google Test library
+#include <gtest/gtest.h>
+
+// uArchSim modules
+#include <cp0.h>
+
+static const char* sample_file = "../../tests/samples/memcpy.out";
+
+//
+// The run loop of a core executing nops from pc till end_cycle:
+// the interrupts are looked at only at the cycles of the events,
+// the handler acknowledges the timer and sets it period cycles later.
+// Returns the number of the interrupts taken.
+//
+static uint32 runNops( CP0& cp0, uint64& cycle, uint64 end_cycle, uint64& pc, uint32 period)
+{
+    uint32 interrupts = 0;
+    while ( cycle < end_cycle)
+    {
+        uint64 stop = std::min( end_cycle, cp0.nextEvent());
+        for ( ; cycle < stop; ++cycle)
+            pc += 4;
+
+        if ( cycle < end_cycle && cp0.checkInterrupts( cycle, pc, false))
+        {
+            ++interrupts;
+            assert( pc == EXCEPTION_VECTOR);
+            cp0.write( CP0_COMPARE, cp0.read( CP0_COMPARE, cycle) + period, cycle);
+            pc = cp0.eret();
+            ++cycle;
+        }
+    }
+    return interrupts;
+}
+
+TEST( Cp0, Overflow)
+{
+    uint32 result = 0;
+
+    // add $t0, $s1, $s2 of tests/samples/add.s
+    ASSERT_FALSE( CP0::addOverflows( 1, 2, result));
+    ASSERT_EQ( result, 3u);
+    ASSERT_FALSE( CP0::addOverflows( 0xffffffff, 0xffffffff, result));
+    ASSERT_TRUE( CP0::addOverflows( 0x7fffffff, 1, result));
+    ASSERT_TRUE( CP0::addOverflows( 0x80000000, 0x80000000, result));
+    ASSERT_FALSE( CP0::subOverflows( 0, 0x7fffffff, result));
+    ASSERT_TRUE( CP0::subOverflows( 0x80000000, 1, result));
+    ASSERT_TRUE( CP0::subOverflows( 0, 0x80000000, result));
+
+    // the exception is precise: the add is done again after the handler
+    CP0 cp0;
+    ASSERT_EQ( cp0.raise( EXC_OV, 0x400010, false), EXCEPTION_VECTOR);
+    ASSERT_EQ( cp0.excCode(), EXC_OV);
+    ASSERT_TRUE( cp0.inException());
+    ASSERT_EQ( cp0.read( CP0_EPC, 0), 0x400010u);
+    ASSERT_EQ( cp0.read( CP0_CAUSE, 0) & CAUSE_BD, 0u);
+
+    // an exception in the handler keeps the return address
+    cp0.raise( EXC_RI, EXCEPTION_VECTOR, false);
+    ASSERT_EQ( cp0.excCode(), EXC_RI);
+    ASSERT_EQ( cp0.eret(), 0x400010u);
+    ASSERT_FALSE( cp0.inException());
+
+    // in a delay slot the branch is done again
+    cp0.raise( EXC_OV, 0x400020, true);
+    ASSERT_EQ( cp0.read( CP0_EPC, 0), 0x40001cu);
+    ASSERT_NE( cp0.read( CP0_CAUSE, 0) & CAUSE_BD, 0u);
+}
+
+TEST( Cp0, Syscall)
+{
+    CP0 cp0;
+    cp0.write( CP0_STATUS, STATUS_BEV, 0);
+    cp0.raise( EXC_ADEL, 0x400000, false, 0x400001);
+    cp0.eret();
+
+    ASSERT_EQ( cp0.raise( EXC_SYS, 0x400008, false), EXCEPTION_VECTOR_BEV);
+    ASSERT_EQ( cp0.excCode(), EXC_SYS);
+    ASSERT_EQ( cp0.read( CP0_BADVADDR, 0), 0x400001u);
+
+    // the handler continues from the next instruction
+    cp0.write( CP0_EPC, cp0.read( CP0_EPC, 0) + 4, 0);
+    ASSERT_EQ( cp0.eret(), 0x40000cu);
+
+    // BadVAddr is read-only
+    cp0.write( CP0_BADVADDR, 0, 0);
+    ASSERT_EQ( cp0.read( CP0_BADVADDR, 0), 0x400001u);
+}
+
+TEST( Cp0, Syscall_Handler)
+{
+    FuncMemory memory( sample_file);
+    CP0 cp0;
+    uint64 pc = 0x400008;
+
+    // the program has no handler, the simulator emulates the syscall
+    ASSERT_FALSE( cp0.syscall( memory, pc, false));
+    ASSERT_EQ( pc, 0x400008u);
+    ASSERT_FALSE( cp0.inException());
+
+    // a data page at the vector is not a handler
+    uint64 vector_page = EXCEPTION_VECTOR & ~( memory.pageSize() - 1);
+    ASSERT_TRUE( memory.addRegion( "handler", vector_page, memory.pageSize(),
+                                   MEM_READ | MEM_WRITE));
+    ASSERT_FALSE( cp0.syscall( memory, pc, false));
+
+    // the guest handles its syscalls itself
+    ASSERT_TRUE( memory.setProtection( vector_page, memory.pageSize(), MEM_READ | MEM_EXEC));
+    ASSERT_TRUE( cp0.syscall( memory, pc, false));
+    ASSERT_EQ( pc, EXCEPTION_VECTOR);
+    ASSERT_EQ( cp0.excCode(), EXC_SYS);
+    ASSERT_EQ( cp0.read( CP0_EPC, 0), 0x400008u);
+
+    // the vector of Status.BEV has no handler
+    cp0.eret();
+    cp0.write( CP0_STATUS, STATUS_BEV, 0);
+    ASSERT_FALSE( cp0.syscall( memory, pc, false));
+}
+
+TEST( Cp0, Address_Errors)
+{
+    FuncMemory memory( sample_file);
+    uint64 pc = memory.startPC();
+    uint64 data_addr = 0;
+    for ( size_t i = 0; i < memory.getRegions().size(); ++i)
+        if ( ( memory.getRegions()[ i].prot & MEM_WRITE) != 0)
+            data_addr = memory.getRegions()[ i].start_addr;
+    ASSERT_NE( data_addr, 0u);
+    uint64 sp = memory.setupStack( vector<string>( 1, sample_file), vector<string>());
+
+    uint64 value = 0;
+    uint32 word = 0;
+
+    // the allowed accesses are done
+    ASSERT_EQ( CP0::fetch( memory, pc, word), EXC_NONE);
+    ASSERT_EQ( word, memory.read( pc));
+    ASSERT_EQ( CP0::store( memory, data_addr, 4, 0x12345678), EXC_NONE);
+    ASSERT_EQ( CP0::load( memory, data_addr, 2, value), EXC_NONE);
+    ASSERT_EQ( value, 0x5678u);
+    ASSERT_EQ( CP0::load( memory, sp, 4, value), EXC_NONE);
+
+    // misaligned addresses
+    ASSERT_EQ( CP0::fetch( memory, pc + 2, word), EXC_ADEL);
+    ASSERT_EQ( CP0::load( memory, data_addr + 1, 2, value), EXC_ADEL);
+    ASSERT_EQ( CP0::store( memory, data_addr + 2, 4, 0), EXC_ADES);
+
+    // the pages the memory does not allow
+    ASSERT_EQ( CP0::store( memory, pc, 4, 0), EXC_MOD);
+    ASSERT_EQ( CP0::fetch( memory, data_addr, word), EXC_TLBL);
+    memory.setRegionChecks( true);
+    ASSERT_EQ( CP0::load( memory, memory.programBreak(), 4, value), EXC_TLBL);
+    ASSERT_EQ( CP0::store( memory, memory.programBreak(), 4, 0), EXC_TLBS);
+
+    // a store of the code is caught before it is done
+    CP0 cp0;
+    ExcCode code = CP0::store( memory, pc, 4, 0);
+    if ( code != EXC_NONE)
+        cp0.raise( code, pc + 8, false, pc);
+    ASSERT_EQ( cp0.excCode(), EXC_MOD);
+    ASSERT_EQ( cp0.read( CP0_BADVADDR, 0), pc);
+    ASSERT_EQ( memory.read( pc), word);
+    ASSERT_NE( word, 0u);
+}
+
+TEST( Cp0, Timer_Interrupt)
+{
+    CP0 cp0;
+    cp0.write( CP0_STATUS, STATUS_IE | STATUS_IM_TIMER, 0);
+    cp0.write( CP0_COMPARE, 100, 0);
+    ASSERT_EQ( cp0.nextEvent(), 100u);
+
+    // the interrupt comes before the instruction of the cycle
+    uint64 pc = 0x400190;
+    ASSERT_FALSE( cp0.checkInterrupts( 99, pc, false));
+    ASSERT_EQ( cp0.read( CP0_COUNT, 99), 99u);
+    ASSERT_TRUE( cp0.checkInterrupts( 100, pc, false));
+    ASSERT_EQ( pc, EXCEPTION_VECTOR);
+    ASSERT_EQ( cp0.read( CP0_EPC, 100), 0x400190u);
+    ASSERT_EQ( cp0.excCode(), EXC_INT);
+    ASSERT_NE( cp0.read( CP0_CAUSE, 100) & CAUSE_TI, 0u);
+
+    // the handler runs with the interrupts off, they are on after eret
+    // until the request is acknowledged by a write of Compare
+    ASSERT_EQ( cp0.nextEvent(), 100 + ( 1ull << 32));
+    ASSERT_EQ( cp0.eret(), 0x400190u);
+    ASSERT_EQ( cp0.nextEvent(), 0u);
+    cp0.write( CP0_COMPARE, 250, 150);
+    ASSERT_EQ( cp0.nextEvent(), 250u);
+    ASSERT_EQ( cp0.read( CP0_CAUSE, 150) & CAUSE_IP_TIMER, 0u);
+
+    // the masked timer sets the request, but it is not taken
+    cp0.write( CP0_STATUS, STATUS_IE, 200);
+    ASSERT_FALSE( cp0.checkInterrupts( 250, pc, false));
+    ASSERT_NE( cp0.read( CP0_CAUSE, 250) & CAUSE_IP_TIMER, 0u);
+
+    // Count is written as well
+    cp0.write( CP0_COUNT, 0xfffffff0, 300);
+    cp0.write( CP0_COMPARE, 0x10, 300);
+    ASSERT_EQ( cp0.nextEvent(), 300u + 0x20);
+    ASSERT_EQ( cp0.read( CP0_COUNT, 300 + 0x20), 0x10u);
+}
+
+TEST( Cp0, Run_Loop)
+{
+    // a timer interrupt each 100 cycles, a run of 1000 cycles
+    CP0 cp0;
+    cp0.write( CP0_STATUS, STATUS_IE | STATUS_IM_TIMER, 0);
+    cp0.write( CP0_COMPARE, 100, 0);
+
+    uint64 cycle = 0;
+    uint64 pc = 0x400000;
+    ASSERT_EQ( runNops( cp0, cycle, 1000, pc, 100), 9u);
+    ASSERT_EQ( cycle, 1000u);
+    ASSERT_FALSE( cp0.inException());
+
+    // the interrupted instructions are not lost
+    ASSERT_EQ( pc, 0x400000u + 4 * ( 1000 - 9));
+}
+
+int main( int argc, char* argv[])
+{
+    ::testing::InitGoogleTest( &argc, argv);
+    ::testing::FLAGS_gtest_death_test_style = "threadsafe";
+    return RUN_ALL_TESTS();
+}
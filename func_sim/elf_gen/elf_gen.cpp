@@ -0,0 +1,308 @@
+/**
+ * elf_gen.cpp - Implementation of the generator of synthetic MIPS ELF files.
+ * Copyright 2015 MIPT-MIPS iLab project
+ */
+
+// Generic C
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <gelf.h>
+
+// Generic C++
+#include <vector>
+#include <sstream>
+
+// uArchSim modules
+#include <elf_gen.h>
+
+const uint32 ElfGen::code[ 2] = { 0x03e00008 /*jr $ra*/, 0 /*nop*/};
+const char* ElfGen::entry_name = "__start";
+
+static const uint64 PAGE_SIZE = 0x1000;
+
+static inline uint64 alignUp( uint64 value, uint64 align)
+{
+    return ( value + align - 1) / align * align;
+}
+
+// Puts the fields of the headers in the byte order of the file
+class ElfWriter
+{
+        vector<uint8>& buf;
+        const bool big_endian;
+
+    public:
+        ElfWriter( vector<uint8>& buf, bool big_endian)
+            : buf( buf), big_endian( big_endian)
+        { }
+
+        void put( uint64 value, size_t size)
+        {
+            for ( size_t i = 0; i < size; ++i)
+            {
+                size_t byte_num = big_endian ? size - 1 - i : i;
+                buf.push_back( value >> ( 8 * byte_num));
+            }
+        }
+        inline void u8( uint64 value) { put( value, 1); }
+        inline void u16( uint64 value) { put( value, 2); }
+        inline void u32( uint64 value) { put( value, 4); }
+};
+
+uint64 ElfGen::sectionAddr( const ElfGenConfig& config, uint32 section)
+{
+    // the code takes the 1st page, each section starts at a page
+    uint64 stride = alignUp( config.section_size + config.gap, PAGE_SIZE);
+    return config.start_addr + alignUp( sizeof( code) + config.gap, PAGE_SIZE)
+           + section * stride;
+}
+
+uint64 ElfGen::symbolAddr( const ElfGenConfig& config, uint32 symbol)
+{
+    uint32 section = symbol % config.num_sections;
+    uint64 slots = config.section_size / 16;
+    return sectionAddr( config, section) + ( symbol / config.num_sections % slots) * 16;
+}
+
+uint64 ElfGen::bssAddr( const ElfGenConfig& config)
+{
+    return sectionAddr( config, config.num_sections);
+}
+
+struct GenSection
+{
+    uint32 name;
+    uint32 type;
+    uint32 flags;
+    uint64 addr;
+    uint64 offset;
+    uint64 size;
+    uint32 link;
+    uint32 info;
+    uint32 align;
+    uint32 entsize;
+};
+
+static bool writeAll( FILE* file, const vector<uint8>& buf)
+{
+    return buf.empty() || fwrite( &buf[ 0], 1, buf.size(), file) == buf.size();
+}
+
+static bool writeZeros( FILE* file, uint64 size)
+{
+    static const uint8 zeros[ 4096] = { 0};
+    while ( size != 0)
+    {
+        uint64 chunk = size < sizeof( zeros) ? size : sizeof( zeros);
+        if ( fwrite( zeros, 1, chunk, file) != chunk)
+            return false;
+        size -= chunk;
+    }
+    return true;
+}
+
+bool ElfGen::generate( const char* file_name, const ElfGenConfig& config, string& error)
+{
+    if ( config.num_sections == 0 || config.num_sections > 60000
+         || config.section_size < 16 || config.start_addr % PAGE_SIZE != 0
+         || bssAddr( config) + config.bss_size > 0x100000000ull)
+    {
+        error = "wrong configuration of the generated file";
+        return false;
+    }
+
+    // names of the sections and the symbols
+    string shstrtab( 1, '\0');
+    string strtab( 1, '\0');
+
+    vector<GenSection> sections( 1); // the null section
+    memset( &sections[ 0], 0, sizeof( sections[ 0]));
+
+    uint32 num_segments = 1 + config.num_sections + ( config.bss_size != 0 ? 1 : 0);
+    uint64 offset = alignUp( sizeof( Elf32_Ehdr) + num_segments * sizeof( Elf32_Phdr), PAGE_SIZE);
+
+    GenSection section;
+    memset( &section, 0, sizeof( section));
+    section.name = shstrtab.size();
+    shstrtab.append( ".text").push_back( '\0');
+    section.type = SHT_PROGBITS;
+    section.flags = SHF_ALLOC | SHF_EXECINSTR;
+    section.addr = config.start_addr;
+    section.offset = offset;
+    section.size = sizeof( code);
+    section.align = 16;
+    sections.push_back( section);
+    offset += PAGE_SIZE;
+
+    for ( uint32 i = 0; i < config.num_sections; ++i)
+    {
+        ostringstream name;
+        name << ".data." << i;
+        section.name = shstrtab.size();
+        shstrtab.append( name.str()).push_back( '\0');
+        section.type = SHT_PROGBITS;
+        section.flags = SHF_ALLOC | SHF_WRITE;
+        section.addr = sectionAddr( config, i);
+        section.offset = offset;
+        section.size = config.section_size;
+        sections.push_back( section);
+        offset += alignUp( config.section_size, PAGE_SIZE);
+    }
+
+    if ( config.bss_size != 0)
+    {
+        section.name = shstrtab.size();
+        shstrtab.append( ".bss").push_back( '\0');
+        section.type = SHT_NOBITS;
+        section.flags = SHF_ALLOC | SHF_WRITE;
+        section.addr = bssAddr( config);
+        section.offset = offset;
+        section.size = config.bss_size;
+        sections.push_back( section);
+    }
+
+    // the symbol table: the null symbol, the entry and the data symbols
+    vector<uint8> symtab;
+    ElfWriter sym( symtab, config.big_endian);
+    sym.u32( 0); sym.u32( 0); sym.u32( 0); sym.u8( 0); sym.u8( 0); sym.u16( 0);
+
+    sym.u32( strtab.size());
+    strtab.append( entry_name).push_back( '\0');
+    sym.u32( config.start_addr); sym.u32( sizeof( code));
+    sym.u8( ELF32_ST_INFO( STB_GLOBAL, STT_FUNC)); sym.u8( 0); sym.u16( 1);
+
+    for ( uint32 i = 0; i < config.num_symbols; ++i)
+    {
+        ostringstream name;
+        name << "sym_" << i;
+        sym.u32( strtab.size());
+        strtab.append( name.str()).push_back( '\0');
+        sym.u32( symbolAddr( config, i)); sym.u32( 16);
+        sym.u8( ELF32_ST_INFO( STB_GLOBAL, STT_OBJECT)); sym.u8( 0);
+        sym.u16( 2 + i % config.num_sections);
+    }
+
+    uint32 symtab_index = sections.size();
+    section.name = shstrtab.size();
+    shstrtab.append( ".symtab").push_back( '\0');
+    section.type = SHT_SYMTAB;
+    section.flags = 0;
+    section.addr = 0;
+    section.offset = offset;
+    section.size = symtab.size();
+    section.link = symtab_index + 1;
+    section.info = 1; // the index of the 1st global symbol
+    section.align = 4;
+    section.entsize = sizeof( Elf32_Sym);
+    sections.push_back( section);
+    offset += symtab.size();
+
+    section.name = shstrtab.size();
+    shstrtab.append( ".strtab").push_back( '\0');
+    section.type = SHT_STRTAB;
+    section.offset = offset;
+    section.size = strtab.size();
+    section.link = 0;
+    section.info = 0;
+    section.align = 1;
+    section.entsize = 0;
+    sections.push_back( section);
+    offset += strtab.size();
+
+    uint32 shstrtab_index = sections.size();
+    section.name = shstrtab.size();
+    shstrtab.append( ".shstrtab").push_back( '\0');
+    section.offset = offset;
+    section.size = shstrtab.size();
+    sections.push_back( section);
+    offset += shstrtab.size();
+
+    uint64 shdr_offset = alignUp( offset, 4);
+
+    // the ELF header and the program headers
+    vector<uint8> headers;
+    ElfWriter hdr( headers, config.big_endian);
+    const uint8 ident[ EI_NIDENT] = { ELFMAG0, ELFMAG1, ELFMAG2, ELFMAG3,
+                                      ELFCLASS32,
+                                      ( uint8)( config.big_endian ? ELFDATA2MSB : ELFDATA2LSB),
+                                      EV_CURRENT};
+    headers.insert( headers.end(), ident, ident + EI_NIDENT);
+    hdr.u16( ET_EXEC); hdr.u16( EM_MIPS); hdr.u32( EV_CURRENT);
+    hdr.u32( config.start_addr); // entry
+    hdr.u32( sizeof( Elf32_Ehdr)); // program headers
+    hdr.u32( shdr_offset);
+    hdr.u32( 0x50001000); // EF_MIPS_ARCH_32 | EF_MIPS_ABI_O32
+    hdr.u16( sizeof( Elf32_Ehdr)); hdr.u16( sizeof( Elf32_Phdr)); hdr.u16( num_segments);
+    hdr.u16( sizeof( Elf32_Shdr)); hdr.u16( sections.size()); hdr.u16( shstrtab_index);
+
+    for ( uint32 i = 1; i <= num_segments; ++i)
+    {
+        const GenSection& s = sections[ i];
+        bool nobits = s.type == SHT_NOBITS;
+        hdr.u32( PT_LOAD);
+        hdr.u32( s.offset); hdr.u32( s.addr); hdr.u32( s.addr);
+        hdr.u32( nobits ? 0 : s.size); hdr.u32( s.size);
+        hdr.u32( ( s.flags & SHF_EXECINSTR) ? PF_R | PF_X : PF_R | PF_W);
+        hdr.u32( PAGE_SIZE);
+    }
+
+    FILE* file = fopen( file_name, "wb");
+    if ( !file)
+    {
+        error = string( "Could not open file ") + file_name + ": " + strerror( errno);
+        return false;
+    }
+
+    bool ok = writeAll( file, headers)
+              && writeZeros( file, sections[ 1].offset - headers.size());
+
+    // the code
+    vector<uint8> buf;
+    ElfWriter text( buf, config.big_endian);
+    text.u32( code[ 0]);
+    text.u32( code[ 1]);
+    ok = ok && writeAll( file, buf) && writeZeros( file, PAGE_SIZE - buf.size());
+
+    // the data sections are written in chunks, so the size of the file is not limited
+    for ( uint32 i = 0; ok && i < config.num_sections; ++i)
+    {
+        const GenSection& s = sections[ 2 + i];
+        for ( uint64 done = 0; ok && done < s.size; )
+        {
+            uint64 chunk = s.size - done < ( 1 << 16) ? s.size - done : ( 1 << 16);
+            buf.resize( chunk);
+            for ( uint64 j = 0; j < chunk; ++j)
+                buf[ j] = dataByte( config, s.addr + done + j);
+            ok = writeAll( file, buf);
+            done += chunk;
+        }
+        ok = ok && writeZeros( file, alignUp( s.size, PAGE_SIZE) - s.size);
+    }
+
+    ok = ok && writeAll( file, symtab)
+         && fwrite( strtab.data(), 1, strtab.size(), file) == strtab.size()
+         && fwrite( shstrtab.data(), 1, shstrtab.size(), file) == shstrtab.size()
+         && writeZeros( file, shdr_offset - offset);
+
+    // the section headers
+    buf.clear();
+    ElfWriter shdr( buf, config.big_endian);
+    for ( size_t i = 0; i < sections.size(); ++i)
+    {
+        const GenSection& s = sections[ i];
+        shdr.u32( s.name); shdr.u32( s.type); shdr.u32( s.flags);
+        shdr.u32( s.addr); shdr.u32( s.offset); shdr.u32( s.size);
+        shdr.u32( s.link); shdr.u32( s.info); shdr.u32( s.align); shdr.u32( s.entsize);
+    }
+    ok = ok && writeAll( file, buf);
+
+    if ( fclose( file) != 0)
+        ok = false;
+    if ( !ok)
+    {
+        error = string( "Could not write file ") + file_name + ": " + strerror( errno);
+        remove( file_name);
+    }
+    return ok;
+}
@@ -0,0 +1,63 @@
+/**
+ * elf_gen.h - Header of the generator of synthetic MIPS ELF files.
+ * The files have configurable numbers and sizes of sections, numbers
+ * of symbols and gaps between the sections, so the loader and the memory
+ * model can be tested on images of any scale without MIPS binutils.
+ * Copyright 2015 MIPT-MIPS iLab project
+ */
+
+// protection from multi-include
+#ifndef ELF_GEN__ELF_GEN_H
+#define ELF_GEN__ELF_GEN_H
+
+// Generic C++
+#include <string>
+
+// uArchSim modules
+#include <types.h>
+
+using namespace std;
+
+struct ElfGenConfig
+{
+    uint32 num_sections; // number of the data sections, each one has its own segment
+    uint64 section_size; // bytes in each data section
+    uint64 bss_size;     // size of the zero-initialized section after them, 0 for none
+    uint32 num_symbols;  // data symbols spread over the data sections
+    uint64 start_addr;   // address of the code, the data sections follow it
+    uint64 gap;          // unmapped bytes between the sections for sparse layouts
+    bool big_endian;
+    uint64 seed;         // defines the content of the data sections
+
+    ElfGenConfig()
+        : num_sections( 16), section_size( 4096), bss_size( 0),
+          num_symbols( 64), start_addr( 0x400000), gap( 0),
+          big_endian( false), seed( 1)
+    { }
+};
+
+class ElfGen
+{
+    public:
+        // Writes the file. Returns false and the description of the problem on failure.
+        static bool generate( const char* file_name, const ElfGenConfig& config,
+                              string& error /*used as output*/);
+
+        // The layout of the generated file, so the tests know what to expect
+        static uint64 sectionAddr( const ElfGenConfig& config, uint32 section);
+        static uint64 symbolAddr( const ElfGenConfig& config, uint32 symbol);
+        static uint64 bssAddr( const ElfGenConfig& config);
+
+        // The byte of a data section at the address
+        static inline uint8 dataByte( const ElfGenConfig& config, uint64 addr)
+        {
+            uint64 x = ( addr ^ config.seed) * 0x9e3779b97f4a7c15ull;
+            return x >> 56;
+        }
+
+        // The code at the start address: "jr $ra" and "nop"
+        static const uint32 code[ 2];
+        static const char* entry_name;
+};
+
+#endif // #ifndef ELF_GEN__ELF_GEN_H
@@ -0,0 +1,87 @@
+// Generic C
+#include <string.h>
+#include <stdlib.h>
+
+// Generic C++
+#include <iostream>
+
+// uArchSim modules
+#include <elf_gen.h>
+
+using namespace std;
+
+static void printUsage( const char* program)
+{
+    ElfGenConfig config;
+    cout << "This program writes a synthetic MIPS ELF binary with the given number" << endl
+         << "and size of the data sections, number of symbols and gaps between" << endl
+         << "the sections. Each data section is loaded by its own segment." << endl
+         << endl
+         << "Usage: \"" << program << " [options] <output file>\"" << endl
+         << "  -s <number of data sections>  (default " << config.num_sections << ")" << endl
+         << "  -z <bytes in a data section>  (default " << config.section_size << ")" << endl
+         << "  -b <bytes in the .bss>        (default " << config.bss_size << ")" << endl
+         << "  -y <number of symbols>        (default " << config.num_symbols << ")" << endl
+         << "  -a <start address>            (default 0x" << hex << config.start_addr << dec << ")" << endl
+         << "  -g <bytes between sections>   (default " << config.gap << ")" << endl
+         << "  -S <seed of the data>         (default " << config.seed << ")" << endl
+         << "  -B                            big-endian file" << endl;
+}
+
+int main( int argc, char* argv[])
+{
+    ElfGenConfig config;
+    const char* output = NULL;
+
+    for ( int arg = 1; arg < argc; ++arg)
+    {
+        if ( !strcmp( argv[ arg], "--help"))
+        {
+            printUsage( argv[ 0]);
+            return 0;
+        } else if ( !strcmp( argv[ arg], "-B"))
+        {
+            config.big_endian = true;
+        } else if ( arg + 1 < argc && argv[ arg][ 0] == '-' && strlen( argv[ arg]) == 2)
+        {
+            uint64 value = strtoull( argv[ ++arg], NULL, 0);
+            switch ( argv[ arg - 1][ 1])
+            {
+                case 's': config.num_sections = value; break;
+                case 'z': config.section_size = value; break;
+                case 'b': config.bss_size = value; break;
+                case 'y': config.num_symbols = value; break;
+                case 'a': config.start_addr = value; break;
+                case 'g': config.gap = value; break;
+                case 'S': config.seed = value; break;
+                default:
+                    cerr << "ERROR: unknown option " << argv[ arg - 1] << endl
+                         << "Type \"" << argv[ 0] << " --help\" for usage." << endl;
+                    exit( EXIT_FAILURE);
+            }
+        } else if ( output == NULL)
+        {
+            output = argv[ arg];
+        } else
+        {
+            cerr << "ERROR: wrong number of arguments!" << endl
+                 << "Type \"" << argv[ 0] << " --help\" for usage." << endl;
+            exit( EXIT_FAILURE);
+        }
+    }
+
+    if ( output == NULL)
+    {
+        cerr << "ERROR: no output file!" << endl
+             << "Type \"" << argv[ 0] << " --help\" for usage." << endl;
+        exit( EXIT_FAILURE);
+    }
+
+    string error;
+    if ( !ElfGen::generate( output, config, error))
+    {
+        cerr << "ERROR: " << error << endl;
+        exit( EXIT_FAILURE);
+    }
+    return 0;
+}
@@ -0,0 +1,199 @@
+// generic C
+#include <cassert>
+#include <cstdlib>
+#include <cstdio>
+
+// Generic C++
+#include <sstream>
+
+// Google Test library
+#include <gtest/gtest.h>
+
+// ELF library
+#include <gelf.h>
+
+// uArchSim modules
+#include <elf_gen.h>
+#include <elf_parser.h>
+#include <func_memory.h>
+
+static const char* test_file = "./test_synthetic.out";
+
+//
+// Checks the bytes of the data sections at their starts, ends and in the middle
+//
+static void checkData( const FuncMemory& memory, const ElfGenConfig& config)
+{
+    for ( uint32 i = 0; i < config.num_sections; i += 1 + config.num_sections / 64)
+    {
+        uint64 addr = ElfGen::sectionAddr( config, i);
+        uint64 offsets[] = { 0, config.section_size / 2, config.section_size - 1};
+        for ( size_t j = 0; j < sizeof( offsets) / sizeof( offsets[ 0]); ++j)
+            ASSERT_EQ( memory.read( addr + offsets[ j], 1),
+                       ElfGen::dataByte( config, addr + offsets[ j]));
+    }
+}
+
+TEST( Elf_gen, Many_Sections)
+{
+    ElfGenConfig config;
+    config.num_sections = 3000;
+    config.section_size = 1000;
+    config.num_symbols = 10000;
+    config.gap = 0x10000; // sparse layout
+    config.bss_size = 0x3000;
+
+    string error;
+    ASSERT_TRUE( ElfGen::generate( test_file, config, error));
+
+    // the sections as the parser sees them
+    vector<ElfSection> sections;
+    ASSERT_TRUE( ElfSection::tryGetAllElfSections( test_file, sections, error));
+    ASSERT_EQ( sections.size(), 1 + config.num_sections + 1u);
+    ASSERT_STREQ( sections[ 0].name, ".text");
+    ASSERT_STREQ( sections[ 1].name, ".data.0");
+    ASSERT_EQ( sections[ 1].start_addr, ElfGen::sectionAddr( config, 0));
+    ASSERT_EQ( sections[ config.num_sections].size, config.section_size);
+    ASSERT_STREQ( sections.back().name, ".bss");
+
+    // the segments and the symbols
+    ElfImage image;
+    ASSERT_TRUE( ElfImage::tryLoad( test_file, image, error));
+    ASSERT_EQ( image.entry_point, config.start_addr);
+    ASSERT_FALSE( image.big_endian);
+    ASSERT_EQ( image.segments.size(), 1 + config.num_sections + 1u);
+    ASSERT_EQ( image.segments[ 0].flags, ( uint32)( PF_R | PF_X));
+    ASSERT_EQ( image.segments[ 1].flags, ( uint32)( PF_R | PF_W));
+    ASSERT_EQ( image.segments.back().file_size, 0u);
+    ASSERT_EQ( image.segments.back().mem_size, config.bss_size);
+    ASSERT_EQ( image.symbols.size(), config.num_symbols + 1u);
+
+    uint64 addr = 0;
+    ASSERT_TRUE( image.symbols.findByName( ElfGen::entry_name, addr));
+    ASSERT_EQ( addr, config.start_addr);
+    ASSERT_TRUE( image.symbols.findByName( "sym_7777", addr));
+    ASSERT_EQ( addr, ElfGen::symbolAddr( config, 7777));
+    ASSERT_STREQ( image.symbols.name( *image.symbols.findByAddr( addr + 15)), "sym_7777");
+
+    // the memory built both ways
+    FuncMemory lazy( image);
+    ASSERT_EQ( lazy.startPC(), config.start_addr);
+    ASSERT_EQ( lazy.read( config.start_addr), ElfGen::code[ 0]);
+    checkData( lazy, config);
+    ASSERT_EQ( lazy.read( ElfGen::bssAddr( config) + 0x2000), 0u);
+
+    FuncMemory eager( sections);
+    checkData( eager, config);
+
+    remove( test_file);
+}
+
+TEST( Elf_gen, Big_Endian)
+{
+    ElfGenConfig config;
+    config.big_endian = true;
+    config.seed = 2015;
+
+    string error;
+    ASSERT_TRUE( ElfGen::generate( test_file, config, error));
+
+    bool big_endian = false;
+    ASSERT_TRUE( ElfSection::tryGetDataEncoding( test_file, big_endian, error));
+    ASSERT_TRUE( big_endian);
+
+    ElfImage image;
+    ASSERT_TRUE( ElfImage::tryLoad( test_file, image, error));
+    ASSERT_EQ( image.entry_point, config.start_addr);
+    ASSERT_EQ( image.symbols.size(), config.num_symbols + 1u);
+
+    FuncMemory memory( image);
+    ASSERT_TRUE( memory.isBigEndian());
+    ASSERT_EQ( memory.read( config.start_addr), ElfGen::code[ 0]);
+    checkData( memory, config);
+
+    remove( test_file);
+}
+
+TEST( Elf_gen, Large_Image)
+{
+    // 256 MB of data in 64 sections
+    ElfGenConfig config;
+    config.num_sections = 64;
+    config.section_size = 4 << 20;
+    config.start_addr = 0x10000000;
+
+    string error;
+    ASSERT_TRUE( ElfGen::generate( test_file, config, error));
+
+    ElfImage image;
+    ASSERT_TRUE( ElfImage::tryLoad( test_file, image, error));
+    ASSERT_EQ( image.segments.size(), 1 + config.num_sections);
+
+    // only the touched pages are loaded
+    FuncMemory memory( image);
+    checkData( memory, config);
+    ASSERT_LT( memory.privatePages(), 4 * config.num_sections);
+
+    remove( test_file);
+}
+
+TEST( Elf_gen, Diff_Of_Images)
+{
+    // the same layout with other data
+    ElfGenConfig config;
+    ElfGenConfig other_config;
+    other_config.seed = 2015;
+    const char* other_file = "./test_synthetic_other.out";
+
+    string error;
+    ASSERT_TRUE( ElfGen::generate( test_file, config, error));
+    ASSERT_TRUE( ElfGen::generate( other_file, other_config, error));
+
+    ElfImage image;
+    ElfImage other_image;
+    ASSERT_TRUE( ElfImage::tryLoad( test_file, image, error));
+    ASSERT_TRUE( ElfImage::tryLoad( other_file, other_image, error));
+
+    // no page is loaded before the diff, still all the data differ
+    FuncMemory memory( image);
+    FuncMemory other_memory( other_image);
+    vector<MemoryRange> ranges;
+    memory.diff( other_memory, ranges);
+    ASSERT_FALSE( ranges.empty());
+    ASSERT_EQ( ranges.front().start_addr, ElfGen::sectionAddr( config, 0));
+
+    // and the same file is the same
+    FuncMemory same_memory( image);
+    ranges.clear();
+    memory.diff( same_memory, ranges);
+    ASSERT_TRUE( ranges.empty());
+
+    remove( test_file);
+    remove( other_file);
+}
+
+TEST( Elf_gen, Wrong_Config)
+{
+    ElfGenConfig config;
+    string error;
+
+    config.num_sections = 0;
+    ASSERT_FALSE( ElfGen::generate( test_file, config, error));
+
+    // the sections do not fit the 32-bit address space
+    config.num_sections = 2;
+    config.start_addr = 0xfff00000;
+    config.section_size = 1 << 20;
+    ASSERT_FALSE( ElfGen::generate( test_file, config, error));
+
+    config = ElfGenConfig();
+    ASSERT_FALSE( ElfGen::generate( "./1234567890/qwertyuiop", config, error));
+    ASSERT_NE( error.find( "Could not open file"), string::npos);
+}
+
+int main( int argc, char* argv[])
+{
+    ::testing::InitGoogleTest( &argc, argv);
+    ::testing::FLAGS_gtest_death_test_style = "threadsafe";
+    return RUN_ALL_TESTS();
+}
@@ -14,24 +14,20 @@
 #include <cstdlib>
 #include <cerrno>
 #include <cassert>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 // Generic C++
 #include <iostream>
 #include <string>
 #include <sstream>
+#include <algorithm>
 
 // uArchSim modules
 #include <elf_parser.h>
 
 using namespace std;
 
-ElfSection::ElfSection()
-{
-    cerr << "ERROR: the constructor without parameters "
-         << "of ElfSection class is prohobited" << endl;
-    exit( EXIT_FAILURE);
-}
-
 ElfSection::ElfSection( const ElfSection& that)
     : size( that.size), start_addr( that.start_addr)
 {
@@ -44,6 +40,12 @@ ElfSection::ElfSection( const ElfSection& that)
 
 ElfSection& ElfSection::operator=(const ElfSection& that)
 {
+    if ( this == &that)
+        return *this;
+
+    delete [] this->name;
+    delete [] this->content;
+
     this->name = new char[ strlen( that.name) + 1];
     strcpy( this->name, that.name);
     
@@ -72,42 +74,72 @@ ElfSection::ElfSection( const char* name, uint64 start_addr,
 void ElfSection::getAllElfSections( const char* elf_file_name,
                                     vector<ElfSection>& sections_array /*is used as output*/)
 {
+    string error;
+    if ( !tryGetAllElfSections( elf_file_name, sections_array, error))
+    {
+        cerr << "ERROR: " << error << endl;
+        exit( EXIT_FAILURE);
+    }
+}
+
+bool ElfSection::tryGetAllElfSections( const char* elf_file_name,
+                                       vector<ElfSection>& sections_array /*is used as output*/,
+                                       string& error /*is used as output*/)
+{
+    ostringstream oss;
+
     // open the binary file, we have to use C-style open,
     // because it is required by elf_begin function
     int file_descr = open( elf_file_name, O_RDONLY); 
     if ( file_descr < 0)
     {
-        cerr << "ERROR: Could not open file " << elf_file_name << ": "
-             << strerror( errno) << endl;
-        exit( EXIT_FAILURE);
+        oss << "Could not open file " << elf_file_name << ": "
+            << strerror( errno);
+        error = oss.str();
+        return false;
     }
 
     // set ELF library operating version
     if ( elf_version( EV_CURRENT) == EV_NONE)
     {
-        cerr << "ERROR: Could not set ELF library operating version:"
-             <<  elf_errmsg( elf_errno()) << endl;
-        exit( EXIT_FAILURE);
+        oss << "Could not set ELF library operating version:"
+            <<  elf_errmsg( elf_errno());
+        error = oss.str();
+        close( file_descr);
+        return false;
     }
    
     // open the file in ELF format 
     Elf* elf = elf_begin( file_descr, ELF_C_READ, NULL);
-    if ( !elf)
+    if ( !elf || elf_kind( elf) != ELF_K_ELF)
     {
-        cerr << "ERROR: Could not open file " << elf_file_name
-             << " as ELF file: "
-             <<  elf_errmsg( elf_errno()) << endl;
-        exit( EXIT_FAILURE);
+        oss << "Could not open file " << elf_file_name
+            << " as ELF file: "
+            << ( elf ? "not an ELF file" : elf_errmsg( elf_errno()));
+        error = oss.str();
+        if ( elf)
+            elf_end( elf);
+        close( file_descr);
+        return false;
     }
     
     size_t shstrndx;
-    elf_getshdrstrndx( elf, &shstrndx);
+    bool ok = elf_getshdrstrndx( elf, &shstrndx) == 0;
+    if ( !ok)
+        oss << "Could not read section names of " << elf_file_name << ": "
+            << elf_errmsg( elf_errno());
     
     Elf_Scn *section = NULL;
-    while ( (section = elf_nextscn( elf, section)) != NULL)
+    while ( ok && (section = elf_nextscn( elf, section)) != NULL)
     {        
         GElf_Shdr shdr;
-        gelf_getshdr( section, &shdr);
+        if ( gelf_getshdr( section, &shdr) == NULL)
+        {
+            oss << "Could not read a section header of " << elf_file_name << ": "
+                << elf_errmsg( elf_errno());
+            ok = false;
+            break;
+        }
 
         char* name = elf_strptr( elf, shstrndx, shdr.sh_name);
         uint64 start_addr = ( uint64)shdr.sh_addr;
@@ -119,25 +151,550 @@ void ElfSection::getAllElfSections( const char* elf_file_name,
         uint64 offset = ( uint64)shdr.sh_offset;
 	    uint8* content = new uint8[ size];
         
-        lseek( file_descr, offset, SEEK_SET);
-        FILE *file = fdopen( file_descr, "r");
-        if ( !file )
+        // fill the content by the section data; pread does not move
+        // the file offset, so nothing is shared between the iterations.
+        // The zero-initialized sections (".bss") have no data in the file.
+        ssize_t read_size = ( ssize_t)size;
+        if ( shdr.sh_type == SHT_NOBITS)
+            memset( content, 0, size);
+        else
+            read_size = pread( file_descr, content, size, offset);
+        if ( read_size != ( ssize_t)size)
         {
-            cerr << "ERROR: Could not open file " << elf_file_name << ": "
-                 << strerror(errno) << endl;
-            exit( EXIT_FAILURE);
+            oss << "Could not read file " << elf_file_name << ": "
+                << ( read_size < 0 ? strerror( errno) : "unexpected end of file");
+            ok = false;
+            delete [] content;
+            break;
         }
         
-        // fill the content by the section data
-        fread( content, sizeof( uint8), size, file);
-        ElfSection section( name, start_addr, size, content);
-	    sections_array.push_back( ElfSection( name, start_addr, size, content));
+	    sections_array.push_back( ElfSection( name ? name : "", start_addr, size, content));
         delete [] content;
     }
     
     // close all used files
     elf_end( elf);
     close( file_descr);
+
+    if ( !ok)
+        error = oss.str();
+    return ok;
+}
+
+bool ElfSection::tryGetDataEncoding( const char* elf_file_name,
+                                     bool& big_endian /*is used as output*/,
+                                     string& error /*is used as output*/)
+{
+    ostringstream oss;
+
+    int file_descr = open( elf_file_name, O_RDONLY);
+    if ( file_descr < 0)
+    {
+        oss << "Could not open file " << elf_file_name << ": "
+            << strerror( errno);
+        error = oss.str();
+        return false;
+    }
+
+    // only the identification bytes are needed, so libelf is not used
+    unsigned char ident[ EI_NIDENT];
+    ssize_t read_size = pread( file_descr, ident, sizeof( ident), 0);
+    close( file_descr);
+
+    if ( read_size != ( ssize_t)sizeof( ident)
+         || memcmp( ident, ELFMAG, SELFMAG) != 0
+         || ( ident[ EI_DATA] != ELFDATA2LSB && ident[ EI_DATA] != ELFDATA2MSB))
+    {
+        oss << "Could not get data encoding of " << elf_file_name
+            << ": not an ELF file";
+        error = oss.str();
+        return false;
+    }
+
+    big_endian = ident[ EI_DATA] == ELFDATA2MSB;
+    return true;
+}
+
+// Adds the symbols with addresses from all the symbol tables of the file
+static bool readSymbols( Elf* elf, ElfSymbolTable& table)
+{
+    Elf_Scn* section = NULL;
+    while ( ( section = elf_nextscn( elf, section)) != NULL)
+    {
+        GElf_Shdr shdr;
+        if ( gelf_getshdr( section, &shdr) == NULL)
+            return false;
+        if ( shdr.sh_type != SHT_SYMTAB || shdr.sh_entsize == 0)
+            continue;
+
+        Elf_Data* data = elf_getdata( section, NULL);
+        if ( data == NULL)
+            return false;
+
+        size_t num = shdr.sh_size / shdr.sh_entsize;
+        for ( size_t i = 0; i < num; ++i)
+        {
+            GElf_Sym sym;
+            if ( gelf_getsym( data, i, &sym) == NULL)
+                return false;
+
+            uint32 type = GELF_ST_TYPE( sym.st_info);
+            if ( sym.st_shndx == SHN_UNDEF || type == STT_SECTION || type == STT_FILE)
+                continue;
+
+            const char* name = elf_strptr( elf, shdr.sh_link, sym.st_name);
+            if ( name == NULL || *name == '\0')
+                continue;
+
+            table.add( sym.st_value, sym.st_size, type, name);
+        }
+    }
+    table.sort();
+    return true;
+}
+
+// Functions go after the other symbols at the same address, so
+// the address lookup prefers "main" to a label like "_ftext"
+static uint32 typeRank( uint32 type)
+{
+    return type == STT_FUNC ? 2 : type == STT_OBJECT ? 1 : 0;
+}
+
+struct SymbolAddrLess
+{
+    bool operator()( const ElfSymbol& a, const ElfSymbol& b) const
+    {
+        if ( a.addr != b.addr)
+            return a.addr < b.addr;
+        if ( typeRank( a.type) != typeRank( b.type))
+            return typeRank( a.type) < typeRank( b.type);
+        return a.size < b.size;
+    }
+    bool operator()( uint64 addr, const ElfSymbol& symbol) const
+    {
+        return addr < symbol.addr;
+    }
+};
+
+struct SymbolNameLess
+{
+    const ElfSymbolTable& table;
+    SymbolNameLess( const ElfSymbolTable& table) : table( table) { }
+
+    bool operator()( uint32 a, uint32 b) const
+    {
+        return strcmp( table.name( table[ a]), table.name( table[ b])) < 0;
+    }
+    bool operator()( uint32 a, const char* name) const
+    {
+        return strcmp( table.name( table[ a]), name) < 0;
+    }
+};
+
+void ElfSymbolTable::add( uint64 addr, uint64 size, uint32 type, const char* name)
+{
+    ElfSymbol symbol;
+    symbol.addr = addr;
+    symbol.size = size;
+    symbol.type = type;
+    symbol.name_offset = names.size();
+    names.append( name);
+    names.push_back( '\0');
+    symbols.push_back( symbol);
+}
+
+void ElfSymbolTable::sort()
+{
+    std::stable_sort( symbols.begin(), symbols.end(), SymbolAddrLess());
+
+    by_name.resize( symbols.size());
+    for ( size_t i = 0; i < by_name.size(); ++i)
+        by_name[ i] = i;
+    std::stable_sort( by_name.begin(), by_name.end(), SymbolNameLess( *this));
+    index_ends();
+}
+
+void ElfSymbolTable::index_ends()
+{
+    cover_end.resize( symbols.size());
+    uint64 end = 0;
+    for ( size_t i = 0; i < symbols.size(); ++i)
+    {
+        if ( symbols[ i].size != 0)
+            end = max( end, symbols[ i].addr + symbols[ i].size);
+        cover_end[ i] = end;
+    }
+}
+
+void ElfSymbolTable::clear()
+{
+    symbols.clear();
+    names.clear();
+    by_name.clear();
+    cover_end.clear();
+}
+
+const ElfSymbol* ElfSymbolTable::findByAddr( uint64 addr) const
+{
+    vector<ElfSymbol>::const_iterator it = upper_bound( symbols.begin(), symbols.end(),
+                                                        addr, SymbolAddrLess());
+    if ( it == symbols.begin())
+        return NULL;
+    size_t nearest = it - symbols.begin() - 1;
+
+    // no symbol before the one where the ends pass the address can contain it
+    for ( size_t i = nearest + 1; i > 0 && cover_end[ i - 1] > addr; --i)
+    {
+        const ElfSymbol& symbol = symbols[ i - 1];
+        if ( symbol.size != 0 && addr - symbol.addr < symbol.size)
+            return &symbol;
+    }
+
+    // a label shares its address with the sized symbols that have ended
+    for ( size_t i = nearest + 1; i > 0 && symbols[ i - 1].addr == symbols[ nearest].addr; --i)
+        if ( symbols[ i - 1].size == 0)
+            return &symbols[ i - 1];
+    return NULL;
+}
+
+bool ElfSymbolTable::findByName( const char* name, uint64& addr) const
+{
+    vector<uint32>::const_iterator it = lower_bound( by_name.begin(), by_name.end(),
+                                                     name, SymbolNameLess( *this));
+    if ( it == by_name.end() || strcmp( this->name( symbols[ *it]), name) != 0)
+        return false;
+
+    addr = symbols[ *it].addr;
+    return true;
+}
+
+bool ElfImage::tryLoad( const char* elf_file_name, ElfImage& image, string& error)
+{
+    ostringstream oss;
+
+    int file_descr = open( elf_file_name, O_RDONLY); 
+    if ( file_descr < 0)
+    {
+        oss << "Could not open file " << elf_file_name << ": "
+            << strerror( errno);
+        error = oss.str();
+        return false;
+    }
+
+    if ( elf_version( EV_CURRENT) == EV_NONE)
+    {
+        oss << "Could not set ELF library operating version:"
+            <<  elf_errmsg( elf_errno());
+        error = oss.str();
+        close( file_descr);
+        return false;
+    }
+
+    Elf* elf = elf_begin( file_descr, ELF_C_READ, NULL);
+    if ( !elf || elf_kind( elf) != ELF_K_ELF)
+    {
+        oss << "Could not open file " << elf_file_name
+            << " as ELF file: "
+            << ( elf ? "not an ELF file" : elf_errmsg( elf_errno()));
+        error = oss.str();
+        if ( elf)
+            elf_end( elf);
+        close( file_descr);
+        return false;
+    }
+
+    image.file_name = elf_file_name;
+    image.segments.clear();
+
+    GElf_Ehdr ehdr;
+    size_t phdr_num = 0;
+    bool ok = gelf_getehdr( elf, &ehdr) != NULL && elf_getphdrnum( elf, &phdr_num) == 0;
+    if ( !ok)
+    {
+        oss << "Could not read the headers of " << elf_file_name << ": "
+            << elf_errmsg( elf_errno());
+    } else
+    {
+        image.entry_point = ehdr.e_entry;
+        image.big_endian = ehdr.e_ident[ EI_DATA] == ELFDATA2MSB;
+    }
+
+    for ( size_t i = 0; ok && i < phdr_num; ++i)
+    {
+        GElf_Phdr phdr;
+        if ( gelf_getphdr( elf, i, &phdr) == NULL)
+        {
+            oss << "Could not read a program header of " << elf_file_name << ": "
+                << elf_errmsg( elf_errno());
+            ok = false;
+            break;
+        }
+
+        if ( phdr.p_type != PT_LOAD)
+            continue;
+
+        if ( phdr.p_filesz > phdr.p_memsz)
+        {
+            oss << "Broken program header in " << elf_file_name
+                << ": file size is greater than memory size";
+            ok = false;
+            break;
+        }
+
+        ElfSegment segment;
+        segment.start_addr = phdr.p_vaddr;
+        segment.file_offset = phdr.p_offset;
+        segment.file_size = phdr.p_filesz;
+        segment.mem_size = phdr.p_memsz;
+        segment.flags = phdr.p_flags;
+        image.segments.push_back( segment);
+    }
+
+    image.symbols.clear();
+    if ( ok && !readSymbols( elf, image.symbols))
+    {
+        oss << "Could not read the symbol table of " << elf_file_name << ": "
+            << elf_errmsg( elf_errno());
+        ok = false;
+    }
+
+    elf_end( elf);
+    close( file_descr);
+
+    if ( !ok)
+        error = oss.str();
+    return ok;
+}
+
+static const char IMAGE_CACHE_MAGIC[ 8] = { 'M', 'I', 'P', 'S', 'I', 'M', 'G', 'C'};
+static const uint32 IMAGE_CACHE_VERSION = 1;
+
+// followed by the arrays of segments, symbols, indices of symbols
+// sorted by name and the names
+struct ImageCacheHeader
+{
+    char magic[ 8];
+    uint32 version;
+    uint32 big_endian;
+    uint64 elf_size;
+    uint64 elf_mtime_sec;
+    uint64 elf_mtime_nsec;
+    uint64 elf_hash;
+    uint64 entry_point;
+    uint64 num_segments;
+    uint64 num_symbols;
+    uint64 names_size;
+};
+
+// Gets the key of the ELF file: its size, modification time and,
+// if hash is not NULL, FNV-1a hash of its content
+static bool getElfKey( const char* elf_file_name, ImageCacheHeader& key,
+                       uint64* hash, string& error)
+{
+    int file_descr = open( elf_file_name, O_RDONLY);
+    struct stat file_stat;
+    if ( file_descr < 0 || fstat( file_descr, &file_stat) != 0)
+    {
+        error = string( "Could not open file ") + elf_file_name + ": " + strerror( errno);
+        if ( file_descr >= 0)
+            close( file_descr);
+        return false;
+    }
+
+    key.elf_size = file_stat.st_size;
+    key.elf_mtime_sec = file_stat.st_mtim.tv_sec;
+    key.elf_mtime_nsec = file_stat.st_mtim.tv_nsec;
+
+    bool ok = true;
+    if ( hash != NULL)
+    {
+        *hash = 0xcbf29ce484222325ull;
+        void* data = key.elf_size != 0
+                     ? mmap( NULL, key.elf_size, PROT_READ, MAP_PRIVATE, file_descr, 0)
+                     : NULL;
+        if ( data == MAP_FAILED)
+        {
+            error = string( "Could not map file ") + elf_file_name + ": " + strerror( errno);
+            ok = false;
+        } else if ( data != NULL)
+        {
+            const uint8* bytes = static_cast<const uint8*>( data);
+            for ( uint64 i = 0; i < key.elf_size; ++i)
+                *hash = ( *hash ^ bytes[ i]) * 0x100000001b3ull;
+            munmap( data, key.elf_size);
+        }
+    }
+    close( file_descr);
+    return ok;
+}
+
+bool ElfImage::trySaveCache( const char* cache_file_name, string& error) const
+{
+    ImageCacheHeader header;
+    memset( &header, 0, sizeof( header));
+    memcpy( header.magic, IMAGE_CACHE_MAGIC, sizeof( header.magic));
+    header.version = IMAGE_CACHE_VERSION;
+    if ( !getElfKey( file_name.c_str(), header, &header.elf_hash, error))
+        return false;
+
+    header.big_endian = big_endian;
+    header.entry_point = entry_point;
+    header.num_segments = segments.size();
+    header.num_symbols = symbols.symbols.size();
+    header.names_size = symbols.names.size();
+
+    // the cache appears under its name only when it is complete,
+    // so a concurrent run never reads a half-written file
+    string tmp_name = string( cache_file_name) + ".tmp";
+    ostringstream pid;
+    pid << getpid();
+    tmp_name += pid.str();
+
+    FILE* file = fopen( tmp_name.c_str(), "wb");
+    if ( !file)
+    {
+        error = string( "Could not open file ") + tmp_name + ": " + strerror( errno);
+        return false;
+    }
+
+    bool ok = fwrite( &header, sizeof( header), 1, file) == 1
+              && fwrite( segments.data(), sizeof( ElfSegment), segments.size(), file) == segments.size()
+              && fwrite( symbols.symbols.data(), sizeof( ElfSymbol),
+                         symbols.symbols.size(), file) == symbols.symbols.size()
+              && fwrite( symbols.by_name.data(), sizeof( uint32),
+                         symbols.by_name.size(), file) == symbols.by_name.size()
+              && fwrite( symbols.names.data(), 1, symbols.names.size(), file) == symbols.names.size();
+    if ( !ok)
+        error = string( "Could not write file ") + tmp_name + ": " + strerror( errno);
+
+    if ( fclose( file) != 0 && ok)
+    {
+        error = string( "Could not write file ") + tmp_name + ": " + strerror( errno);
+        ok = false;
+    }
+
+    if ( ok && rename( tmp_name.c_str(), cache_file_name) != 0)
+    {
+        error = string( "Could not write file ") + cache_file_name + ": " + strerror( errno);
+        ok = false;
+    }
+    if ( !ok)
+        unlink( tmp_name.c_str());
+    return ok;
+}
+
+bool ElfImage::tryLoadCache( const char* elf_file_name, const char* cache_file_name,
+                             ElfImage& image, string& error)
+{
+    int file_descr = open( cache_file_name, O_RDONLY);
+    struct stat file_stat;
+    if ( file_descr < 0 || fstat( file_descr, &file_stat) != 0)
+    {
+        error = string( "Could not open file ") + cache_file_name + ": " + strerror( errno);
+        if ( file_descr >= 0)
+            close( file_descr);
+        return false;
+    }
+
+    uint64 cache_size = file_stat.st_size;
+    void* data = cache_size >= sizeof( ImageCacheHeader)
+                 ? mmap( NULL, cache_size, PROT_READ, MAP_PRIVATE, file_descr, 0)
+                 : MAP_FAILED;
+    close( file_descr);
+    if ( data == MAP_FAILED)
+    {
+        error = string( "Broken cache file ") + cache_file_name;
+        return false;
+    }
+
+    const uint8* bytes = static_cast<const uint8*>( data);
+    ImageCacheHeader header;
+    memcpy( &header, bytes, sizeof( header));
+
+    bool ok = memcmp( header.magic, IMAGE_CACHE_MAGIC, sizeof( header.magic)) == 0
+              && header.version == IMAGE_CACHE_VERSION
+              && header.num_segments <= cache_size / sizeof( ElfSegment)
+              && header.num_symbols <= cache_size / sizeof( ElfSymbol)
+              && header.names_size <= cache_size
+              && cache_size == sizeof( header)
+                               + header.num_segments * sizeof( ElfSegment)
+                               + header.num_symbols * ( sizeof( ElfSymbol) + sizeof( uint32))
+                               + header.names_size;
+
+    // the table indexes its arrays without checks, so the sizes
+    // matching is not enough for a file that is damaged inside
+    const ElfSymbol* symbols = reinterpret_cast<const ElfSymbol*>(
+        bytes + sizeof( header) + header.num_segments * sizeof( ElfSegment));
+    const uint32* by_name = reinterpret_cast<const uint32*>( symbols + header.num_symbols);
+    for ( uint64 i = 0; ok && i < header.num_symbols; ++i)
+        ok = by_name[ i] < header.num_symbols && symbols[ i].name_offset < header.names_size;
+    if ( !ok)
+        error = string( "Broken cache file ") + cache_file_name;
+
+    // the hash is computed only if the time stamp of the file has changed
+    ImageCacheHeader key;
+    if ( ok)
+        ok = getElfKey( elf_file_name, key, NULL, error);
+    if ( ok && ( key.elf_size != header.elf_size
+                 || key.elf_mtime_sec != header.elf_mtime_sec
+                 || key.elf_mtime_nsec != header.elf_mtime_nsec))
+    {
+        uint64 hash = 0;
+        ok = getElfKey( elf_file_name, key, &hash, error);
+        if ( ok && ( key.elf_size != header.elf_size || hash != header.elf_hash))
+        {
+            error = string( "Cache file ") + cache_file_name + " is made from other file";
+            ok = false;
+        }
+
+        // the file has only been touched, its new time stamp saves
+        // hashing it in the next runs; a failure to write it is ignored
+        if ( ok)
+        {
+            header.elf_mtime_sec = key.elf_mtime_sec;
+            header.elf_mtime_nsec = key.elf_mtime_nsec;
+            int cache_descr = open( cache_file_name, O_WRONLY);
+            if ( cache_descr >= 0)
+            {
+                ssize_t written = pwrite( cache_descr, &header, sizeof( header), 0);
+                (void)written;
+                close( cache_descr);
+            }
+        }
+    }
+
+    if ( ok)
+    {
+        image.file_name = elf_file_name;
+        image.entry_point = header.entry_point;
+        image.big_endian = header.big_endian != 0;
+
+        const ElfSegment* segments = reinterpret_cast<const ElfSegment*>( bytes + sizeof( header));
+        image.segments.assign( segments, segments + header.num_segments);
+        image.symbols.symbols.assign( symbols, symbols + header.num_symbols);
+        image.symbols.by_name.assign( by_name, by_name + header.num_symbols);
+        image.symbols.names.assign( reinterpret_cast<const char*>( by_name + header.num_symbols),
+                                    header.names_size);
+        image.symbols.index_ends();
+    }
+
+    munmap( data, cache_size);
+    return ok;
+}
+
+bool ElfImage::tryLoadCached( const char* elf_file_name, const char* cache_file_name,
+                              ElfImage& image, string& error)
+{
+    string cache_error;
+    if ( tryLoadCache( elf_file_name, cache_file_name, image, cache_error))
+        return true;
+
+    if ( !tryLoad( elf_file_name, image, error))
+        return false;
+
+    // the run does not depend on the cache, so a failure to write it is ignored
+    image.trySaveCache( cache_file_name, cache_error);
+    return true;
 }
 
 ElfSection::~ElfSection()
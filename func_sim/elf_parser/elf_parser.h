@@ -22,6 +22,7 @@ class ElfSection
 {
     // You cannot use this constructor to create an object.
     // Use the static function getAllElfSections.
+    // It is declared but not defined, so any use fails at link time.
     ElfSection(); 
     ElfSection( const char* name, uint64 start_addr,
                 uint64 size, const uint8* content);
@@ -39,7 +40,19 @@ public:
     // Note that the 2nd parameter is used as output.
     static void getAllElfSections( const char* elf_file_name,
                                    vector<ElfSection>& sections_array /*used as output*/);
+
+    // The same as getAllElfSections, but instead of terminating the program
+    // it returns false and the description of the problem in the 3rd parameter.
+    static bool tryGetAllElfSections( const char* elf_file_name,
+                                      vector<ElfSection>& sections_array /*used as output*/,
+                                      string& error /*used as output*/);
     
+    // Gets the byte order of the data in the ELF file from its header.
+    // Returns false and the description of the problem on failure.
+    static bool tryGetDataEncoding( const char* elf_file_name,
+                                    bool& big_endian /*used as output*/,
+                                    string& error /*used as output*/);
+
     virtual ~ElfSection();
     
     string dump( string indent = "") const;
@@ -47,4 +60,101 @@ public:
     string strByWords() const;
 };
 
+// A loadable segment (PT_LOAD program header) of the ELF file.
+// Bytes from file_size to mem_size (e.g. ".bss") are zero-initialized.
+struct ElfSegment
+{
+    uint64 start_addr;  // the virtual address of the segment
+    uint64 file_offset; // where the data of the segment is in the file
+    uint64 file_size;   // size of the data in the file
+    uint64 mem_size;    // size of the segment in the memory
+    uint32 flags;       // PF_R, PF_W and PF_X bits
+};
+
+// A symbol of the ELF file, its name is kept by the symbol table
+struct ElfSymbol
+{
+    uint64 addr;
+    uint64 size;        // 0 for the labels of assembly programs
+    uint32 name_offset; // position of the name in the table of names
+    uint32 type;        // STT_FUNC, STT_OBJECT or STT_NOTYPE
+};
+
+//
+// Symbols sorted by address in one array and their names in one string,
+// so the lookups do binary searches over contiguous memory.
+//
+class ElfSymbolTable
+{
+        vector<ElfSymbol> symbols;  // sorted by address
+        string names;               // all the names, each one ends with '\0'
+        vector<uint32> by_name;     // indices of the symbols sorted by name
+        // the largest end of the sized symbols up to each one,
+        // the address lookup stops its scan back where it is passed
+        vector<uint64> cover_end;
+
+        // the cache of the image stores the arrays as they are,
+        // the ends are built again after loading them
+        friend struct ElfImage;
+        void index_ends();
+
+    public:
+        // Adds a symbol, the table must be sorted after all the additions
+        void add( uint64 addr, uint64 size, uint32 type, const char* name);
+        void sort();
+        void clear();
+
+        // Finds the closest sized symbol the address is inside, so a function
+        // wins over its local labels and over the objects that end before the address.
+        // If there is none, the closest symbol before the address is taken
+        // provided it has no size, like a label of an assembly program.
+        // Returns NULL if there is no such symbol.
+        const ElfSymbol* findByAddr( uint64 addr) const;
+
+        // Returns false if there is no symbol with the name
+        bool findByName( const char* name, uint64& addr /*used as output*/) const;
+
+        inline const char* name( const ElfSymbol& symbol) const
+        {
+            return names.c_str() + symbol.name_offset;
+        }
+        inline size_t size() const { return symbols.size(); }
+        inline const ElfSymbol& operator[]( size_t i) const { return symbols[ i]; }
+};
+
+// Everything a loader needs to know about the ELF file
+struct ElfImage
+{
+    string file_name;
+    uint64 entry_point;
+    bool big_endian;
+    vector<ElfSegment> segments;
+    ElfSymbolTable symbols; // from ".symtab", empty for a stripped file
+
+    // Reads the ELF header, the program headers and the symbol table.
+    // The data of the segments is not read, it stays in the file at the given offsets.
+    // Returns false and the description of the problem on failure.
+    static bool tryLoad( const char* elf_file_name,
+                         ElfImage& image /*used as output*/,
+                         string& error /*used as output*/);
+
+    // The cache file keeps the parsed image as flat arrays in the host
+    // byte order, so loading it is a mapping and a few copies.
+    // The cache is valid if the ELF file has the same size and
+    // modification time, or the same hash of its content.
+    bool trySaveCache( const char* cache_file_name,
+                       string& error /*used as output*/) const;
+    // Returns false if the cache is missing, broken or made from other file
+    static bool tryLoadCache( const char* elf_file_name,
+                              const char* cache_file_name,
+                              ElfImage& image /*used as output*/,
+                              string& error /*used as output*/);
+    // Loads the image from the cache if it is valid, otherwise
+    // reads the ELF file and writes the cache for the next runs
+    static bool tryLoadCached( const char* elf_file_name,
+                               const char* cache_file_name,
+                               ElfImage& image /*used as output*/,
+                               string& error /*used as output*/);
+};
+
 #endif // #ifndef ELF_PARSER__ELF_PARSER_H
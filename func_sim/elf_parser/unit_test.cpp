@@ -1,10 +1,16 @@
 // generic C
 #include <cassert>
 #include <cstdlib>
+#include <cstdio>
+#include <cstddef>
+#include <sys/time.h>
 
 // Google Test library
 #include <gtest/gtest.h>
 
+// ELF library
+#include <gelf.h>
+
 // uArchSim modules
 #include <elf_parser.h>
 
@@ -28,6 +34,249 @@ TEST( Elf_parser_init, Process_Wrong_Args_Of_Constr)
                  ::testing::ExitedWithCode( EXIT_FAILURE), "ERROR.*");
 }
 
+TEST( Elf_parser_init, Report_Errors_Without_Exit)
+{
+    vector<ElfSection> sections_array;
+    string error;
+
+    ASSERT_TRUE( ElfSection::tryGetAllElfSections( valid_elf_file, sections_array, error));
+    ASSERT_FALSE( sections_array.empty());
+
+    // the file does not exist
+    ASSERT_FALSE( ElfSection::tryGetAllElfSections( "./1234567890/qwertyuiop",
+                                                    sections_array, error));
+    ASSERT_NE( error.find( "Could not open file"), string::npos);
+
+    // the file exists, but it is not an ELF file
+    error.clear();
+    ASSERT_FALSE( ElfSection::tryGetAllElfSections( "./unit_test.cpp", sections_array, error));
+    ASSERT_NE( error.find( "as ELF file"), string::npos);
+}
+
+TEST( Elf_parser, Get_Data_Encoding)
+{
+    bool big_endian = true;
+    string error;
+
+    ASSERT_TRUE( ElfSection::tryGetDataEncoding( valid_elf_file, big_endian, error));
+    ASSERT_FALSE( big_endian);
+
+    ASSERT_FALSE( ElfSection::tryGetDataEncoding( "./unit_test.cpp", big_endian, error));
+    ASSERT_NE( error.find( "not an ELF file"), string::npos);
+}
+
+TEST( Elf_parser, Load_Segments)
+{
+    ElfImage image;
+    string error;
+
+    ASSERT_TRUE( ElfImage::tryLoad( valid_elf_file, image, error));
+    ASSERT_EQ( image.entry_point, 0x4000b0u);
+    ASSERT_FALSE( image.big_endian);
+
+    // the code with the headers and the data
+    ASSERT_EQ( image.segments.size(), 2u);
+    ASSERT_EQ( image.segments[ 0].start_addr, 0x400000u);
+    ASSERT_EQ( image.segments[ 0].flags, ( uint32)( PF_R | PF_X));
+    ASSERT_EQ( image.segments[ 1].start_addr, 0x4100c0u);
+    ASSERT_EQ( image.segments[ 1].file_offset, 0xc0u);
+    ASSERT_EQ( image.segments[ 1].mem_size, 0xc0u);
+    ASSERT_EQ( image.segments[ 1].flags, ( uint32)( PF_R | PF_W));
+
+    ASSERT_FALSE( ElfImage::tryLoad( "./unit_test.cpp", image, error));
+    ASSERT_NE( error.find( "not an ELF file"), string::npos);
+}
+
+TEST( Elf_parser, Symbol_Table)
+{
+    ElfImage image;
+    string error;
+    ASSERT_TRUE( ElfImage::tryLoad( valid_elf_file, image, error));
+
+    const ElfSymbolTable& symbols = image.symbols;
+    ASSERT_FALSE( symbols.size() == 0);
+
+    // the symbols are sorted by address
+    for ( size_t i = 1; i < symbols.size(); ++i)
+        ASSERT_LE( symbols[ i - 1].addr, symbols[ i].addr);
+
+    // "__start" is an object, so it is preferred to "_ftext" at the same address
+    const ElfSymbol* symbol = symbols.findByAddr( 0x4000b0 + 8);
+    ASSERT_TRUE( symbol != NULL);
+    ASSERT_STREQ( symbols.name( *symbol), "__start");
+
+    symbol = symbols.findByAddr( 0x4100cc + 2);
+    ASSERT_TRUE( symbol != NULL);
+    ASSERT_STREQ( symbols.name( *symbol), "best_nums");
+
+    // nothing before the code
+    ASSERT_TRUE( symbols.findByAddr( 0x1000) == NULL);
+
+    uint64 addr = 0;
+    ASSERT_TRUE( symbols.findByName( "just_space", addr));
+    ASSERT_EQ( addr, 0x4100d8u);
+    ASSERT_FALSE( symbols.findByName( "main", addr));
+    ASSERT_FALSE( symbols.findByName( ".text", addr));
+}
+
+TEST( Elf_parser, Symbol_Sizes)
+{
+    ElfSymbolTable symbols;
+    symbols.add( 0x2000, 0x100, STT_FUNC, "foo");
+    symbols.add( 0x1000, 0x80, STT_FUNC, "bar");
+    symbols.sort();
+
+    ASSERT_STREQ( symbols.name( *symbols.findByAddr( 0x1000)), "bar");
+    ASSERT_STREQ( symbols.name( *symbols.findByAddr( 0x20ff)), "foo");
+
+    // the address is between the functions
+    ASSERT_TRUE( symbols.findByAddr( 0x1080) == NULL);
+    ASSERT_TRUE( symbols.findByAddr( 0x2100) == NULL);
+}
+
+TEST( Elf_parser, Enclosing_Symbol)
+{
+    ElfSymbolTable symbols;
+    symbols.add( 0x1000, 0x100, STT_FUNC, "foo");
+    symbols.add( 0x1040, 0, STT_NOTYPE, "loop");
+    symbols.add( 0x1080, 0x10, STT_OBJECT, "table");
+    symbols.add( 0x2000, 0, STT_NOTYPE, "end");
+    symbols.sort();
+
+    // a local label inside the function does not hide it
+    ASSERT_STREQ( symbols.name( *symbols.findByAddr( 0x1044)), "foo");
+
+    // an object inside the function is taken while the address is in it
+    ASSERT_STREQ( symbols.name( *symbols.findByAddr( 0x1088)), "table");
+    ASSERT_STREQ( symbols.name( *symbols.findByAddr( 0x10a0)), "foo");
+
+    // a label is found if no sized symbol contains the address
+    ASSERT_TRUE( symbols.findByAddr( 0x1100) == NULL);
+    ASSERT_STREQ( symbols.name( *symbols.findByAddr( 0x2010)), "end");
+}
+
+TEST( Elf_parser, Image_Cache)
+{
+    const char* cache_file = "./test_image.cache";
+    ElfImage image, cached;
+    string error;
+
+    remove( cache_file);
+    ASSERT_FALSE( ElfImage::tryLoadCache( valid_elf_file, cache_file, cached, error));
+
+    // the 1st run parses the file and writes the cache, the 2nd one reads the cache
+    ASSERT_TRUE( ElfImage::tryLoadCached( valid_elf_file, cache_file, image, error));
+    ASSERT_TRUE( ElfImage::tryLoadCache( valid_elf_file, cache_file, cached, error));
+
+    ASSERT_EQ( cached.file_name, image.file_name);
+    ASSERT_EQ( cached.entry_point, image.entry_point);
+    ASSERT_EQ( cached.big_endian, image.big_endian);
+    ASSERT_EQ( cached.segments.size(), image.segments.size());
+    ASSERT_EQ( cached.segments[ 1].file_offset, image.segments[ 1].file_offset);
+    ASSERT_EQ( cached.symbols.size(), image.symbols.size());
+
+    uint64 addr = 0;
+    ASSERT_TRUE( cached.symbols.findByName( "best_nums", addr));
+    ASSERT_EQ( addr, 0x4100ccu);
+    ASSERT_STREQ( cached.symbols.name( *cached.symbols.findByAddr( 0x4000b0)), "__start");
+
+    // the cache of one file is not used for another one
+    ASSERT_FALSE( ElfImage::tryLoadCache( "./unit_test.cpp", cache_file, cached, error));
+    ASSERT_NE( error.find( "other file"), string::npos);
+
+    remove( cache_file);
+}
+
+// Reads the header field of the cache file at the offset
+static uint64 readCacheField( const char* cache_file, long offset)
+{
+    uint64 value = 0;
+    FILE* file = fopen( cache_file, "rb");
+    fseek( file, offset, SEEK_SET);
+    if ( fread( &value, sizeof( value), 1, file) != 1)
+        value = 0;
+    fclose( file);
+    return value;
+}
+
+static void writeCacheBytes( const char* cache_file, long offset, const void* data, size_t size)
+{
+    FILE* file = fopen( cache_file, "r+b");
+    fseek( file, offset, SEEK_SET);
+    fwrite( data, size, 1, file);
+    fclose( file);
+}
+
+TEST( Elf_parser, Image_Cache_Checks)
+{
+    const char* elf_copy = "./test_image.out";
+    const char* cache_file = "./test_image.cache";
+    ElfImage image;
+    string error;
+
+    FILE* src = fopen( valid_elf_file, "rb");
+    FILE* dst = fopen( elf_copy, "wb");
+    char buf[ 4096];
+    for ( size_t n; ( n = fread( buf, 1, sizeof( buf), src)) != 0; )
+        fwrite( buf, 1, n, dst);
+    fclose( src);
+    fclose( dst);
+
+    remove( cache_file);
+    ASSERT_TRUE( ElfImage::tryLoadCached( elf_copy, cache_file, image, error));
+
+    // the file is only touched, the cache takes its new time stamp
+    struct timeval times[ 2] = { { 1000, 0}, { 1000, 0}};
+    ASSERT_EQ( utimes( elf_copy, times), 0);
+    ASSERT_TRUE( ElfImage::tryLoadCache( elf_copy, cache_file, image, error));
+    ASSERT_EQ( readCacheField( cache_file, 24), 1000u); // after the magic, version and size
+
+    // the cache with a name out of the names or a wrong index is rejected
+    uint64 num_symbols = readCacheField( cache_file, 64);
+    uint64 names_size = readCacheField( cache_file, 72);
+    ASSERT_NE( num_symbols, 0u);
+    FILE* file = fopen( cache_file, "rb");
+    fseek( file, 0, SEEK_END);
+    long by_name_offset = ftell( file) - names_size - num_symbols * sizeof( uint32);
+    long symbols_offset = by_name_offset - num_symbols * sizeof( ElfSymbol);
+    fclose( file);
+
+    uint32 wrong = num_symbols;
+    writeCacheBytes( cache_file, by_name_offset, &wrong, sizeof( wrong));
+    ASSERT_FALSE( ElfImage::tryLoadCache( elf_copy, cache_file, image, error));
+    ASSERT_NE( error.find( "Broken cache file"), string::npos);
+
+    ASSERT_TRUE( image.trySaveCache( cache_file, error));
+    wrong = names_size;
+    writeCacheBytes( cache_file, symbols_offset + offsetof( ElfSymbol, name_offset),
+                     &wrong, sizeof( wrong));
+    ASSERT_FALSE( ElfImage::tryLoadCache( elf_copy, cache_file, image, error));
+    ASSERT_NE( error.find( "Broken cache file"), string::npos);
+
+    remove( cache_file);
+    remove( elf_copy);
+}
+
+TEST( Elf_parser, Sample_Kernels)
+{
+    const char* kernels[] = { "memcpy", "matmul", "linked_list",
+                              "quicksort", "crc32", "string_search"};
+
+    for ( size_t i = 0; i < sizeof( kernels) / sizeof( kernels[ 0]); ++i)
+    {
+        string file_name = string( "../../tests/samples/") + kernels[ i] + ".out";
+        ElfImage image;
+        string error;
+        ASSERT_TRUE( ElfImage::tryLoad( file_name.c_str(), image, error)) << error;
+
+        // each kernel starts at "__start" and writes its result to "result"
+        uint64 addr = 0;
+        ASSERT_TRUE( image.symbols.findByName( "__start", addr));
+        ASSERT_EQ( addr, image.entry_point);
+        ASSERT_TRUE( image.symbols.findByName( "result", addr));
+    }
+}
+
 int main( int argc, char* argv[])
 {
     ::testing::InitGoogleTest( &argc, argv);
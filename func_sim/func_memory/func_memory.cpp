@@ -7,57 +7,732 @@
 
 // Generic C
 #include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 // Generic C++
 #include <sstream>
 #include <iomanip>
+#include <algorithm>
 
 // uArchSim modules
 #include <func_memory.h>
 
-union uint64_8
-{
-    uint8 bytes[sizeof(uint64) / sizeof(uint8)];
-    uint64 val;
-};
+// true if the host stores the most significant byte first
+static const bool host_big_endian = __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__;
+
+// the user part of the O32 address space ends at 0x80000000
+static const uint64 STACK_TOP = 0x7fff0000;
+static const uint64 MMAP_TOP = 0x70000000;
+
+// the auxiliary vector entries of the initial stack
+static const uint32 AT_NULL = 0;
+static const uint32 AT_PAGESZ = 6;
+
+// the p_flags bits of the ELF program headers
+static const uint32 ELF_PF_X = 1;
+static const uint32 ELF_PF_W = 2;
+static const uint32 ELF_PF_R = 4;
+
+// the largest table of the memory: the sets, the pages of a set or a page
+static const uint64 MAX_GEOMETRY_BITS = 30;
+static const uint64 MAX_TABLE_SIZE = 1ull << MAX_GEOMETRY_BITS;
+
+uint8 FuncMemory::lazy_page = 0;
 
 FuncMemory::FuncMemory( const char* executable_file_name,
                         uint64 addr_bits,
                         uint64 page_bits,
-                        uint64 offset_bits) :
-    addr_bits( addr_bits),
-    page_bits( page_bits),
-    offset_bits( offset_bits),
-    set_bits( addr_bits - offset_bits - page_bits),
-    offset_mask( ( 1 << offset_bits) - 1),
-    page_mask ( ( ( 1 << page_bits) - 1) << offset_bits),
-    set_mask ( (( 1 << set_bits) - 1) << ( page_bits + offset_bits))
+                        uint64 offset_bits)
 {
     assert( executable_file_name);
 
-    memory = new uint8** [1 << set_bits];
-    memset(memory, 0, sizeof(uint8**) * (1 << set_bits));
-    
-    std::vector<ElfSection> sections_array;
-    ElfSection::getAllElfSections( executable_file_name, sections_array);
+    ElfImage image;
+    string error;
+    if ( !ElfImage::tryLoad( executable_file_name, image, error))
+    {
+        cerr << "ERROR: " << error << endl;
+        exit( EXIT_FAILURE);
+    }
+
+    init( addr_bits, page_bits, offset_bits, image.big_endian);
+    if ( !load( image, error))
+    {
+        cerr << "ERROR: " << error << endl;
+        exit( EXIT_FAILURE);
+    }
+}
+
+FuncMemory::FuncMemory( const ElfImage& image,
+                        uint64 addr_bits,
+                        uint64 page_bits,
+                        uint64 offset_bits)
+{
+    init( addr_bits, page_bits, offset_bits, image.big_endian);
+
+    string error;
+    if ( !load( image, error))
+    {
+        cerr << "ERROR: " << error << endl;
+        exit( EXIT_FAILURE);
+    }
+}
+
+FuncMemory::FuncMemory( const vector<ElfSection>& sections_array,
+                        uint64 addr_bits,
+                        uint64 page_bits,
+                        uint64 offset_bits,
+                        bool big_endian)
+{
+    init( addr_bits, page_bits, offset_bits, big_endian);
+    load( sections_array);
+}
+
+FuncMemory* FuncMemory::create( const char* executable_file_name,
+                                string& error,
+                                uint64 addr_bits,
+                                uint64 page_bits,
+                                uint64 offset_bits)
+{
+    if ( !executable_file_name)
+    {
+        error = "no executable file name";
+        return NULL;
+    }
+    if ( !checkGeometry( addr_bits, page_bits, offset_bits, error))
+        return NULL;
+
+    ElfImage image;
+    if ( !ElfImage::tryLoad( executable_file_name, image, error))
+        return NULL;
+
+    FuncMemory* memory = new FuncMemory( vector<ElfSection>(),
+                                         addr_bits, page_bits, offset_bits,
+                                         image.big_endian);
+    if ( !memory->load( image, error))
+    {
+        delete memory;
+        return NULL;
+    }
+    return memory;
+}
 
-    for ( vector<ElfSection>::iterator it = sections_array.begin(); it != sections_array.end(); ++it)
+bool FuncMemory::checkGeometry( uint64 addr_bits, uint64 page_bits, uint64 offset_bits,
+                                string& error)
+{
+    if ( addr_bits > 64 || page_bits + offset_bits >= addr_bits)
+    {
+        error = "memory geometry does not fit the address";
+        return false;
+    }
+    if ( offset_bits > MAX_GEOMETRY_BITS || page_bits > MAX_GEOMETRY_BITS)
+    {
+        error = "memory pages or sets are too large";
+        return false;
+    }
+
+    // the table of the sets is allocated at once, a set and a page on the 1st access
+    uint64 set_bits = addr_bits - offset_bits - page_bits;
+    if ( set_bits > MAX_GEOMETRY_BITS
+         || ( sizeof( Page*) << set_bits) > MAX_TABLE_SIZE
+         || ( sizeof( Page) << page_bits) > MAX_TABLE_SIZE
+         || ( 1ull << offset_bits) > MAX_TABLE_SIZE)
+    {
+        error = "memory tables are too large to allocate";
+        return false;
+    }
+    return true;
+}
+
+void FuncMemory::init( uint64 addr_bits, uint64 page_bits, uint64 offset_bits,
+                       bool big_endian)
+{
+    string error;
+    if ( !checkGeometry( addr_bits, page_bits, offset_bits, error))
+    {
+        cerr << "ERROR: " << error << endl;
+        exit( EXIT_FAILURE);
+    }
+
+    this->addr_bits = addr_bits;
+    this->page_bits = page_bits;
+    this->offset_bits = offset_bits;
+    set_bits = addr_bits - offset_bits - page_bits;
+    offset_mask = ( 1ull << offset_bits) - 1;
+    page_mask = ( ( 1ull << page_bits) - 1) << offset_bits;
+    set_mask = (( 1ull << set_bits) - 1) << ( page_bits + offset_bits);
+
+    startPC_addr = 0;
+    zero_page = NULL;
+    private_pages = 0;
+    image_data = NULL;
+    image_size = 0;
+    image_dev = 0;
+    image_ino = 0;
+    next_watchpoint_id = 0;
+
+    regions_changed = false;
+    region_checks = false;
+    heap_start = 0;
+    heap_end = 0;
+    mmap_top = MMAP_TOP;
+    if ( addr_bits < 64 && mmap_top > ( 1ull << addr_bits))
+        mmap_top = ( 1ull << addr_bits);
+    reset_heap_end = 0;
+    reset_mmap_top = mmap_top;
+
+    this->big_endian = big_endian;
+
+    memory = new Page* [1ull << set_bits];
+    memset(memory, 0, sizeof(Page*) * ( 1ull << set_bits));
+}
+
+void FuncMemory::load( const vector<ElfSection>& sections_array)
+{
+    for ( vector<ElfSection>::const_iterator it = sections_array.begin(); it != sections_array.end(); ++it)
     {
         if ( !strcmp( ".text", it->name))
         {
             startPC_addr = it->start_addr;
         }
-        for ( size_t offset = 0; offset < it->size; ++offset)
+        writeBlock( it->start_addr, it->content, it->size);
+
+        if ( it->size != 0)
+        {
+            MemoryRegion region = { it->name, it->start_addr, it->size,
+                                    MEM_READ | MEM_WRITE | MEM_EXEC };
+            insert_region( region);
+        }
+    }
+    init_heap();
+
+    // the loaded image is the initial state, not a change of it
+    clearDirtyPages();
+    setResetPoint();
+}
+
+bool FuncMemory::load( const ElfImage& image, string& error)
+{
+    int file_descr = open( image.file_name.c_str(), O_RDONLY);
+    struct stat file_stat;
+    if ( file_descr < 0 || fstat( file_descr, &file_stat) != 0)
+    {
+        error = "Could not open file " + image.file_name + ": " + strerror( errno);
+        if ( file_descr >= 0)
+            close( file_descr);
+        return false;
+    }
+
+    // the mapping stays valid after the file is closed
+    void* data = mmap( NULL, file_stat.st_size, PROT_READ, MAP_PRIVATE, file_descr, 0);
+    close( file_descr);
+    if ( data == MAP_FAILED)
+    {
+        error = "Could not map file " + image.file_name + ": " + strerror( errno);
+        return false;
+    }
+    image_data = static_cast<const uint8*>( data);
+    image_size = file_stat.st_size;
+    image_dev = file_stat.st_dev;
+    image_ino = file_stat.st_ino;
+
+    for ( size_t i = 0; i < image.segments.size(); ++i)
+    {
+        const ElfSegment& segment = image.segments[ i];
+        if ( segment.file_offset > image_size
+             || segment.file_size > image_size - segment.file_offset)
+        {
+            ostringstream oss;
+            oss << "The segment at 0x" << hex << segment.start_addr
+                << " is out of file " << image.file_name;
+            error = oss.str();
+            return false;
+        }
+    }
+
+    lazy_segments = image.segments;
+    for ( size_t i = 0; i < image.segments.size(); ++i)
+    {
+        const ElfSegment& segment = image.segments[ i];
+        mapSegment( segment);
+        if ( segment.mem_size == 0)
+            continue;
+
+        MemoryRegion region;
+        region.name = ( segment.flags & ELF_PF_X) != 0 ? "code" : "data";
+        region.start_addr = segment.start_addr;
+        region.size = segment.mem_size;
+        region.prot = ( ( segment.flags & ELF_PF_R) != 0 ? MEM_READ : 0)
+                      | ( ( segment.flags & ELF_PF_W) != 0 ? MEM_WRITE : 0)
+                      | ( ( segment.flags & ELF_PF_X) != 0 ? MEM_EXEC : 0);
+        insert_region( region);
+    }
+    init_heap();
+    setResetPoint();
+
+    startPC_addr = image.entry_point;
+    return true;
+}
+
+void FuncMemory::mapSegment( const ElfSegment& segment)
+{
+    // nothing is copied here, the pages only remember that they have data
+    uint64 addr = segment.start_addr;
+    uint64 size = segment.file_size;
+    while ( size != 0)
+    {
+        uint64 chunk = pageSize() - get_offset( addr);
+        if ( chunk > size)
+            chunk = size;
+
+        uint8** page = &alloc_set( addr)[get_page(addr)].data;
+        if ( *page == NULL || *page == zero_page)
+        {
+            *page = &lazy_page;
+        } else if ( *page != &lazy_page)
+        {
+            memcpy( *page + get_offset( addr),
+                    image_data + segment.file_offset + ( addr - segment.start_addr),
+                    chunk);
+        }
+        addr += chunk;
+        size -= chunk;
+    }
+
+    mapZeros( segment.start_addr + segment.file_size,
+              segment.mem_size - segment.file_size);
+}
+
+void FuncMemory::mapZeros( uint64 addr, uint64 size)
+{
+    while ( size != 0)
+    {
+        uint64 chunk = pageSize() - get_offset( addr);
+        if ( chunk > size)
+            chunk = size;
+
+        Page& entry = alloc_set( addr)[get_page(addr)];
+        uint8** page = &entry.data;
+        if ( chunk == pageSize() && *page == NULL)
+        {
+            // the whole page is zero, so it is shared until the first write
+            map_zero_page( entry);
+        } else if ( *page == NULL)
+        {
+            // the filling starts from zeros
+            *page = &lazy_page;
+        } else if ( *page != &lazy_page && *page != zero_page)
+        {
+            memset( *page + get_offset( addr), 0, chunk);
+        }
+        addr += chunk;
+        size -= chunk;
+    }
+}
+
+void FuncMemory::fill( uint64 addr) const
+{
+    Page& entry = memory[get_set(addr)][get_page(addr)];
+    uint8** page = &entry.data;
+    *page = new uint8 [1ull << offset_bits];
+    memset(*page, 0, sizeof(uint8) * ( 1ull << offset_bits));
+    entry.flags |= PAGE_PRIVATE;
+    ++private_pages;
+
+    // copy the parts of all the segments that are in the page
+    uint64 page_start = addr - get_offset( addr);
+    uint64 page_end = page_start + pageSize();
+    for ( size_t i = 0; i < lazy_segments.size(); ++i)
+    {
+        const ElfSegment& segment = lazy_segments[ i];
+        uint64 start = max( page_start, segment.start_addr);
+        uint64 end = min( page_end, segment.start_addr + segment.file_size);
+        if ( start < end)
+            memcpy( *page + ( start - page_start),
+                    image_data + segment.file_offset + ( start - segment.start_addr),
+                    end - start);
+    }
+}
+
+static bool canMerge( const MemoryRegion& a, const MemoryRegion& b)
+{
+    return a.start_addr + a.size == b.start_addr
+           && a.name == b.name && a.prot == b.prot;
+}
+
+void FuncMemory::insert_region( const MemoryRegion& region)
+{
+    vector<MemoryRegion>::iterator it = regions.begin();
+    while ( it != regions.end() && it->start_addr < region.start_addr)
+        ++it;
+    it = regions.insert( it, region);
+    regions_changed = true;
+    update_prot_flags( region.start_addr, region.size);
+
+    // a growing heap stays one region
+    if ( it + 1 != regions.end() && canMerge( *it, *( it + 1)))
+    {
+        it->size += ( it + 1)->size;
+        regions.erase( it + 1);
+    }
+    if ( it != regions.begin() && canMerge( *( it - 1), *it))
+    {
+        ( it - 1)->size += it->size;
+        regions.erase( it);
+    }
+}
+
+bool FuncMemory::overlaps( uint64 start_addr, uint64 size) const
+{
+    for ( size_t i = 0; i < regions.size(); ++i)
+        if ( start_addr < regions[ i].start_addr + regions[ i].size
+             && regions[ i].start_addr < start_addr + size)
+            return true;
+    return false;
+}
+
+void FuncMemory::init_heap()
+{
+    heap_start = 0;
+    for ( size_t i = 0; i < regions.size(); ++i)
+        heap_start = max( heap_start, regions[ i].start_addr + regions[ i].size);
+    heap_start = ( heap_start + pageSize() - 1) & ~offset_mask;
+    heap_end = heap_start;
+}
+
+// Maps the pages of the range that have no data to the shared zero page
+void FuncMemory::map_region_pages( uint64 start_addr, uint64 size)
+{
+    for ( uint64 addr = start_addr & ~offset_mask; addr < start_addr + size; addr += pageSize())
+    {
+        Page& page = alloc_set( addr)[get_page(addr)];
+        if ( page.data == NULL)
+        {
+            track_write( page, addr);
+            map_zero_page( page);
+        }
+    }
+}
+
+// Frees the pages of the range, the reset brings them back
+void FuncMemory::unmap_pages( uint64 start_addr, uint64 size)
+{
+    for ( uint64 addr = start_addr; addr < start_addr + size; addr += pageSize())
+    {
+        Page* set = memory[get_set(addr)];
+        if ( set == NULL || set[get_page(addr)].data == NULL)
+            continue;
+
+        Page& page = set[get_page(addr)];
+        track_write( page, addr);
+        if ( page.data != zero_page && page.data != &lazy_page)
+        {
+            delete [] page.data;
+            --private_pages;
+        }
+        page.data = NULL;
+        page.flags &= ~PAGE_PRIVATE;
+    }
+}
+
+bool FuncMemory::addRegion( const string& name, uint64 start_addr, uint64 size, uint32 prot)
+{
+    uint64 end = start_addr + size;
+    if ( size == 0 || end < start_addr || ( addr_bits < 64 && end > ( 1ull << addr_bits))
+         || overlaps( start_addr, size))
+        return false;
+
+    map_region_pages( start_addr, size);
+    MemoryRegion region = { name, start_addr, size, prot };
+    insert_region( region);
+    return true;
+}
+
+// Removes the range from the regions, the removed parts go to cut
+void FuncMemory::cut_regions( uint64 start_addr, uint64 end_addr, vector<MemoryRegion>& cut)
+{
+    vector<MemoryRegion> remaining;
+    for ( size_t i = 0; i < regions.size(); ++i)
+    {
+        const MemoryRegion& region = regions[ i];
+        uint64 region_end = region.start_addr + region.size;
+        if ( region_end <= start_addr || end_addr <= region.start_addr)
+        {
+            remaining.push_back( region);
+            continue;
+        }
+
+        MemoryRegion part = region;
+        part.start_addr = max( region.start_addr, start_addr);
+        part.size = min( region_end, end_addr) - part.start_addr;
+        cut.push_back( part);
+
+        // the parts of the region out of the range remain
+        if ( region.start_addr < start_addr)
+        {
+            MemoryRegion head = region;
+            head.size = start_addr - region.start_addr;
+            remaining.push_back( head);
+        }
+        if ( end_addr < region_end)
         {
-            write( it->content[offset], it->start_addr + offset, 1);
+            MemoryRegion tail = region;
+            tail.start_addr = end_addr;
+            tail.size = region_end - end_addr;
+            remaining.push_back( tail);
         }
     }
+    regions.swap( remaining);
+    regions_changed = true;
+}
+
+// Sets the PAGE_NO_* bits of the pages in the range
+// from the regions overlapping them
+void FuncMemory::update_prot_flags( uint64 start_addr, uint64 size)
+{
+    uint64 first = start_addr & ~offset_mask;
+    uint64 end = start_addr + size;
+    size_t num_pages = ( end - first + pageSize() - 1) / pageSize();
+    vector<uint32> prot( num_pages, 0);
+    vector<bool> covered( num_pages, false);
+
+    for ( size_t i = 0; i < regions.size(); ++i)
+    {
+        const MemoryRegion& region = regions[ i];
+        uint64 from = max( region.start_addr, first) & ~offset_mask;
+        uint64 to = min( region.start_addr + region.size, end);
+        for ( uint64 addr = from; addr < to; addr += pageSize())
+        {
+            size_t page = ( addr - first) / pageSize();
+            prot[ page] |= region.prot;
+            covered[ page] = true;
+        }
+    }
+
+    for ( size_t i = 0; i < num_pages; ++i)
+    {
+        uint64 addr = first + i * pageSize();
+        if ( !covered[ i] && memory[get_set(addr)] == NULL)
+            continue;
+
+        Page& page = alloc_set( addr)[get_page(addr)];
+        page.flags &= ~PAGE_NO_ACCESS;
+        if ( covered[ i] && ( prot[ i] & MEM_READ) == 0)
+            page.flags |= PAGE_NO_READ;
+        if ( covered[ i] && ( prot[ i] & MEM_WRITE) == 0)
+            page.flags |= PAGE_NO_WRITE;
+        if ( covered[ i] && ( prot[ i] & MEM_EXEC) == 0)
+            page.flags |= PAGE_NO_EXEC;
+    }
+}
+
+void FuncMemory::removeRegions( uint64 start_addr, uint64 size)
+{
+    uint64 start = start_addr & ~offset_mask;
+    uint64 end = ( start_addr + size + pageSize() - 1) & ~offset_mask;
+    if ( end <= start)
+        return;
+
+    vector<MemoryRegion> cut;
+    cut_regions( start, end, cut);
+
+    // a page shared with a remaining region is kept
+    for ( uint64 addr = start; addr < end; addr += pageSize())
+        if ( !overlaps( addr, pageSize()))
+            unmap_pages( addr, pageSize());
+    update_prot_flags( start, end - start);
+}
+
+bool FuncMemory::setProtection( uint64 start_addr, uint64 size, uint32 prot)
+{
+    uint64 start = start_addr & ~offset_mask;
+    uint64 end = ( start_addr + size + pageSize() - 1) & ~offset_mask;
+    if ( end <= start)
+        return false;
+
+    // the whole pages of the range are in the regions
+    uint64 covered = start;
+    for ( size_t i = 0; i < regions.size(); ++i)
+        if ( ( regions[ i].start_addr & ~offset_mask) <= covered
+             && regions[ i].start_addr + regions[ i].size > covered)
+            covered = ( regions[ i].start_addr + regions[ i].size + pageSize() - 1) & ~offset_mask;
+    if ( covered < end)
+        return false;
+
+    vector<MemoryRegion> cut;
+    cut_regions( start, end, cut);
+    for ( size_t i = 0; i < cut.size(); ++i)
+    {
+        cut[ i].prot = prot;
+        insert_region( cut[ i]);
+    }
+    return true;
+}
+
+uint32 FuncMemory::pageProt( uint64 addr) const
+{
+    uint32 flags = page_flags( addr);
+    if ( ( flags & PAGE_UNMAPPED) != 0)
+        return 0;
+    return ( ( flags & PAGE_NO_READ) == 0 ? MEM_READ : 0)
+           | ( ( flags & PAGE_NO_WRITE) == 0 ? MEM_WRITE : 0)
+           | ( ( flags & PAGE_NO_EXEC) == 0 ? MEM_EXEC : 0);
+}
+
+uint64 FuncMemory::setupStack( const vector<string>& argv, const vector<string>& envp,
+                               uint64 stack_size)
+{
+    uint64 top = STACK_TOP;
+    if ( addr_bits < 64 && top > ( 1ull << addr_bits))
+        top = ( 1ull << addr_bits);
+    stack_size = ( stack_size + pageSize() - 1) & ~offset_mask;
+
+    // the strings and the pointers to them take a part of the stack
+    uint64 used = 0;
+    for ( size_t i = 0; i < argv.size(); ++i)
+        used += argv[ i].size() + 1;
+    for ( size_t i = 0; i < envp.size(); ++i)
+        used += envp[ i].size() + 1;
+    // argc, argv and its NULL, envp and its NULL, AT_PAGESZ and AT_NULL pairs
+    uint64 num_words = 1 + argv.size() + 1 + envp.size() + 1 + 4;
+    used += num_words * 4 + 8;
+
+    if ( stack_size == 0 || stack_size > top || used > stack_size
+         || !addRegion( "stack", top - stack_size, stack_size, MEM_READ | MEM_WRITE))
+        return 0;
+
+    // a guard page separates the mappings from the stack
+    if ( mmap_top > top - stack_size - pageSize())
+        mmap_top = top - stack_size - pageSize();
+
+    uint64 addr = top;
+    vector<uint64> argv_addrs, envp_addrs;
+    for ( size_t i = 0; i < argv.size(); ++i)
+    {
+        addr -= argv[ i].size() + 1;
+        writeBlock( addr, reinterpret_cast<const uint8*>( argv[ i].c_str()), argv[ i].size() + 1);
+        argv_addrs.push_back( addr);
+    }
+    for ( size_t i = 0; i < envp.size(); ++i)
+    {
+        addr -= envp[ i].size() + 1;
+        writeBlock( addr, reinterpret_cast<const uint8*>( envp[ i].c_str()), envp[ i].size() + 1);
+        envp_addrs.push_back( addr);
+    }
+
+    uint64 sp = ( addr - num_words * 4) & ~7ull;
+    uint64 word = sp;
+    write( argv.size(), word, 4);
+    for ( size_t i = 0; i < argv_addrs.size(); ++i)
+        write( argv_addrs[ i], word += 4, 4);
+    write( 0, word += 4, 4);
+    for ( size_t i = 0; i < envp_addrs.size(); ++i)
+        write( envp_addrs[ i], word += 4, 4);
+    write( 0, word += 4, 4);
+    write( AT_PAGESZ, word += 4, 4);
+    write( pageSize(), word += 4, 4);
+    write( AT_NULL, word += 4, 4);
+    write( 0, word += 4, 4);
+
+    region_checks = true;
+    clearDirtyPages();
+    setResetPoint();
+    return sp;
+}
+
+bool FuncMemory::setProgramBreak( uint64 addr)
+{
+    if ( addr < heap_start)
+        return false;
+
+    uint64 old_end = ( heap_end + pageSize() - 1) & ~offset_mask;
+    uint64 new_end = ( addr + pageSize() - 1) & ~offset_mask;
+    if ( new_end > old_end)
+    {
+        // the heap does not grow into the mappings or the stack
+        if ( !addRegion( "heap", old_end, new_end - old_end, MEM_READ | MEM_WRITE))
+            return false;
+    } else if ( new_end < old_end)
+    {
+        removeRegions( new_end, old_end - new_end);
+    }
+    heap_end = addr;
+    return true;
+}
+
+uint64 FuncMemory::mapAnonymous( uint64 size, uint32 prot)
+{
+    size = ( size + pageSize() - 1) & ~offset_mask;
+    if ( size == 0 || size > mmap_top)
+        return 0;
+
+    // the highest gap that fits between the heap and the top of the mappings,
+    // so the space of the removed mappings is taken again
+    uint64 heap_top = ( heap_end + pageSize() - 1) & ~offset_mask;
+    uint64 gap_end = mmap_top;
+    for ( size_t i = regions.size(); i > 0 && gap_end >= heap_top + size; --i)
+    {
+        uint64 start = regions[ i - 1].start_addr & ~offset_mask;
+        uint64 end = ( regions[ i - 1].start_addr + regions[ i - 1].size + pageSize() - 1)
+                     & ~offset_mask;
+        if ( start >= gap_end)
+            continue;
+        if ( end <= gap_end - size)
+            break;
+        gap_end = start;
+    }
+
+    if ( gap_end < heap_top + size || !addRegion( "mmap", gap_end - size, size, prot))
+        return 0;
+    return gap_end - size;
+}
+
+bool FuncMemory::restoreRegions( const vector<MemoryRegion>& saved_regions,
+                                 uint64 saved_heap_start, uint64 saved_heap_end,
+                                 uint64 saved_mmap_top)
+{
+    uint64 limit = addr_bits < 64 ? 1ull << addr_bits : ~0ull;
+    if ( saved_heap_start > saved_heap_end || saved_mmap_top > limit)
+        return false;
+
+    uint64 prev_end = 0;
+    for ( size_t i = 0; i < saved_regions.size(); ++i)
+    {
+        const MemoryRegion& region = saved_regions[ i];
+        uint64 end = region.start_addr + region.size;
+        if ( region.size == 0 || end < region.start_addr || end > limit
+             || region.start_addr < prev_end)
+            return false;
+        prev_end = end;
+    }
+
+    // the pages of the old regions lose their protection, the new ones get theirs
+    vector<MemoryRegion> old_regions;
+    old_regions.swap( regions);
+    regions = saved_regions;
+    regions_changed = true;
+    for ( size_t i = 0; i < old_regions.size(); ++i)
+        update_prot_flags( old_regions[ i].start_addr, old_regions[ i].size);
+    for ( size_t i = 0; i < regions.size(); ++i)
+        update_prot_flags( regions[ i].start_addr, regions[ i].size);
+
+    heap_start = saved_heap_start;
+    heap_end = saved_heap_end;
+    mmap_top = saved_mmap_top;
+    return true;
 }
 
 FuncMemory::~FuncMemory()
 {
-    uint64 set_cnt = 1 << set_bits;
-    uint64 page_cnt = 1 << page_bits;
+    uint64 set_cnt = 1ull << set_bits;
+    uint64 page_cnt = 1ull << page_bits;
 
     for ( size_t set = 0; set < set_cnt; ++set)
     {
@@ -65,71 +740,745 @@ FuncMemory::~FuncMemory()
         {
             for ( size_t page = 0; page < page_cnt; ++page)
             {
-                if (memory[set][page] != NULL)
+                uint8* data = memory[set][page].data;
+                if ( data != NULL && data != zero_page && data != &lazy_page)
                 {
-                    delete [] memory[set][page];
+                    delete [] data;
                 }
             }
             delete [] memory[set];
         }
     }
     delete [] memory;
+    clear_journal();
+    delete [] zero_page;
+    if ( image_data != NULL)
+        munmap( const_cast<uint8*>( image_data), image_size);
 }
 
-uint64 FuncMemory::read( uint64 addr, unsigned short num_of_bytes) const
+template<bool guest_big_endian>
+uint64 FuncMemory::read_guest( const uint8* host_addr, uint64 addr,
+                               unsigned short num_of_bytes) const
 {
-    assert( num_of_bytes <= 8);
-    assert( num_of_bytes != 0);
-    assert( check( addr));
-    assert( check( addr + num_of_bytes - 1));
+    static const bool swap_bytes = guest_big_endian != host_big_endian;
+
+    // an access of a power of 2 size within one page is done
+    // by a single host load and a byte swap if it is needed
+    if ( get_offset( addr) + num_of_bytes <= pageSize())
+    {
+        switch ( num_of_bytes)
+        {
+            case 1:
+                return *host_addr;
+            case 2:
+            {
+                uint16 value;
+                memcpy( &value, host_addr, sizeof( value));
+                return swap_bytes ? __builtin_bswap16( value) : value;
+            }
+            case 4:
+            {
+                uint32 value;
+                memcpy( &value, host_addr, sizeof( value));
+                return swap_bytes ? __builtin_bswap32( value) : value;
+            }
+            case 8:
+            {
+                uint64 value;
+                memcpy( &value, host_addr, sizeof( value));
+                return swap_bytes ? __builtin_bswap64( value) : value;
+            }
+            default:
+                break;
+        }
+    }
+
+    // other sizes and accesses crossing a page border are done byte by byte
+    uint64 value = 0;
+    for ( size_t i = 0; i < num_of_bytes; ++i)
+    {
+        size_t byte_num = guest_big_endian ? num_of_bytes - 1 - i : i;
+        value |= ( uint64)read_byte( addr + i) << ( 8 * byte_num);
+    }
+    return value;
+}
 
-    uint64_8 value;
-    value.val = 0ull;
+template<bool guest_big_endian>
+void FuncMemory::write_guest( uint8* host_addr, uint64 value, uint64 addr,
+                              unsigned short num_of_bytes)
+{
+    static const bool swap_bytes = guest_big_endian != host_big_endian;
+
+    if ( get_offset( addr) + num_of_bytes <= pageSize())
+    {
+        switch ( num_of_bytes)
+        {
+            case 1:
+                *host_addr = value;
+                return;
+            case 2:
+            {
+                uint16 host_value = swap_bytes ? __builtin_bswap16( value) : value;
+                memcpy( host_addr, &host_value, sizeof( host_value));
+                return;
+            }
+            case 4:
+            {
+                uint32 host_value = swap_bytes ? __builtin_bswap32( value) : value;
+                memcpy( host_addr, &host_value, sizeof( host_value));
+                return;
+            }
+            case 8:
+            {
+                uint64 host_value = swap_bytes ? __builtin_bswap64( value) : value;
+                memcpy( host_addr, &host_value, sizeof( host_value));
+                return;
+            }
+            default:
+                break;
+        }
+    }
 
     for ( size_t i = 0; i < num_of_bytes; ++i)
     {
-        value.bytes[i] = read_byte( addr + i);
+        size_t byte_num = guest_big_endian ? num_of_bytes - 1 - i : i;
+        write_byte( addr + i, value >> ( 8 * byte_num));
     }
+}
+
+inline MemoryFault FuncMemory::read_pages( uint64 addr, unsigned short num_of_bytes,
+                                           uint32 denied, uint64& value, uint32& flags) const
+{
+    const Page* page = find_page( addr);
+    if ( page == NULL)
+        return FAULT_UNMAPPED;
+    flags = page->flags;
 
-    return value.val;
+    // the rare access crossing a page border looks up the next page as well
+    if ( get_offset( addr) + num_of_bytes > pageSize())
+    {
+        const Page* next = find_page( addr + num_of_bytes - 1);
+        if ( next == NULL)
+            return FAULT_UNMAPPED;
+        flags |= next->flags;
+    }
+    if ( ( flags & denied) != 0)
+        return FAULT_PROTECTION;
+
+    const uint8* host_addr = page->data + get_offset( addr);
+    value = big_endian ? read_guest<true>( host_addr, addr, num_of_bytes)
+                       : read_guest<false>( host_addr, addr, num_of_bytes);
+    return FAULT_NONE;
 }
 
-void FuncMemory::write( uint64 value, uint64 addr, unsigned short num_of_bytes)
+MemoryFault FuncMemory::readAccess( uint64 addr, unsigned short num_of_bytes,
+                                    uint64& value) const
+{
+    assert( num_of_bytes <= 8);
+    assert( num_of_bytes != 0);
+
+    uint32 flags = 0;
+    MemoryFault fault = read_pages( addr, num_of_bytes, PAGE_NO_READ, value, flags);
+    if ( fault == FAULT_NONE && ( flags & PAGE_WATCH_READ) != 0)
+        check_watchpoints( addr, num_of_bytes, false, value);
+    return fault;
+}
+
+MemoryFault FuncMemory::writeAccess( uint64 value, uint64 addr, unsigned short num_of_bytes)
 {
     assert( addr != 0);
     assert( num_of_bytes != 0 );
-    alloc( addr);
-    alloc( addr + num_of_bytes - 1);
+    assert( num_of_bytes <= 8);
 
-    uint64_8 value_;
-    value_.val = value;
+    uint64 last = addr + num_of_bytes - 1;
+    bool crossing = get_offset( addr) + num_of_bytes > pageSize();
+    if ( crossing)
+    {
+        // nothing is changed unless both the pages can be written
+        MemoryFault fault = write_fault( addr);
+        if ( fault == FAULT_NONE)
+            fault = write_fault( last);
+        if ( fault != FAULT_NONE)
+            return fault;
+    }
 
-    for ( size_t i = 0; i < num_of_bytes; ++i)
+    Page* page = NULL;
+    MemoryFault fault = prepare_write( addr, PAGE_NO_WRITE, page);
+    if ( fault != FAULT_NONE)
+        return fault;
+    uint32 flags = page->flags;
+    if ( crossing)
+    {
+        Page* next = NULL;
+        prepare_write( last, PAGE_NO_WRITE, next);
+        flags |= next->flags;
+    }
+
+    uint8* host_addr = page->data + get_offset( addr);
+    if ( big_endian)
+        write_guest<true>( host_addr, value, addr, num_of_bytes);
+    else
+        write_guest<false>( host_addr, value, addr, num_of_bytes);
+
+    if ( ( flags & PAGE_WATCH_WRITE) != 0)
+        check_watchpoints( addr, num_of_bytes, true, value);
+    return FAULT_NONE;
+}
+
+MemoryFault FuncMemory::fetchAccess( uint64 addr, uint32& value) const
+{
+    assert( ( addr & 3) == 0);
+
+    uint64 word = 0;
+    uint32 flags = 0;
+    MemoryFault fault = read_pages( addr, 4, PAGE_NO_EXEC, word, flags);
+    if ( fault == FAULT_NONE)
+        value = word;
+    return fault;
+}
+
+uint64 FuncMemory::read( uint64 addr, unsigned short num_of_bytes) const
+{
+    uint64 value = 0;
+    MemoryFault fault = readAccess( addr, num_of_bytes, value);
+    if ( fault != FAULT_NONE)
+        report_fault( addr, num_of_bytes, "read", fault);
+    return value;
+}
+
+void FuncMemory::write( uint64 value, uint64 addr, unsigned short num_of_bytes)
+{
+    MemoryFault fault = writeAccess( value, addr, num_of_bytes);
+    if ( fault != FAULT_NONE)
+        report_fault( addr, num_of_bytes, "write", fault);
+}
+
+bool FuncMemory::tryRead( uint64 addr, unsigned short num_of_bytes, uint64& value) const
+{
+    if ( num_of_bytes == 0 || num_of_bytes > 8)
+        return false;
+    return readAccess( addr, num_of_bytes, value) == FAULT_NONE;
+}
+
+bool FuncMemory::tryWrite( uint64 value, uint64 addr, unsigned short num_of_bytes)
+{
+    if ( addr == 0 || num_of_bytes == 0 || num_of_bytes > 8)
+        return false;
+    return writeAccess( value, addr, num_of_bytes) == FAULT_NONE;
+}
+
+uint32 FuncMemory::fetch( uint64 addr) const
+{
+    uint32 value = 0;
+    MemoryFault fault = fetchAccess( addr, value);
+    if ( fault != FAULT_NONE)
+        report_fault( addr, 4, "fetch", fault);
+    return value;
+}
+
+bool FuncMemory::tryFetch( uint64 addr, uint32& value) const
+{
+    if ( ( addr & 3) != 0)
+        return false;
+    return fetchAccess( addr, value) == FAULT_NONE;
+}
+
+void FuncMemory::readBlock( uint64 addr, uint8* buf, uint64 size) const
+{
+    while ( size != 0)
+    {
+        const Page* page = find_page( addr);
+        if ( page == NULL)
+            report_fault( addr, size, "read", FAULT_UNMAPPED);
+        uint64 chunk = pageSize() - get_offset( addr);
+        if ( chunk > size)
+            chunk = size;
+
+        memcpy( buf, page->data + get_offset( addr), chunk);
+        addr += chunk;
+        buf += chunk;
+        size -= chunk;
+    }
+}
+
+void FuncMemory::writeBlock( uint64 addr, const uint8* buf, uint64 size)
+{
+    while ( size != 0)
+    {
+        // the host ignores the protection
+        Page* page = NULL;
+        MemoryFault fault = prepare_write( addr, 0, page);
+        if ( fault != FAULT_NONE)
+            report_fault( addr, size, "write", fault);
+        uint64 chunk = pageSize() - get_offset( addr);
+        if ( chunk > size)
+            chunk = size;
+
+        memcpy( page->data + get_offset( addr), buf, chunk);
+        addr += chunk;
+        buf += chunk;
+        size -= chunk;
+    }
+}
+
+bool FuncMemory::tryReadBlock( uint64 addr, uint8* buf, uint64 size) const
+{
+    uint64 end = addr + size;
+    if ( end < addr || ( addr_bits < 64 && end > ( 1ull << addr_bits)))
+        return false;
+
+    uint32 flags = 0;
+    for ( uint64 page = addr & ~offset_mask; size != 0 && page < end; page += pageSize())
+        flags |= page_flags( page);
+    if ( ( flags & ( PAGE_UNMAPPED | PAGE_NO_READ)) != 0)
+        return false;
+
+    readBlock( addr, buf, size);
+    if ( ( flags & PAGE_WATCH_READ) != 0)
+        check_block_watchpoints( addr, buf, size, false);
+    return true;
+}
+
+bool FuncMemory::tryWriteBlock( uint64 addr, const uint8* buf, uint64 size)
+{
+    uint64 end = addr + size;
+    if ( addr == 0 || end < addr || ( addr_bits < 64 && end > ( 1ull << addr_bits)))
+        return false;
+
+    uint32 denied = PAGE_NO_WRITE | ( region_checks ? PAGE_UNMAPPED : 0);
+    uint32 flags = 0;
+    for ( uint64 page = addr & ~offset_mask; size != 0 && page < end; page += pageSize())
+        flags |= page_flags( page);
+    if ( ( flags & denied) != 0)
+        return false;
+
+    writeBlock( addr, buf, size);
+    if ( ( flags & PAGE_WATCH_WRITE) != 0)
+        check_block_watchpoints( addr, buf, size, true);
+    return true;
+}
+
+uint32 FuncMemory::addWatchpoint( uint64 start_addr, uint64 size, WatchType type,
+                                  MemoryWatcher* watcher)
+{
+    assert( size != 0);
+    assert( watcher != NULL);
+
+    WatchEntry entry;
+    entry.watchpoint.id = next_watchpoint_id++;
+    entry.watchpoint.start_addr = start_addr;
+    entry.watchpoint.size = size;
+    entry.watchpoint.type = type;
+    entry.watcher = watcher;
+    watchpoints.push_back( entry);
+
+    update_watch_flags( start_addr, size);
+    return entry.watchpoint.id;
+}
+
+void FuncMemory::removeWatchpoint( uint32 id)
+{
+    for ( size_t i = 0; i < watchpoints.size(); ++i)
+    {
+        if ( watchpoints[ i].watchpoint.id == id)
+        {
+            Watchpoint removed = watchpoints[ i].watchpoint;
+            watchpoints.erase( watchpoints.begin() + i);
+            update_watch_flags( removed.start_addr, removed.size);
+            return;
+        }
+    }
+}
+
+// Sets the PAGE_WATCH_* bits of the pages in the range
+// from the watchpoints overlapping them
+void FuncMemory::update_watch_flags( uint64 start_addr, uint64 size)
+{
+    uint64 page_addr = start_addr - get_offset( start_addr);
+    uint64 end_addr = start_addr + size - 1;
+    while ( true)
+    {
+        uint32 flags = 0;
+        uint64 page_end = page_addr + pageSize() - 1;
+        for ( size_t i = 0; i < watchpoints.size(); ++i)
+        {
+            const Watchpoint& watchpoint = watchpoints[ i].watchpoint;
+            if ( watchpoint.start_addr <= page_end
+                 && page_addr <= watchpoint.start_addr + watchpoint.size - 1)
+            {
+                if ( ( watchpoint.type & WATCH_READ) != 0)
+                    flags |= PAGE_WATCH_READ;
+                if ( ( watchpoint.type & WATCH_WRITE) != 0)
+                    flags |= PAGE_WATCH_WRITE;
+            }
+        }
+
+        Page& page = alloc_set( page_addr)[get_page(page_addr)];
+        page.flags = ( page.flags & ~( PAGE_WATCH_READ | PAGE_WATCH_WRITE)) | flags;
+
+        if ( page_end >= end_addr)
+            break;
+        page_addr += pageSize();
+    }
+}
+
+void FuncMemory::check_watchpoints( uint64 addr, uint64 size,
+                                    bool is_write, uint64 value) const
+{
+    WatchType type = is_write ? WATCH_WRITE : WATCH_READ;
+    for ( size_t i = 0; i < watchpoints.size(); ++i)
+    {
+        const Watchpoint& watchpoint = watchpoints[ i].watchpoint;
+        if ( ( watchpoint.type & type) != 0
+             && watchpoint.start_addr <= addr + size - 1
+             && addr <= watchpoint.start_addr + watchpoint.size - 1)
+        {
+            watchpoints[ i].watcher->watchHit( watchpoint, addr, size, is_write, value);
+        }
+    }
+}
+
+void FuncMemory::check_block_watchpoints( uint64 addr, const uint8* buf, uint64 size,
+                                          bool is_write) const
+{
+    WatchType type = is_write ? WATCH_WRITE : WATCH_READ;
+    for ( size_t i = 0; i < watchpoints.size(); ++i)
+    {
+        const Watchpoint& watchpoint = watchpoints[ i].watchpoint;
+        if ( ( watchpoint.type & type) == 0)
+            continue;
+
+        // the part of the watched range in the block
+        uint64 start = max( addr, watchpoint.start_addr);
+        uint64 last = min( addr + size - 1, watchpoint.start_addr + watchpoint.size - 1);
+        if ( start > last)
+            continue;
+
+        uint64 hit_size = last - start + 1;
+        uint64 value = 0;
+        for ( size_t j = 0; hit_size <= sizeof( value) && j < hit_size; ++j)
+        {
+            size_t byte_num = big_endian ? hit_size - 1 - j : j;
+            value |= ( uint64)buf[ start - addr + j] << ( 8 * byte_num);
+        }
+        watchpoints[ i].watcher->watchHit( watchpoint, start, hit_size, is_write, value);
+    }
+}
+
+void FuncMemory::getAllocatedPages( vector<uint64>& pages) const
+{
+    uint64 set_cnt = 1ull << set_bits;
+    uint64 page_cnt = 1ull << page_bits;
+
+    for ( size_t set = 0; set < set_cnt; ++set)
+    {
+        if ( memory[set] != NULL)
+        {
+            for ( size_t page = 0; page < page_cnt; ++page)
+            {
+                if ( memory[set][page].data != NULL)
+                {
+                    pages.push_back( get_addr( set, page, 0));
+                }
+            }
+        }
+    }
+}
+
+void FuncMemory::populate() const
+{
+    uint64 set_cnt = 1ull << set_bits;
+    uint64 page_cnt = 1ull << page_bits;
+
+    for ( size_t set = 0; set < set_cnt; ++set)
+    {
+        if ( memory[set] != NULL)
+        {
+            for ( size_t page = 0; page < page_cnt; ++page)
+            {
+                if ( memory[set][page].data == &lazy_page)
+                    fill( get_addr( set, page, 0));
+            }
+        }
+    }
+}
+
+void FuncMemory::getDirtyPages( vector<uint64>& pages) const
+{
+    pages.insert( pages.end(), dirty_pages.begin(), dirty_pages.end());
+    sort( pages.end() - dirty_pages.size(), pages.end());
+}
+
+void FuncMemory::clearDirtyPages()
+{
+    for ( size_t i = 0; i < dirty_pages.size(); ++i)
+        memory[get_set(dirty_pages[ i])][get_page(dirty_pages[ i])].flags &= ~PAGE_DIRTY;
+    dirty_pages.clear();
+}
+
+void FuncMemory::track_write( Page& page, uint64 addr)
+{
+    uint64 page_addr = addr - get_offset( addr);
+
+    if ( ( page.flags & PAGE_WRITTEN) == 0)
+    {
+        JournalEntry entry;
+        entry.addr = page_addr;
+        entry.original = page.data;
+        if ( page.data != NULL && page.data != zero_page && page.data != &lazy_page)
+        {
+            entry.original = new uint8 [1ull << offset_bits];
+            memcpy( entry.original, page.data, sizeof(uint8) * ( 1ull << offset_bits));
+        }
+        journal.push_back( entry);
+        page.flags |= PAGE_WRITTEN;
+    }
+
+    if ( ( page.flags & PAGE_DIRTY) == 0)
+    {
+        dirty_pages.push_back( page_addr);
+        page.flags |= PAGE_DIRTY;
+    }
+}
+
+void FuncMemory::reset()
+{
+    for ( size_t i = 0; i < journal.size(); ++i)
+    {
+        Page& page = memory[get_set(journal[ i].addr)][get_page(journal[ i].addr)];
+        uint8* original = journal[ i].original;
+
+        // neither the page nor its original are always private:
+        // a region can be added or removed after the reset point
+        if ( page.data != NULL && page.data != zero_page && page.data != &lazy_page)
+        {
+            delete [] page.data;
+            --private_pages;
+        }
+        if ( original != NULL && original != zero_page && original != &lazy_page)
+        {
+            ++private_pages;
+            page.flags |= PAGE_PRIVATE;
+        } else
+        {
+            page.flags &= ~PAGE_PRIVATE;
+        }
+        page.data = original;
+        // the content has changed, so the page stays dirty
+        page.flags &= ~PAGE_WRITTEN;
+    }
+    journal.clear();
+
+    heap_end = reset_heap_end;
+    mmap_top = reset_mmap_top;
+    if ( regions_changed)
+    {
+        // the pages of both the dropped and the restored regions get their permissions
+        vector<MemoryRegion> changed;
+        changed.swap( regions);
+        regions = reset_regions;
+        for ( size_t i = 0; i < changed.size(); ++i)
+            update_prot_flags( changed[ i].start_addr, changed[ i].size);
+        for ( size_t i = 0; i < regions.size(); ++i)
+            update_prot_flags( regions[ i].start_addr, regions[ i].size);
+        regions_changed = false;
+    }
+}
+
+void FuncMemory::setResetPoint()
+{
+    reset_regions = regions;
+    regions_changed = false;
+    reset_heap_end = heap_end;
+    reset_mmap_top = mmap_top;
+
+    for ( size_t i = 0; i < journal.size(); ++i)
+        memory[get_set(journal[ i].addr)][get_page(journal[ i].addr)].flags &= ~PAGE_WRITTEN;
+    clear_journal();
+}
+
+void FuncMemory::clear_journal()
+{
+    for ( size_t i = 0; i < journal.size(); ++i)
+    {
+        uint8* original = journal[ i].original;
+        if ( original != NULL && original != zero_page && original != &lazy_page)
+            delete [] original;
+    }
+    journal.clear();
+}
+
+const uint8* FuncMemory::page_data( uint64 addr) const
+{
+    load_page( addr);
+    return memory[get_set(addr)][get_page(addr)].data;
+}
+
+bool FuncMemory::same_origin( const FuncMemory& other, uint64 addr) const
+{
+    const uint8* data = memory[get_set(addr)][get_page(addr)].data;
+    const uint8* other_data = other.memory[other.get_set(addr)][other.get_page(addr)].data;
+    // all the lazy pages point to the same placeholder whatever file they are of
+    if ( data == other_data && data != &lazy_page)
+        return true;
+
+    if ( data == zero_page && other_data == other.zero_page)
+        return true;
+
+    // the pages are not loaded yet from the same segments of the same file
+    if ( data != &lazy_page || other_data != &lazy_page
+         || image_dev != other.image_dev || image_ino != other.image_ino
+         || lazy_segments.size() != other.lazy_segments.size())
+        return false;
+
+    for ( size_t i = 0; i < lazy_segments.size(); ++i)
+    {
+        const ElfSegment& a = lazy_segments[ i];
+        const ElfSegment& b = other.lazy_segments[ i];
+        if ( a.start_addr != b.start_addr || a.file_offset != b.file_offset
+             || a.file_size != b.file_size)
+            return false;
+    }
+    return true;
+}
+
+void FuncMemory::diff( const FuncMemory& other, vector<MemoryRange>& ranges) const
+{
+    assert( pageSize() == other.pageSize());
+
+    vector<uint64> pages, other_pages;
+    getAllocatedPages( pages);
+    other.getAllocatedPages( other_pages);
+
+    // both the arrays are sorted, so they are merged in one pass
+    size_t i = 0, j = 0;
+    while ( i < pages.size() || j < other_pages.size())
+    {
+        if ( j == other_pages.size() || ( i < pages.size() && pages[ i] < other_pages[ j]))
+        {
+            addRange( pages[ i++], pageSize(), ranges);
+        } else if ( i == pages.size() || other_pages[ j] < pages[ i])
+        {
+            addRange( other_pages[ j++], pageSize(), ranges);
+        } else
+        {
+            uint64 addr = pages[ i];
+            if ( !same_origin( other, addr))
+                diffBytes( page_data( addr), other.page_data( addr), pageSize(), addr, ranges);
+            ++i;
+            ++j;
+        }
+    }
+}
+
+void FuncMemory::addRange( uint64 addr, uint64 size, vector<MemoryRange>& ranges)
+{
+    if ( !ranges.empty() && ranges.back().start_addr + ranges.back().size == addr)
     {
-        write_byte( addr + i, value_.bytes[i]);
+        ranges.back().size += size;
+    } else
+    {
+        MemoryRange range;
+        range.start_addr = addr;
+        range.size = size;
+        ranges.push_back( range);
     }
 }
 
-void FuncMemory::alloc( uint64 addr)
+void FuncMemory::diffBytes( const uint8* a, const uint8* b, uint64 size, uint64 addr,
+                            vector<MemoryRange>& ranges)
 {
-    uint8*** set = &memory[get_set(addr)];
+    uint64 i = 0;
+#ifdef __SSE2__
+    // the equal blocks, which are the common case, cost a compare and a test
+    for ( ; i + 16 <= size; i += 16)
+    {
+        __m128i x = _mm_loadu_si128( reinterpret_cast<const __m128i*>( a + i));
+        __m128i y = _mm_loadu_si128( reinterpret_cast<const __m128i*>( b + i));
+        uint32 equal = _mm_movemask_epi8( _mm_cmpeq_epi8( x, y));
+        if ( equal == 0xffff)
+            continue;
+
+        for ( uint32 k = 0; k < 16; ++k)
+            if ( ( equal & ( 1u << k)) == 0)
+                addRange( addr + i + k, 1, ranges);
+    }
+#endif
+    for ( ; i < size; ++i)
+        if ( a[ i] != b[ i])
+            addRange( addr + i, 1, ranges);
+}
+
+FuncMemory::Page* FuncMemory::alloc_set( uint64 addr)
+{
+    Page** set = &memory[get_set(addr)];
     if ( *set == NULL)
     {
-        *set = new uint8* [1 << page_bits];
-    	memset(*set, 0, sizeof(uint8*) * (1 << page_bits));
+        *set = new Page [1ull << page_bits];
+    	memset(*set, 0, sizeof(Page) * ( 1ull << page_bits));
     }
-    uint8** page = &memory[get_set(addr)][get_page(addr)];
-    if ( *page == NULL)
+    return *set;
+}
+
+MemoryFault FuncMemory::prepare_write_slow( uint64 addr, uint32 denied, Page& page)
+{
+    if ( ( page.flags & denied) != 0)
+        return FAULT_PROTECTION;
+    if ( page.data == NULL && region_checks)
+        return FAULT_UNMAPPED;
+
+    track_write( page, addr);
+    if ( page.data == &lazy_page)
+    {
+        fill( addr);
+    } else if ( page.data == NULL || page.data == zero_page)
+    {
+        // a shared zero page is replaced by a private page of zeros as well
+        page.data = new uint8 [1ull << offset_bits];
+    	memset(page.data, 0, sizeof(uint8) * ( 1ull << offset_bits));
+        page.flags |= PAGE_PRIVATE;
+        ++private_pages;
+    }
+    return FAULT_NONE;
+}
+
+MemoryFault FuncMemory::write_fault( uint64 addr) const
+{
+    uint32 flags = page_flags( addr);
+    if ( ( flags & PAGE_UNMAPPED) != 0)
+        return region_checks ? FAULT_UNMAPPED : FAULT_NONE;
+    return ( flags & PAGE_NO_WRITE) != 0 ? FAULT_PROTECTION : FAULT_NONE;
+}
+
+void FuncMemory::map_zero_page( Page& page)
+{
+    if ( zero_page == NULL)
     {
-        *page = new uint8 [1 << offset_bits];
-    	memset(*page, 0, sizeof(uint8) * (1 << offset_bits));
+        zero_page = new uint8 [1ull << offset_bits];
+        memset( zero_page, 0, sizeof( uint8) * ( 1ull << offset_bits));
     }
+    page.data = zero_page;
+    page.flags &= ~PAGE_PRIVATE;
+}
+
+void FuncMemory::report_fault( uint64 addr, uint64 size, const char* access,
+                               MemoryFault fault) const
+{
+    cerr << "ERROR: " << access << " of " << dec << size << " bytes at 0x" << hex << addr;
+    if ( fault == FAULT_PROTECTION)
+        cerr << " is not permitted by the protection of the page";
+    else if ( region_checks)
+        cerr << " is out of the guest regions";
+    else
+        cerr << " is out of the loaded memory";
+    cerr << dec << endl;
+    exit( EXIT_FAILURE);
 }
 
 bool FuncMemory::check( uint64 addr) const
 {
-    uint8** set = memory[get_set(addr)];
-    return set != NULL && set[get_page(addr)] != NULL;
+    Page* set = memory[get_set(addr)];
+    return set != NULL && set[get_page(addr)].data != NULL;
 }
 
 string FuncMemory::dump( string indent) const
@@ -137,9 +1486,9 @@ string FuncMemory::dump( string indent) const
     std::ostringstream oss;
     oss << std::setfill( '0') << hex;
     
-    uint64 set_cnt = 1 << set_bits;
-    uint64 page_cnt = 1 << page_bits;
-    uint64 offset_cnt = 1 << offset_bits;
+    uint64 set_cnt = 1ull << set_bits;
+    uint64 page_cnt = 1ull << page_bits;
+    uint64 offset_cnt = 1ull << offset_bits;
     
     for ( size_t set = 0; set < set_cnt; ++set)
     {
@@ -147,14 +1496,15 @@ string FuncMemory::dump( string indent) const
         {
             for ( size_t page = 0; page < page_cnt; ++page)
             {
-                if (memory[set][page] != NULL)
+                if (memory[set][page].data != NULL)
                 {
+                    load_page( get_addr( set, page, 0));
                     for ( size_t offset = 0; offset < offset_cnt; ++offset)
                     {
-                        if (memory[set][page][offset])
+                        if (memory[set][page].data[offset])
                         {
                             oss << "addr 0x" << get_addr( set, page, offset) 
-                                << ": data 0x" << memory[set][page][offset] << std::endl;
+                                << ": data 0x" << memory[set][page].data[offset] << std::endl;
                         }
                     }
                 }
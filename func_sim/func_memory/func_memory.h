@@ -18,11 +18,174 @@
 #include <types.h>
 #include <elf_parser.h>
 
+enum WatchType
+{
+    WATCH_READ = 1,
+    WATCH_WRITE = 2,
+    WATCH_ACCESS = WATCH_READ | WATCH_WRITE
+};
+
+struct Watchpoint
+{
+    uint32 id;
+    uint64 start_addr;
+    uint64 size;
+    WatchType type;
+};
+
+// A range of addresses, e.g. of the bytes that differ in two memories
+struct MemoryRange
+{
+    uint64 start_addr;
+    uint64 size;
+};
+
+enum MemoryProt
+{
+    MEM_READ = 1,
+    MEM_WRITE = 2,
+    MEM_EXEC = 4
+};
+
+// A range of the guest addresses the program may access:
+// a loaded segment, the stack, the heap or an anonymous mapping
+struct MemoryRegion
+{
+    string name;
+    uint64 start_addr;
+    uint64 size;
+    uint32 prot; // MEM_* bits
+};
+
+// The result of an access of a guest instruction
+enum MemoryFault
+{
+    FAULT_NONE,      // the access is done
+    FAULT_UNMAPPED,  // a page of the access has no data or is out of the guest regions
+    FAULT_PROTECTION // a page of the access does not permit it
+};
+
+// Gets the accesses to the watched ranges of the memory
+class MemoryWatcher
+{
+    public:
+        virtual ~MemoryWatcher() { }
+
+        // The value is the one read or written. A block access of the guest
+        // is reported once with the part of the watched range it accessed,
+        // the value holds the bytes of the part if there are 8 or less, 0 otherwise.
+        // The host block accesses are not reported.
+        virtual void watchHit( const Watchpoint& watchpoint,
+                               uint64 addr, uint64 size,
+                               bool is_write, uint64 value) = 0;
+};
+
 class FuncMemory
 {
     private:
-        uint8*** memory;
+        // An entry of the page table
+        struct Page
+        {
+            uint8* data;  // NULL if the page is not allocated
+            uint32 flags; // PAGE_* bits
+        };
+        enum PageFlags
+        {
+            PAGE_DIRTY = 1,   // written since the last clearDirtyPages
+            PAGE_WRITTEN = 2, // written since the last reset, the journal has its original
+            PAGE_WATCH_READ = 4,  // the reads of the page are checked against watchpoints
+            PAGE_WATCH_WRITE = 8, // the writes of the page are checked against watchpoints
+            PAGE_UNMAPPED = 16,   // returned by load_page for a page without data, never stored
+            // the permissions are stored negated, so a page out of the regions
+            // is accessed as before and a check is a test of the flags
+            PAGE_NO_READ = 32,
+            PAGE_NO_WRITE = 64,
+            PAGE_NO_EXEC = 128,
+            PAGE_NO_ACCESS = PAGE_NO_READ | PAGE_NO_WRITE | PAGE_NO_EXEC,
+            PAGE_PRIVATE = 256,   // the data is own host memory, not NULL, zero_page or lazy_page
+
+            // a write to a page without all these bits goes to track_write
+            PAGE_TRACKED = PAGE_DIRTY | PAGE_WRITTEN
+        };
+
+        Page** memory;
         uint64 startPC_addr;
+
+        // start addresses of the dirty pages in order of their 1st write,
+        // so the dirty pages are found without walking the page table
+        vector<uint64> dirty_pages;
+
+        // The original content of a page written since the last reset:
+        // NULL, zero_page or &lazy_page for the pages that are restored
+        // without copying, otherwise a private copy of the page.
+        struct JournalEntry
+        {
+            uint64 addr;
+            uint8* original;
+        };
+        vector<JournalEntry> journal;
+
+        // Only the pages with PAGE_WATCH_* bits look here,
+        // so the accesses to the other pages do no range checks
+        struct WatchEntry
+        {
+            Watchpoint watchpoint;
+            MemoryWatcher* watcher;
+        };
+        vector<WatchEntry> watchpoints;
+        uint32 next_watchpoint_id;
+
+        void update_watch_flags( uint64 start_addr, uint64 size);
+        void check_watchpoints( uint64 addr, uint64 size,
+                                bool is_write, uint64 value) const;
+        void check_block_watchpoints( uint64 addr, const uint8* buf, uint64 size,
+                                      bool is_write) const;
+
+        // the data of the allocated page, loaded if it is needed
+        const uint8* page_data( uint64 addr) const;
+        // true if the pages are equal by construction, so their bytes are not compared
+        bool same_origin( const FuncMemory& other, uint64 addr) const;
+
+        // All the pages of zero-initialized data (".bss") that are not
+        // written yet point to this page, it is copied on the first write.
+        uint8* zero_page;
+        mutable uint64 private_pages; // number of pages that have own host memory
+
+        // The pages holding data of the ELF file point to this marker
+        // until the first access, which fills them from the mapped file.
+        static uint8 lazy_page;
+        const uint8* image_data; // the whole ELF file mapped to the host memory
+        uint64 image_size;
+        uint64 image_dev; // the device and the inode identify the file
+        uint64 image_ino;
+        vector<ElfSegment> lazy_segments;
+
+        // The guest regions sorted by address. With the region checks on
+        // a page out of them is never allocated, an access to it is reported.
+        // The pages of the regions are mapped when the regions are added,
+        // so the checks are done only for the pages without data.
+        // A page gets the permissions of all the regions it is shared by.
+        vector<MemoryRegion> regions;
+        bool regions_changed; // since the reset point
+        bool region_checks;
+        uint64 heap_start;
+        uint64 heap_end; // the program break
+        uint64 mmap_top; // the anonymous mappings are taken from the top down below it
+        // the regions at the reset point
+        vector<MemoryRegion> reset_regions;
+        uint64 reset_heap_end;
+        uint64 reset_mmap_top;
+
+        void insert_region( const MemoryRegion& region);
+        void cut_regions( uint64 start_addr, uint64 end_addr,
+                          vector<MemoryRegion>& cut /*used as output*/);
+        void update_prot_flags( uint64 start_addr, uint64 size);
+        bool overlaps( uint64 start_addr, uint64 size) const;
+        void map_zero_page( Page& page);
+        void map_region_pages( uint64 start_addr, uint64 size);
+        void unmap_pages( uint64 start_addr, uint64 size);
+        void init_heap();
+        void report_fault( uint64 addr, uint64 size, const char* access, MemoryFault fault) const;
     
         uint64 addr_bits;
         uint64 set_bits;
@@ -55,7 +218,7 @@ class FuncMemory
         
         inline uint8* get_host_addr( uint64 addr) const
         {
-            return &memory[get_set(addr)][get_page(addr)][get_offset(addr)];
+            return &memory[get_set(addr)][get_page(addr)].data[get_offset(addr)];
         }
 
         inline uint8 read_byte( uint64 addr) const
@@ -68,19 +231,253 @@ class FuncMemory
            *get_host_addr(addr) = value;
         }
         
-        void alloc( uint64 addr);
+        Page* alloc_set( uint64 addr);
         bool check( uint64 addr) const;
 
+        void fill( uint64 addr) const;
+
+        void track_write( Page& page, uint64 addr);
+        void clear_journal();
+
+        // Makes the page ready for a write the denied flags do not forbid.
+        // All the bookkeeping is out of the usual path,
+        // so the writes after the 1st one cost a single test.
+        inline MemoryFault prepare_write( uint64 addr, uint32 denied, Page*& page /*used as output*/)
+        {
+            page = &alloc_set( addr)[get_page(addr)];
+            if ( ( page->flags & ( PAGE_TRACKED | PAGE_PRIVATE | denied))
+                 == ( PAGE_TRACKED | PAGE_PRIVATE))
+                return FAULT_NONE;
+            return prepare_write_slow( addr, denied, *page);
+        }
+        MemoryFault prepare_write_slow( uint64 addr, uint32 denied, Page& page);
+        // The fault of a write to the page without changing it
+        MemoryFault write_fault( uint64 addr) const;
+
+        // The flags of the page without loading it, PAGE_UNMAPPED if it has no data
+        inline uint32 page_flags( uint64 addr) const
+        {
+            const Page* set = memory[get_set(addr)];
+            if ( set == NULL || set[get_page(addr)].data == NULL)
+                return PAGE_UNMAPPED;
+            return set[get_page(addr)].flags;
+        }
+        // Makes the page ready for a read and returns it, NULL if the page has no data
+        inline const Page* find_page( uint64 addr) const
+        {
+            const Page* set = memory[get_set(addr)];
+            if ( set == NULL || set[get_page(addr)].data == NULL)
+                return NULL;
+
+            const Page* page = &set[get_page(addr)];
+            if ( page->data == &lazy_page)
+                fill( addr);
+            return page;
+        }
+        // The same, but returns the flags of the page, PAGE_UNMAPPED if it has no data
+        inline uint32 load_page( uint64 addr) const
+        {
+            const Page* page = find_page( addr);
+            return page == NULL ? ( uint32)PAGE_UNMAPPED : page->flags;
+        }
+        // Reads the data of a read or a fetch looking up each page once.
+        // Returns the fault if a page has no data or has a denied flag.
+        inline MemoryFault read_pages( uint64 addr, unsigned short num_of_bytes, uint32 denied,
+                                       uint64& value /*used as output*/,
+                                       uint32& flags /*used as output*/) const;
+
+        // The byte order of the guest is a predicted branch between
+        // the inlined instances of read_guest and write_guest,
+        // each of them has no checks of it inside.
+        bool big_endian;
+
+        // host_addr is the place of the 1st byte in its page
+        template<bool guest_big_endian>
+        inline uint64 read_guest( const uint8* host_addr, uint64 addr,
+                                  unsigned short num_of_bytes) const;
+        template<bool guest_big_endian>
+        inline void write_guest( uint8* host_addr, uint64 value, uint64 addr,
+                                 unsigned short num_of_bytes);
+
+        void init( uint64 addr_size, uint64 page_num_size, uint64 offset_size,
+                   bool big_endian);
+        void load( const vector<ElfSection>& sections_array);
+        bool load( const ElfImage& image, string& error /*used as output*/);
+        void mapSegment( const ElfSegment& segment);
+        void mapZeros( uint64 addr, uint64 size);
+
     public:
         FuncMemory ( const char* executable_file_name,
                      uint64 addr_size = 32,
                      uint64 page_num_size = 10,
                      uint64 offset_size = 12);
+        // Creates the memory from sections that are already extracted
+        // from the ELF file, so one binary can be loaded by many simulations.
+        FuncMemory ( const vector<ElfSection>& sections_array,
+                     uint64 addr_size = 32,
+                     uint64 page_num_size = 10,
+                     uint64 offset_size = 12,
+                     bool big_endian = false);
+        // Creates the memory from the loadable segments of the ELF file.
+        // The file is mapped to the host memory and each page is filled
+        // from there on its first access, so a run touching a small part
+        // of a huge binary does not pay for the rest of it.
+        // Zero-initialized parts of the segments take no host memory until written.
+        FuncMemory ( const ElfImage& image,
+                     uint64 addr_size = 32,
+                     uint64 page_num_size = 10,
+                     uint64 offset_size = 12);
         virtual ~FuncMemory();
+
+        // Creates the memory as the 1st constructor does, but instead of
+        // terminating the program returns NULL and the description of the problem.
+        static FuncMemory* create( const char* executable_file_name,
+                                   string& error /*used as output*/,
+                                   uint64 addr_size = 32,
+                                   uint64 page_num_size = 10,
+                                   uint64 offset_size = 12);
+
+        // Checks that the pages fit the address and the tables of the memory
+        // can be allocated. Returns false and the description of the problem otherwise.
+        static bool checkGeometry( uint64 addr_size, uint64 page_num_size, uint64 offset_size,
+                                   string& error /*used as output*/);
+
+        // The accesses of the guest instructions. Each page is looked up once:
+        // the access is done if it is permitted, otherwise nothing is changed
+        // and the fault is returned. The size is 1 to 8 bytes, a write is not to 0,
+        // a fetch is aligned. The other accesses below are wrappers of these ones.
+        MemoryFault readAccess( uint64 addr, unsigned short num_of_bytes,
+                                uint64& value /*used as output*/) const;
+        MemoryFault writeAccess( uint64 value, uint64 addr, unsigned short num_of_bytes);
+        MemoryFault fetchAccess( uint64 addr, uint32& value /*used as output*/) const;
+
         uint64 read( uint64 addr, unsigned short num_of_bytes = 4) const;
         void write( uint64 value, uint64 addr, unsigned short num_of_bytes = 4);
+
+        // The same as read and write, but return false
+        // on wrong arguments, uninitialized memory or a protection fault
+        // instead of aborting.
+        bool tryRead( uint64 addr, unsigned short num_of_bytes,
+                      uint64& value /*used as output*/) const;
+        bool tryWrite( uint64 value, uint64 addr, unsigned short num_of_bytes);
+
+        // Reads an instruction word, the page must be executable.
+        // The address must be aligned, so the word is in one page.
+        uint32 fetch( uint64 addr) const;
+        bool tryFetch( uint64 addr, uint32& value /*used as output*/) const;
         inline uint64 startPC() const { return startPC_addr; }
+        inline bool isBigEndian() const { return big_endian; }
         std::string dump( string indent = "") const;
+
+        inline uint64 addrBits() const { return addr_bits; }
+        inline uint64 pageBits() const { return page_bits; }
+        inline uint64 offsetBits() const { return offset_bits; }
+        inline uint64 pageSize() const { return offset_mask + 1; }
+
+        // Copy size bytes between the memory and a host buffer page by page.
+        // readBlock requires all the bytes to be initialized.
+        // These are the accesses of the host (loading, checkpoints),
+        // so the protection of the pages and the watchpoints are not checked.
+        void readBlock( uint64 addr, uint8* buf, uint64 size) const;
+        void writeBlock( uint64 addr, const uint8* buf, uint64 size);
+        // The same as readBlock and writeBlock, but return false
+        // on uninitialized bytes, a range out of the address space
+        // or a protection fault instead of aborting, nothing is copied then.
+        // These are for the guest buffers, the watchers see them.
+        bool tryReadBlock( uint64 addr, uint8* buf, uint64 size) const;
+        bool tryWriteBlock( uint64 addr, const uint8* buf, uint64 size);
+
+        // Gets start addresses of all the allocated pages in ascending order
+        void getAllocatedPages( vector<uint64>& pages /*used as output*/) const;
+        // Gets start addresses of the pages written since the creation
+        // of the memory or the last clearDirtyPages in ascending order.
+        // Loading of the ELF file does not make the pages dirty.
+        void getDirtyPages( vector<uint64>& pages /*used as output*/) const;
+        void clearDirtyPages();
+
+        // Reverts the pages written since the creation of the memory,
+        // the last reset or setResetPoint, so the next run starts
+        // from the loaded image without reloading it.
+        void reset();
+        // Makes the current content the one reset returns to
+        void setResetPoint();
+
+        // The watcher is called on each access overlapping the range
+        // of the given type. Returns the id of the watchpoint.
+        uint32 addWatchpoint( uint64 start_addr, uint64 size, WatchType type,
+                              MemoryWatcher* watcher);
+        void removeWatchpoint( uint32 id);
+
+        // Finds the bytes that differ in this and the other memory, which must
+        // have the same page size. A page allocated in only one of them
+        // differs entirely. Appends the ranges in ascending order.
+        void diff( const FuncMemory& other,
+                   vector<MemoryRange>& ranges /*used as output*/) const;
+
+        // Compares size bytes of two buffers 16 bytes at a time and
+        // appends the differing ranges starting from addr, merging them
+        // with the last range of the array if they are adjacent.
+        static void diffBytes( const uint8* a, const uint8* b, uint64 size, uint64 addr,
+                               vector<MemoryRange>& ranges /*used as output*/);
+        // Appends the range merging it with the last one if they are adjacent
+        static void addRange( uint64 addr, uint64 size,
+                              vector<MemoryRange>& ranges /*used as output*/);
+
+        // Number of the allocated pages that are not shared zero pages
+        inline uint64 privatePages() const { return private_pages; }
+        // Fills all the pages not loaded from the file yet,
+        // so the loading is done at once instead of on the 1st accesses
+        void populate() const;
+
+        // The regions of the loaded segments are named "code" and "data",
+        // the heap starts at the first page after them.
+        const vector<MemoryRegion>& getRegions() const { return regions; }
+        // Adds a region of zeros. Returns false if the region is empty,
+        // overlaps another one or is out of the address space.
+        bool addRegion( const string& name, uint64 start_addr, uint64 size, uint32 prot);
+        // Removes the whole pages of the range from the regions and frees them
+        void removeRegions( uint64 start_addr, uint64 size);
+        // Changes the protection of the whole pages of the range.
+        // Returns false if a part of the range is out of the regions.
+        // A code page made writable is the only one that can change,
+        // so the decoded instructions of the other ones stay valid.
+        bool setProtection( uint64 start_addr, uint64 size, uint32 prot);
+        // MEM_* bits of the page, all of them for a page out of the regions,
+        // none for a page without data
+        uint32 pageProt( uint64 addr) const;
+
+        // With the checks on, the writes out of the regions are not allocating
+        // the memory any more, they and the reads out of the regions
+        // are reported, and tryRead and tryWrite return false for them.
+        inline void setRegionChecks( bool on) { region_checks = on; }
+        inline bool regionChecks() const { return region_checks; }
+
+        // Adds the stack at the top of the user addresses and puts there
+        // argc, argv, envp and the auxiliary vector as Linux does for O32.
+        // Turns the region checks on and makes the result the initial state:
+        // the reset point without dirty pages. Returns the stack pointer,
+        // 0 if the stack does not fit.
+        uint64 setupStack( const vector<string>& argv, const vector<string>& envp,
+                           uint64 stack_size = 8 << 20);
+
+        // The heap grows from the loaded image up to the anonymous mappings
+        inline uint64 programBreak() const { return heap_end; }
+        bool setProgramBreak( uint64 addr);
+        // Returns the address of the new region of zeros, 0 if there is no space.
+        // The region is put at the highest free place below the top of the mappings.
+        uint64 mapAnonymous( uint64 size, uint32 prot);
+
+        // The rest of the layout of the regions, so a checkpoint saves all of it
+        inline uint64 heapStart() const { return heap_start; }
+        inline uint64 mmapTop() const { return mmap_top; }
+        // Replaces the regions, the heap and the place of the next mapping
+        // with the saved ones. The data of the pages is not changed,
+        // their protection becomes the one of the saved regions.
+        // Returns false if the regions are not sorted, overlap
+        // or are out of the address space, nothing is changed then.
+        bool restoreRegions( const vector<MemoryRegion>& saved_regions,
+                             uint64 saved_heap_start, uint64 saved_heap_end,
+                             uint64 saved_mmap_top);
 };
 
 #endif // #ifndef FUNC_MEMORY__FUNC_MEMORY_H
@@ -1,11 +1,13 @@
 // Generci C
 #include <stdlib.h>
+#include <string.h>
 
 // Generic C++
 #include <iostream>
 
 // uArchSim modules
 #include <func_memory.h>
+#include <host_perf.h>
 
 using namespace std;
 
@@ -15,27 +17,68 @@ int main (int argc, char* argv[])
     // Only one argumnt is required, the name of an executable file 
     const int num_of_args = 1;
 
+    // "-p" prints the host counters of each phase to stderr
+    const char* program = argv[ 0];
+    HostPerf* perf = NULL;
+    if ( argc > 1 && !strcmp( argv[ 1], "-p"))
+    {
+        perf = new HostPerf;
+        --argc;
+        ++argv;
+    }
+
     if ( argc - 1 == num_of_args)
     {
         // set the name of the executable file
         const char * file_name = argv[1];        
         
-        // create the functiona memory
-        FuncMemory func_mem( file_name, 32, 10, 12);
+        ElfImage image;
+        string error;
+        {
+            HostPerfScope phase( perf, "elf_load");
+            if ( !ElfImage::tryLoad( file_name, image, error))
+            {
+                cerr << "ERROR: " << error << endl;
+                exit( EXIT_FAILURE);
+            }
+        }
+
+        // create the functiona memory, its pages are loaded lazily,
+        // so they are filled here to count the population in its own phase
+        FuncMemory* func_mem = NULL;
+        {
+            HostPerfScope phase( perf, "memory_population");
+            func_mem = new FuncMemory( image, 32, 10, 12);
+            func_mem->populate();
+        }
         
         // print content of the memory
-        cout << func_mem.dump() << endl;
+        {
+            HostPerfScope phase( perf, "dump");
+            cout << func_mem->dump() << endl;
+        }
+        delete func_mem;
+
+        if ( perf != NULL)
+        {
+            perf->report( cerr);
+            delete perf;
+        }
  
     } else if ( argc - 1 > num_of_args)
     {
         cerr << "ERROR: too many arguments!" << endl
-             << "Only one argumnt is required, the name of an executable file." << endl;
+             << "Only one argument is required, the name of an executable file." << endl
+             << "Usage: \"" << program << " [-p] <ELF binary file>\"" << endl
+             << "  -p  print the host performance counters of each phase" << endl;
         exit( EXIT_FAILURE); 
 
     } else
     {
         cerr << "ERROR: too few arguments!" << endl
-             << "One argument is required, the name of an executable file." << endl;
+             << "One argument is required, the name of an executable file." << endl
+             << "Usage: \"" << program << " [-p] <ELF binary file>\"" << endl
+             << "  -p  print the host performance counters of each phase" << endl;
         exit( EXIT_FAILURE);
     }
 
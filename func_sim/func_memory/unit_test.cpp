@@ -1,6 +1,7 @@
 // generic C
 #include <cassert>
 #include <cstdlib>
+#include <cstring>
 
 // Google Test library
 #include <gtest/gtest.h>
@@ -9,6 +10,8 @@
 #include <func_memory.h>
 
 static const char * valid_elf_file = "./mips_bin_exmpl.out";
+static const char * big_endian_elf_file = "./mips_bin_exmpl_be.out";
+static const char * bss_elf_file = "./mips_bss_exmpl.out";
 
 //
 // Check that all incorect input params of the constructor
@@ -19,7 +22,10 @@ TEST( Func_memory_init, Process_Wrong_Args_Of_Constr)
     // check memory initialization with default parameters 
     ASSERT_NO_THROW( FuncMemory func_mem( valid_elf_file));
     // check memory initialization with custom parameters 
-    ASSERT_NO_THROW( FuncMemory func_mem( valid_elf_file, 64, 15, 32));
+    ASSERT_NO_THROW( FuncMemory func_mem( valid_elf_file, 64, 22, 22));
+    // the pages of 4 GB cannot be allocated
+    ASSERT_EXIT( FuncMemory func_mem( valid_elf_file, 64, 15, 32),
+                 ::testing::ExitedWithCode( EXIT_FAILURE), "ERROR.*");
 
     // test behavior when the file name does not exist
     const char * wrong_file_name = "./1234567890/qwertyuiop";
@@ -28,6 +34,36 @@ TEST( Func_memory_init, Process_Wrong_Args_Of_Constr)
                  ::testing::ExitedWithCode( EXIT_FAILURE), "ERROR.*");
 }
 
+TEST( Func_memory_init, Create_Without_Exit)
+{
+    string error;
+
+    FuncMemory* func_mem = FuncMemory::create( valid_elf_file, error);
+    ASSERT_TRUE( func_mem != NULL);
+    ASSERT_EQ( func_mem->startPC(), 0x4000b0u);
+    delete func_mem;
+
+    // the file does not exist
+    ASSERT_TRUE( FuncMemory::create( "./1234567890/qwertyuiop", error) == NULL);
+    ASSERT_NE( error.find( "Could not open file"), string::npos);
+
+    // the pages do not fit the address
+    ASSERT_TRUE( FuncMemory::create( valid_elf_file, error, 32, 20, 20) == NULL);
+
+    // the pages or the table of the sets are too large
+    ASSERT_TRUE( FuncMemory::create( valid_elf_file, error, 64, 15, 32) == NULL);
+    ASSERT_TRUE( FuncMemory::create( valid_elf_file, error, 32, 1, 2) == NULL);
+    ASSERT_NE( error.find( "too large"), string::npos);
+    ASSERT_TRUE( FuncMemory::create( valid_elf_file, error, 64, 0, 0) == NULL);
+
+    // a 64-bit address with pages of 4 MB
+    func_mem = FuncMemory::create( valid_elf_file, error, 64, 22, 22);
+    ASSERT_TRUE( func_mem != NULL);
+    ASSERT_EQ( func_mem->pageSize(), 1u << 22);
+    ASSERT_EQ( func_mem->read( 0x4100c0), 0x03020100u);
+    delete func_mem;
+}
+
 TEST( Func_memory, StartPC_Method_Test)
 {
     FuncMemory func_mem( valid_elf_file);
@@ -65,7 +101,29 @@ TEST( Func_memory, Read_Method_Test)
     // check hadling the situation when read
     // from not initialized or written data
     ASSERT_EXIT( func_mem.read( 0x300000),
-                 ::testing::KilledBySignal( SIGABRT), ".*");
+                 ::testing::ExitedWithCode( EXIT_FAILURE), "ERROR.*");
+}
+
+TEST( Func_memory, Try_Read_Write_Test)
+{
+    FuncMemory func_mem( valid_elf_file);
+    uint64 dataSectAddr = 0x4100c0;
+    uint64 value = 0;
+
+    ASSERT_TRUE( func_mem.tryRead( dataSectAddr, 4, value));
+    ASSERT_EQ( value, 0x03020100u);
+
+    // wrong number of bytes and not initialized memory
+    ASSERT_FALSE( func_mem.tryRead( dataSectAddr, 0, value));
+    ASSERT_FALSE( func_mem.tryRead( dataSectAddr, 9, value));
+    ASSERT_FALSE( func_mem.tryRead( 0x300000, 4, value));
+
+    ASSERT_TRUE( func_mem.tryWrite( 0x42, 0x300000, 1));
+    ASSERT_TRUE( func_mem.tryRead( 0x300000, 1, value));
+    ASSERT_EQ( value, 0x42u);
+
+    ASSERT_FALSE( func_mem.tryWrite( 0x42, dataSectAddr, 0));
+    ASSERT_FALSE( func_mem.tryWrite( 0x42, 0, 1));
 }
 
 TEST( Func_memory, Write_Read_Initialized_Mem_Test)
@@ -100,6 +158,10 @@ TEST( Func_memory, Write_Read_Not_Initialized_Mem_Test)
     FuncMemory func_mem( valid_elf_file);
 
     uint64 write_addr = 0x3FFFFE;
+
+    // the write ends in the code, which is made writable first
+    ASSERT_FALSE( func_mem.tryWrite( 0x03020100, write_addr, sizeof( uint64)));
+    ASSERT_TRUE( func_mem.setProtection( 0x400000, 1, MEM_READ | MEM_WRITE | MEM_EXEC));
  
     // write 0x03020100 into the four bytes pointed by write_addr
     func_mem.write( 0x03020100, write_addr, sizeof( uint64));
@@ -113,6 +175,508 @@ TEST( Func_memory, Write_Read_Not_Initialized_Mem_Test)
     ASSERT_EQ( func_mem.read( write_addr + 2, sizeof( uint16)), right_ret);
 }
 
+TEST( Func_memory, Big_Endian_Read_Write_Test)
+{
+    FuncMemory func_mem( big_endian_elf_file);
+    ASSERT_TRUE( func_mem.isBigEndian());
+    ASSERT_FALSE( FuncMemory( valid_elf_file).isBigEndian());
+
+    // the address of the ".data" section, it starts with bytes 0, 1, 2, ...
+    uint64 data_sect_addr = 0x30160;
+
+    ASSERT_EQ( func_mem.read( data_sect_addr), 0x00010203ull);
+    ASSERT_EQ( func_mem.read( data_sect_addr + 1, 3), 0x010203ull);
+    ASSERT_EQ( func_mem.read( data_sect_addr + 2, 2), 0x0203ull);
+    ASSERT_EQ( func_mem.read( data_sect_addr, 8), 0x0001020304050607ull);
+
+    // the elements of "best_nums" array placed right after 10 bytes of "dec_digits"
+    ASSERT_EQ( func_mem.read( data_sect_addr + 10), 7ull);
+    ASSERT_EQ( func_mem.read( data_sect_addr + 14), 11ull);
+
+    func_mem.write( 0x7777, data_sect_addr + 1, sizeof( uint16));
+    ASSERT_EQ( func_mem.read( data_sect_addr), 0x00777703ull);
+}
+
+TEST( Func_memory, Page_Straddling_Read_Write_Test)
+{
+    FuncMemory le_mem( valid_elf_file);
+    FuncMemory be_mem( big_endian_elf_file);
+
+    // the value crosses the border of two pages
+    uint64 addr = 0x500000 - 3;
+    le_mem.write( 0x0102030405060708ull, addr, sizeof( uint64));
+    be_mem.write( 0x0102030405060708ull, addr, sizeof( uint64));
+
+    ASSERT_EQ( le_mem.read( addr, sizeof( uint64)), 0x0102030405060708ull);
+    ASSERT_EQ( be_mem.read( addr, sizeof( uint64)), 0x0102030405060708ull);
+
+    // the byte order of the guest defines which bytes are where
+    ASSERT_EQ( le_mem.read( addr, 1), 0x08ull);
+    ASSERT_EQ( be_mem.read( addr, 1), 0x01ull);
+    ASSERT_EQ( le_mem.read( addr + 2, 4), 0x03040506ull);
+    ASSERT_EQ( be_mem.read( addr + 2, 4), 0x03040506ull);
+}
+
+TEST( Func_memory, Block_Read_Write_Test)
+{
+    FuncMemory func_mem( valid_elf_file);
+
+    // the block straddles the border of two pages
+    uint64 addr = 0x500000 - 3;
+    uint8 data[ 8] = { 1, 2, 3, 4, 5, 6, 7, 8};
+    func_mem.writeBlock( addr, data, sizeof( data));
+    ASSERT_EQ( func_mem.read( addr + 2, 2), 0x0403ull);
+
+    uint8 result[ 8] = { 0};
+    func_mem.readBlock( addr, result, sizeof( result));
+    ASSERT_EQ( memcmp( data, result, sizeof( data)), 0);
+
+    // .text, .data and the two new pages
+    vector<uint64> pages;
+    func_mem.getAllocatedPages( pages);
+    ASSERT_EQ( pages.size(), 4u);
+    ASSERT_EQ( pages[ 2], 0x500000 - func_mem.pageSize());
+    ASSERT_EQ( pages[ 3], 0x500000u);
+
+    // the checked copies fail on uninitialized bytes and wrong ranges
+    ASSERT_TRUE( func_mem.tryReadBlock( addr, result, sizeof( result)));
+    ASSERT_FALSE( func_mem.tryReadBlock( 0x500000, result, func_mem.pageSize() + 1));
+    ASSERT_FALSE( func_mem.tryWriteBlock( 0, data, sizeof( data)));
+    ASSERT_FALSE( func_mem.tryWriteBlock( 0xfffffffc, data, sizeof( data)));
+    ASSERT_TRUE( func_mem.tryWriteBlock( 0x600000, data, sizeof( data)));
+}
+
+TEST( Func_memory, Load_Segments_Test)
+{
+    ElfImage image;
+    string error;
+    ASSERT_TRUE( ElfImage::tryLoad( bss_elf_file, image, error));
+    FuncMemory func_mem( image);
+    ASSERT_EQ( func_mem.startPC(), 0x20150u /*the entry point*/);
+
+    // "counter" is followed by 1 MB of ".bss"
+    uint64 counter_addr = 0x30170;
+    uint64 bss_addr = 0x30190;
+    uint64 bss_size = 0x100000;
+    ASSERT_EQ( func_mem.read( counter_addr), 42u);
+    ASSERT_EQ( func_mem.read( bss_addr), 0u);
+    ASSERT_EQ( func_mem.read( bss_addr + bss_size / 2), 0u);
+    ASSERT_EQ( func_mem.read( bss_addr + bss_size - 4), 0u);
+
+    // the pages of the whole ".bss" are mapped, but only the pages
+    // shared with the other data and the read ones have own memory
+    vector<uint64> pages;
+    func_mem.getAllocatedPages( pages);
+    ASSERT_EQ( pages.size(), 2 + ( bss_addr + bss_size - 0x30000) / func_mem.pageSize() + 1);
+    ASSERT_EQ( func_mem.privatePages(), 2u);
+
+    // the 1st write to a zero page gives it own memory
+    func_mem.write( 0x12345678, bss_addr + bss_size / 2);
+    ASSERT_EQ( func_mem.privatePages(), 3u);
+    ASSERT_EQ( func_mem.read( bss_addr + bss_size / 2), 0x12345678u);
+    ASSERT_EQ( func_mem.read( bss_addr + bss_size / 2 + func_mem.pageSize()), 0u);
+
+    // ".bss" has no data in the file, but its section is read as zeros
+    vector<ElfSection> sections;
+    ASSERT_TRUE( ElfSection::tryGetAllElfSections( bss_elf_file, sections, error));
+    ASSERT_EQ( FuncMemory( sections).read( bss_addr + bss_size - 4), 0u);
+}
+
+TEST( Func_memory, Lazy_Load_Test)
+{
+    FuncMemory func_mem( bss_elf_file);
+
+    // nothing is copied from the file before the 1st access
+    ASSERT_EQ( func_mem.privatePages(), 0u);
+
+    // the code is filled on the 1st read, the data on the 1st write
+    ASSERT_EQ( func_mem.read( func_mem.startPC()), 0x3c080003u /*lui $t0, 0x3*/);
+    ASSERT_EQ( func_mem.privatePages(), 1u);
+    func_mem.write( 1, 0x30170 + 1, 1);
+    ASSERT_EQ( func_mem.read( 0x30170), 42u + 256);
+    ASSERT_EQ( func_mem.privatePages(), 2u);
+
+    // the last page of ".bss" shares no data with the file
+    ASSERT_EQ( func_mem.read( 0x130190 - 4), 0u);
+    ASSERT_EQ( func_mem.privatePages(), 3u);
+
+    // the block copy fills the pages as well
+    uint8 headers[ 4] = { 0};
+    func_mem.readBlock( 0x10000, headers, sizeof( headers));
+    ASSERT_EQ( memcmp( headers, "\x7f" "ELF", sizeof( headers)), 0);
+    ASSERT_EQ( func_mem.privatePages(), 4u);
+
+    // or all of them are filled at once
+    FuncMemory populated( bss_elf_file);
+    populated.populate();
+    uint64 filled = populated.privatePages();
+    ASSERT_GE( filled, 4u);
+    ASSERT_EQ( populated.read( 0x30170), 42u);
+    ASSERT_EQ( populated.privatePages(), filled);
+}
+
+TEST( Func_memory, Dirty_Pages_Test)
+{
+    FuncMemory func_mem( valid_elf_file);
+    vector<uint64> pages;
+
+    // the loading does not make the pages dirty, the reads do not either
+    func_mem.getDirtyPages( pages);
+    ASSERT_TRUE( pages.empty());
+    func_mem.read( 0x4100c0);
+    func_mem.getDirtyPages( pages);
+    ASSERT_TRUE( pages.empty());
+
+    func_mem.write( 1, 0x4100c0);
+    func_mem.write( 2, 0x4100c4);
+    func_mem.write( 0x0102030405060708ull, 0x500000 - 3, sizeof( uint64));
+    uint8 data[ 3] = { 1, 2, 3};
+    func_mem.writeBlock( 0x300000, data, sizeof( data));
+
+    // each page is reported once, in ascending order
+    func_mem.getDirtyPages( pages);
+    ASSERT_EQ( pages.size(), 4u);
+    ASSERT_EQ( pages[ 0], 0x300000u);
+    ASSERT_EQ( pages[ 1], 0x410000u);
+    ASSERT_EQ( pages[ 2], 0x500000 - func_mem.pageSize());
+    ASSERT_EQ( pages[ 3], 0x500000u);
+
+    func_mem.clearDirtyPages();
+    pages.clear();
+    func_mem.getDirtyPages( pages);
+    ASSERT_TRUE( pages.empty());
+
+    // the cleared page becomes dirty again on the next write
+    func_mem.write( 3, 0x4100c0);
+    func_mem.getDirtyPages( pages);
+    ASSERT_EQ( pages.size(), 1u);
+    ASSERT_EQ( pages[ 0], 0x410000u);
+}
+
+TEST( Func_memory, Reset_Test)
+{
+    FuncMemory func_mem( bss_elf_file);
+
+    // a lazily loaded page, a zero page of ".bss" and two new pages
+    func_mem.write( 7, 0x30170);
+    func_mem.write( 8, 0x30190 + 0x80000);
+    func_mem.write( 9, 0x300000 - 2);
+    ASSERT_EQ( func_mem.privatePages(), 4u);
+
+    // the pages get back to the shared and not loaded states
+    func_mem.reset();
+    ASSERT_EQ( func_mem.privatePages(), 0u);
+    ASSERT_EQ( func_mem.dump(), FuncMemory( bss_elf_file).dump());
+    ASSERT_EQ( func_mem.read( 0x30170), 42u);
+    ASSERT_EQ( func_mem.read( 0x30190 + 0x80000), 0u);
+    uint64 value = 0;
+    ASSERT_FALSE( func_mem.tryRead( 0x300000, 1, value));
+
+    // a page read before the write is restored from its copy,
+    // the code made writable gets back its protection as well
+    ASSERT_EQ( func_mem.read( func_mem.startPC()), 0x3c080003u);
+    ASSERT_TRUE( func_mem.setProtection( func_mem.startPC(), 4, MEM_READ | MEM_WRITE | MEM_EXEC));
+    func_mem.write( 0, func_mem.startPC());
+    func_mem.reset();
+    ASSERT_EQ( func_mem.read( func_mem.startPC()), 0x3c080003u);
+    ASSERT_EQ( func_mem.pageProt( func_mem.startPC()), ( uint32)( MEM_READ | MEM_EXEC));
+
+    // the changes made before the reset point stay
+    func_mem.write( 1, 0x30170);
+    func_mem.setResetPoint();
+    func_mem.write( 2, 0x30170);
+    func_mem.reset();
+    ASSERT_EQ( func_mem.read( 0x30170), 1u);
+
+    // the reverted pages are reported as dirty
+    vector<uint64> pages;
+    func_mem.getDirtyPages( pages);
+    ASSERT_EQ( pages.size(), 5u);
+}
+
+// Records all the watchpoint hits
+class HitRecorder : public MemoryWatcher
+{
+    public:
+        vector<Watchpoint> watchpoints;
+        vector<uint64> addrs;
+        vector<uint64> values;
+        vector<bool> writes;
+
+        void watchHit( const Watchpoint& watchpoint, uint64 addr, uint64 /* size */,
+                       bool is_write, uint64 value)
+        {
+            watchpoints.push_back( watchpoint);
+            addrs.push_back( addr);
+            values.push_back( value);
+            writes.push_back( is_write);
+        }
+};
+
+TEST( Func_memory, Watchpoints_Test)
+{
+    FuncMemory func_mem( valid_elf_file);
+    HitRecorder recorder;
+
+    // "best_nums" array
+    uint32 id = func_mem.addWatchpoint( 0x4100cc, 12, WATCH_WRITE, &recorder);
+    func_mem.addWatchpoint( 0x4100d8, 4, WATCH_READ, &recorder);
+
+    // the same page, but out of the ranges
+    func_mem.write( 1, 0x4100c0);
+    func_mem.read( 0x4100c8);
+    ASSERT_TRUE( recorder.addrs.empty());
+
+    // the write overlaps the range by one byte
+    func_mem.write( 0x11223344, 0x4100c9);
+    ASSERT_EQ( recorder.addrs.size(), 1u);
+    ASSERT_EQ( recorder.watchpoints[ 0].id, id);
+    ASSERT_EQ( recorder.addrs[ 0], 0x4100c9u);
+    ASSERT_EQ( recorder.values[ 0], 0x11223344u);
+    ASSERT_TRUE( recorder.writes[ 0]);
+
+    // the reads of the write-only range are not reported
+    func_mem.read( 0x4100cc);
+    ASSERT_EQ( recorder.addrs.size(), 1u);
+    ASSERT_EQ( func_mem.read( 0x4100d8), 0u);
+    ASSERT_EQ( recorder.addrs.size(), 2u);
+    ASSERT_FALSE( recorder.writes[ 1]);
+
+    // the block accesses of the host are not reported
+    uint8 data[ 64];
+    for ( size_t i = 0; i < sizeof( data); ++i)
+        data[ i] = i;
+    func_mem.writeBlock( 0x4100c0, data, sizeof( data));
+    func_mem.readBlock( 0x4100c0, data, sizeof( data));
+    ASSERT_EQ( recorder.addrs.size(), 2u);
+
+    // the ones of the guest are reported once with the watched part
+    ASSERT_TRUE( func_mem.tryWriteBlock( 0x4100c0, data, sizeof( data)));
+    ASSERT_TRUE( func_mem.tryReadBlock( 0x4100c0, data, sizeof( data)));
+    ASSERT_EQ( recorder.addrs.size(), 4u);
+    ASSERT_EQ( recorder.addrs[ 2], 0x4100ccu);
+    ASSERT_TRUE( recorder.writes[ 2]);
+    ASSERT_EQ( recorder.values[ 2], 0u); // 12 bytes do not fit the value
+    ASSERT_EQ( recorder.addrs[ 3], 0x4100d8u);
+    ASSERT_FALSE( recorder.writes[ 3]);
+    ASSERT_EQ( recorder.values[ 3], 0x1b1a1918u);
+
+    func_mem.removeWatchpoint( id);
+    func_mem.write( 0, 0x4100cc);
+    ASSERT_EQ( recorder.addrs.size(), 4u);
+    func_mem.read( 0x4100d8);
+    ASSERT_EQ( recorder.addrs.size(), 5u);
+}
+
+TEST( Func_memory, Diff_Test)
+{
+    FuncMemory func_mem( bss_elf_file);
+    FuncMemory other_mem( bss_elf_file);
+    vector<MemoryRange> ranges;
+
+    // the pages from the same file and the zero pages are not even loaded
+    func_mem.diff( other_mem, ranges);
+    ASSERT_TRUE( ranges.empty());
+    ASSERT_EQ( func_mem.privatePages(), 0u);
+
+    // adjacent bytes make one range, one crossing the pages as well
+    func_mem.write( 0x01020304, 0x30170);
+    func_mem.write( 0x0102, 0x30190 + 0x1000 - 1, 2);
+    other_mem.write( 0x01020304, 0x30170);
+    other_mem.write( 0x77, 0x30170 + 1, 1);
+    func_mem.write( 0, 0x400000, 1);
+
+    func_mem.diff( other_mem, ranges);
+    ASSERT_EQ( ranges.size(), 3u);
+    ASSERT_EQ( ranges[ 0].start_addr, 0x30171u);
+    ASSERT_EQ( ranges[ 0].size, 1u);
+    ASSERT_EQ( ranges[ 1].start_addr, 0x30190u + 0x1000 - 1);
+    ASSERT_EQ( ranges[ 1].size, 2u);
+    ASSERT_EQ( ranges[ 2].start_addr, 0x400000u);
+    ASSERT_EQ( ranges[ 2].size, func_mem.pageSize());
+
+    // the scalar tail and the vector part find the same bytes
+    uint8 a[ 37] = { 0}, b[ 37] = { 0};
+    b[ 0] = b[ 15] = b[ 16] = b[ 36] = 1;
+    ranges.clear();
+    FuncMemory::diffBytes( a, b, sizeof( a), 0x1000, ranges);
+    ASSERT_EQ( ranges.size(), 3u);
+    ASSERT_EQ( ranges[ 1].start_addr, 0x100fu);
+    ASSERT_EQ( ranges[ 1].size, 2u);
+    ASSERT_EQ( ranges[ 2].start_addr, 0x1024u);
+}
+
+TEST( Func_memory, Regions_Test)
+{
+    FuncMemory func_mem( bss_elf_file);
+    uint64 page_size = func_mem.pageSize();
+
+    // the headers, the code, the data with ".bss" and the heap after them
+    const vector<MemoryRegion>& regions = func_mem.getRegions();
+    ASSERT_EQ( regions.size(), 3u);
+    ASSERT_EQ( regions[ 0].name, "data");
+    ASSERT_EQ( regions[ 0].prot, ( uint32)MEM_READ);
+    ASSERT_EQ( regions[ 1].name, "code");
+    ASSERT_EQ( regions[ 1].prot, ( uint32)( MEM_READ | MEM_EXEC));
+    ASSERT_EQ( regions[ 2].name, "data");
+    ASSERT_EQ( regions[ 2].prot, ( uint32)( MEM_READ | MEM_WRITE));
+    uint64 image_end = regions[ 2].start_addr + regions[ 2].size;
+    ASSERT_EQ( image_end, 0x30190u + 0x100000);
+    uint64 brk = func_mem.programBreak();
+    ASSERT_EQ( brk, ( image_end + page_size - 1) & ~( page_size - 1));
+
+    vector<string> argv, envp;
+    argv.push_back( "prog");
+    argv.push_back( "-v");
+    envp.push_back( "HOME=/");
+    uint64 sp = func_mem.setupStack( argv, envp);
+    ASSERT_NE( sp, 0u);
+    ASSERT_EQ( sp % 8, 0u);
+    ASSERT_TRUE( func_mem.regionChecks());
+    ASSERT_EQ( func_mem.getRegions().back().name, "stack");
+
+    // argc, argv, envp and the auxiliary vector
+    ASSERT_EQ( func_mem.read( sp), 2u);
+    char str[ 8];
+    func_mem.readBlock( func_mem.read( sp + 4), reinterpret_cast<uint8*>( str), 5);
+    ASSERT_STREQ( str, "prog");
+    func_mem.readBlock( func_mem.read( sp + 8), reinterpret_cast<uint8*>( str), 3);
+    ASSERT_STREQ( str, "-v");
+    ASSERT_EQ( func_mem.read( sp + 12), 0u);
+    func_mem.readBlock( func_mem.read( sp + 16), reinterpret_cast<uint8*>( str), 7);
+    ASSERT_STREQ( str, "HOME=/");
+    ASSERT_EQ( func_mem.read( sp + 20), 0u);
+    ASSERT_EQ( func_mem.read( sp + 24), 6u /*AT_PAGESZ*/);
+    ASSERT_EQ( func_mem.read( sp + 28), page_size);
+    ASSERT_EQ( func_mem.read( sp + 32), 0u /*AT_NULL*/);
+
+    // the stack is zeroed, the memory out of the regions is not accessible
+    ASSERT_EQ( func_mem.read( sp - 4), 0u);
+    uint64 value = 0;
+    ASSERT_FALSE( func_mem.tryRead( brk, 4, value));
+    ASSERT_FALSE( func_mem.tryWrite( 1, brk, 4));
+    ASSERT_EXIT( func_mem.write( 1, brk),
+                 ::testing::ExitedWithCode( EXIT_FAILURE), "ERROR.*");
+    ASSERT_EXIT( func_mem.read( brk),
+                 ::testing::ExitedWithCode( EXIT_FAILURE), "ERROR.*");
+    uint64 private_pages = func_mem.privatePages();
+
+    // the heap grows and shrinks by pages
+    ASSERT_FALSE( func_mem.setProgramBreak( brk - 1));
+    ASSERT_TRUE( func_mem.setProgramBreak( brk + 2 * page_size + 1));
+    ASSERT_EQ( func_mem.programBreak(), brk + 2 * page_size + 1);
+    ASSERT_EQ( func_mem.read( brk + 2 * page_size), 0u);
+    func_mem.write( 5, brk + 2 * page_size);
+    ASSERT_EQ( func_mem.read( brk + 2 * page_size), 5u);
+    ASSERT_TRUE( func_mem.setProgramBreak( brk + page_size));
+    ASSERT_FALSE( func_mem.tryRead( brk + 2 * page_size, 4, value));
+    ASSERT_TRUE( func_mem.tryWrite( 6, brk, 4));
+
+    // the written page comes back as a shared zero page, a write gets a private one
+    ASSERT_TRUE( func_mem.setProgramBreak( brk + 3 * page_size));
+    ASSERT_EQ( func_mem.read( brk + 2 * page_size), 0u);
+    func_mem.write( 8, brk + 2 * page_size);
+    ASSERT_EQ( func_mem.read( brk + 2 * page_size), 8u);
+    ASSERT_EQ( func_mem.read( ( sp & ~( page_size - 1)) - 16 * page_size), 0u);
+    ASSERT_TRUE( func_mem.setProgramBreak( brk + page_size));
+
+    // the mappings are taken from the top down below the stack
+    uint64 map = func_mem.mapAnonymous( page_size + 1, MEM_READ | MEM_WRITE);
+    ASSERT_NE( map, 0u);
+    ASSERT_EQ( map % page_size, 0u);
+    ASSERT_LT( map, sp);
+    uint64 other_map = func_mem.mapAnonymous( page_size, MEM_READ);
+    ASSERT_EQ( other_map, map - page_size);
+    ASSERT_TRUE( func_mem.tryWrite( 7, map + page_size, 4));
+    func_mem.removeRegions( map, page_size);
+    ASSERT_FALSE( func_mem.tryRead( map, 4, value));
+    ASSERT_TRUE( func_mem.tryRead( map + page_size, 4, value));
+    ASSERT_EQ( value, 7u);
+
+    // the reset brings back the regions of the reset point
+    func_mem.reset();
+    ASSERT_EQ( func_mem.programBreak(), brk);
+    ASSERT_EQ( func_mem.getRegions().size(), 4u);
+    ASSERT_FALSE( func_mem.tryRead( brk, 4, value));
+    ASSERT_FALSE( func_mem.tryRead( map + page_size, 4, value));
+    ASSERT_EQ( func_mem.privatePages(), private_pages);
+    ASSERT_EQ( func_mem.mapAnonymous( page_size + 1, MEM_READ), map);
+}
+
+TEST( Func_memory, Protection_Test)
+{
+    FuncMemory func_mem( bss_elf_file);
+    uint64 pc = func_mem.startPC();
+    uint64 data_addr = 0x30170;
+    uint64 value = 0;
+    uint32 word = 0;
+
+    // the permissions come from the flags of the segments
+    ASSERT_EQ( func_mem.pageProt( 0x10000), ( uint32)MEM_READ);
+    ASSERT_EQ( func_mem.pageProt( pc), ( uint32)( MEM_READ | MEM_EXEC));
+    ASSERT_EQ( func_mem.pageProt( data_addr), ( uint32)( MEM_READ | MEM_WRITE));
+
+    // the code is fetched and read, but not written
+    ASSERT_TRUE( func_mem.tryFetch( pc, word));
+    ASSERT_EQ( word, 0x3c080003u);
+    ASSERT_EQ( func_mem.fetch( pc), 0x3c080003u);
+    ASSERT_FALSE( func_mem.tryFetch( pc + 2, word));
+    ASSERT_TRUE( func_mem.tryRead( pc, 4, value));
+    ASSERT_FALSE( func_mem.tryWrite( 0, pc, 4));
+    ASSERT_FALSE( func_mem.tryWrite( 0, 0x10000, 4));
+    uint8 data[ 8] = { 0};
+    ASSERT_FALSE( func_mem.tryWriteBlock( pc, data, sizeof( data)));
+    ASSERT_EXIT( func_mem.write( 0, pc),
+                 ::testing::ExitedWithCode( EXIT_FAILURE), "ERROR.*protection");
+
+    // the data is not executable
+    ASSERT_FALSE( func_mem.tryFetch( data_addr, word));
+    ASSERT_EXIT( func_mem.fetch( data_addr),
+                 ::testing::ExitedWithCode( EXIT_FAILURE), "ERROR.*protection");
+
+    // the host accesses ignore the protection
+    func_mem.writeBlock( pc, data, 4);
+    ASSERT_EQ( func_mem.read( pc), 0u);
+
+    // a page out of the regions is accessed as before
+    ASSERT_TRUE( func_mem.tryWrite( 0x1000000c, 0x300000, 4));
+    ASSERT_EQ( func_mem.pageProt( 0x300000), ( uint32)( MEM_READ | MEM_WRITE | MEM_EXEC));
+    ASSERT_EQ( func_mem.fetch( 0x300000), 0x1000000cu);
+    ASSERT_FALSE( func_mem.setProtection( 0x300000, 4, MEM_READ));
+
+    // the protection of a mapping is changed by whole pages
+    uint64 map = func_mem.mapAnonymous( 2 * func_mem.pageSize(), 0);
+    ASSERT_NE( map, 0u);
+    ASSERT_FALSE( func_mem.tryRead( map, 4, value));
+    ASSERT_FALSE( func_mem.tryReadBlock( map, data, sizeof( data)));
+    ASSERT_TRUE( func_mem.setProtection( map + 1, 1, MEM_READ));
+    ASSERT_TRUE( func_mem.tryRead( map, 4, value));
+    ASSERT_FALSE( func_mem.tryWrite( 1, map, 4));
+    ASSERT_FALSE( func_mem.tryRead( map + func_mem.pageSize(), 4, value));
+    ASSERT_EQ( func_mem.getRegions().back().prot, 0u);
+
+    // the accesses of the instructions tell what is wrong
+    ASSERT_EQ( func_mem.readAccess( map + func_mem.pageSize(), 4, value), FAULT_PROTECTION);
+    word = 1;
+    ASSERT_EQ( func_mem.fetchAccess( map, word), FAULT_PROTECTION);
+    ASSERT_EQ( word, 1u);
+    ASSERT_EQ( func_mem.writeAccess( 1, pc, 4), FAULT_PROTECTION);
+    func_mem.setRegionChecks( true);
+    ASSERT_EQ( func_mem.readAccess( 0x7000000, 4, value), FAULT_UNMAPPED);
+    ASSERT_EQ( func_mem.writeAccess( 1, 0x7000000, 4), FAULT_UNMAPPED);
+
+    // a write crossing into a page it may not write changes nothing
+    ASSERT_TRUE( func_mem.setProtection( map, func_mem.pageSize(), MEM_READ | MEM_WRITE));
+    func_mem.clearDirtyPages();
+    ASSERT_EQ( func_mem.writeAccess( ~0ull, map + func_mem.pageSize() - 4, 8), FAULT_PROTECTION);
+    ASSERT_EQ( func_mem.read( map + func_mem.pageSize() - 4), 0u);
+    vector<uint64> dirty;
+    func_mem.getDirtyPages( dirty);
+    ASSERT_TRUE( dirty.empty());
+    ASSERT_EQ( func_mem.writeAccess( ~0ull, map + func_mem.pageSize() - 4, 4), FAULT_NONE);
+    ASSERT_EQ( func_mem.read( map + func_mem.pageSize() - 4), 0xffffffffu);
+}
+
 int main( int argc, char* argv[])
 {
     ::testing::InitGoogleTest( &argc, argv);
@@ -0,0 +1,225 @@
+/**
+ * host_perf.cpp - Implementation of the module reading the hardware
+ * performance counters of the host through Linux perf_event_open.
+ * Copyright 2015 MIPT-MIPS iLab project
+ */
+
+// Generic C
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <time.h>
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+// Generic C++
+#include <sstream>
+#include <iomanip>
+
+// uArchSim modules
+#include <host_perf.h>
+
+static double monotonicSeconds()
+{
+    struct timespec now;
+    clock_gettime( CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+#ifdef __linux__
+static const uint64 counter_configs[ HOST_COUNTER_NUM] = {
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES,
+    PERF_COUNT_HW_BRANCH_MISSES
+};
+
+static int openCounter( uint64 config, int group_fd)
+{
+    struct perf_event_attr attr;
+    memset( &attr, 0, sizeof( attr));
+    attr.size = sizeof( attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP
+                       | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    // the calling thread on any CPU; the group is scheduled on the counters
+    // of the host at once, so the values are of the same time
+    return syscall( __NR_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+#endif
+
+HostPerf::HostPerf()
+    : leader( -1), group_size( 0), current( 0), running( false),
+      start_enabled( 0), start_running( 0), start_time( 0)
+{
+    for ( size_t i = 0; i < HOST_COUNTER_NUM; ++i)
+    {
+        group_index[ i] = 0;
+#ifdef __linux__
+        fds[ i] = openCounter( counter_configs[ i], leader);
+        if ( fds[ i] == -1 && error.empty())
+            error = string( "perf_event_open: ") + strerror( errno);
+        if ( fds[ i] == -1)
+            continue;
+
+        if ( leader == -1)
+            leader = fds[ i];
+        group_index[ i] = group_size++;
+#else
+        fds[ i] = -1;
+        error = "host counters are supported only on Linux";
+#endif
+    }
+}
+
+HostPerf::~HostPerf()
+{
+    for ( size_t i = 0; i < HOST_COUNTER_NUM; ++i)
+        if ( fds[ i] != -1)
+            close( fds[ i]);
+}
+
+bool HostPerf::readCounters( uint64 values[ HOST_COUNTER_NUM],
+                             uint64& enabled_time, uint64& running_time) const
+{
+    memset( values, 0, sizeof( uint64) * HOST_COUNTER_NUM);
+    enabled_time = 0;
+    running_time = 0;
+    if ( leader == -1)
+        return false;
+
+    // the number of the values, the times and the values in the order of opening
+    uint64 data[ 3 + HOST_COUNTER_NUM];
+    ssize_t size = ( 3 + group_size) * sizeof( data[ 0]);
+    if ( read( leader, data, size) != size || data[ 0] != group_size)
+        return false;
+
+    enabled_time = data[ 1];
+    running_time = data[ 2];
+    for ( size_t i = 0; i < HOST_COUNTER_NUM; ++i)
+        if ( fds[ i] != -1)
+            values[ i] = data[ 3 + group_index[ i]];
+    return true;
+}
+
+uint64 HostPerf::scaleCount( uint64 count, uint64 enabled, uint64 running)
+{
+    if ( running == 0)
+        return 0;
+    if ( running >= enabled)
+        return count;
+    return ( uint64)( ( double)count * enabled / running);
+}
+
+void HostPerf::begin( const string& name)
+{
+    if ( running)
+        end();
+
+    for ( current = 0; current < phases.size(); ++current)
+        if ( phases[ current].name == name)
+            break;
+
+    if ( current == phases.size())
+    {
+        HostPhase phase;
+        phase.name = name;
+        phase.runs = 0;
+        phase.seconds = 0;
+        memset( phase.values, 0, sizeof( phase.values));
+        phase.scaled = false;
+        phases.push_back( phase);
+    }
+
+    running = true;
+    start_time = monotonicSeconds();
+    readCounters( start_values, start_enabled, start_running);
+}
+
+void HostPerf::end()
+{
+    if ( !running)
+        return;
+
+    // the counters are read first, so the bookkeeping is not counted
+    uint64 values[ HOST_COUNTER_NUM];
+    uint64 enabled = 0;
+    uint64 counting = 0;
+    readCounters( values, enabled, counting);
+    double end_time = monotonicSeconds();
+
+    // the group counted only a part of the phase if the host multiplexed it
+    HostPhase& phase = phases[ current];
+    enabled -= start_enabled;
+    counting -= start_running;
+    if ( counting < enabled)
+        phase.scaled = true;
+    for ( size_t i = 0; i < HOST_COUNTER_NUM; ++i)
+        phase.values[ i] += scaleCount( values[ i] - start_values[ i], enabled, counting);
+    phase.seconds += end_time - start_time;
+    ++phase.runs;
+    running = false;
+}
+
+const char* HostPerf::counterName( HostCounter counter)
+{
+    static const char* names[ HOST_COUNTER_NUM] = {
+        "cycles", "instructions", "cache_misses", "branch_misses"
+    };
+    return names[ counter];
+}
+
+void HostPerf::report( ostream& out) const
+{
+    const int width = 16;
+    out << left << setw( 20) << "phase" << right << setw( 6) << "runs"
+        << setw( width) << "seconds";
+    for ( size_t i = 0; i < HOST_COUNTER_NUM; ++i)
+        out << setw( width) << counterName( ( HostCounter)i);
+    out << setw( 8) << "IPC" << endl;
+
+    for ( size_t p = 0; p < phases.size(); ++p)
+    {
+        const HostPhase& phase = phases[ p];
+        ostringstream seconds;
+        seconds << fixed << setprecision( 6) << phase.seconds;
+        out << left << setw( 20) << phase.name << right << setw( 6) << phase.runs
+            << setw( width) << seconds.str();
+        for ( size_t i = 0; i < HOST_COUNTER_NUM; ++i)
+        {
+            if ( isAvailable( ( HostCounter)i))
+                out << setw( width) << phase.values[ i];
+            else
+                out << setw( width) << "n/a";
+        }
+
+        ostringstream ipc;
+        if ( isAvailable( HOST_CYCLES) && isAvailable( HOST_INSTRUCTIONS)
+             && phase.values[ HOST_CYCLES] != 0)
+        {
+            ipc << fixed << setprecision( 2)
+                << ( double)phase.values[ HOST_INSTRUCTIONS] / phase.values[ HOST_CYCLES];
+        } else
+        {
+            ipc << "n/a";
+        }
+        out << setw( 8) << ipc.str() << ( phase.scaled ? " *" : "") << endl;
+    }
+
+    for ( size_t p = 0; p < phases.size(); ++p)
+        if ( phases[ p].scaled)
+        {
+            out << "* the host multiplexed the counters, the values are scaled estimates" << endl;
+            break;
+        }
+
+    if ( !error.empty())
+        out << "Some host counters are unavailable: " << error << endl;
+}
@@ -0,0 +1,117 @@
+/**
+ * host_perf.h - Header of the module reading the hardware performance
+ * counters of the host (cycles, instructions, cache and branch misses)
+ * for the phases of the simulator, so it is seen where the host time goes.
+ * Copyright 2015 MIPT-MIPS iLab project
+ */
+
+// protection from multi-include
+#ifndef HOST_PERF__HOST_PERF_H
+#define HOST_PERF__HOST_PERF_H
+
+// Generic C++
+#include <string>
+#include <vector>
+#include <ostream>
+
+// uArchSim modules
+#include <types.h>
+
+using namespace std;
+
+enum HostCounter
+{
+    HOST_CYCLES,
+    HOST_INSTRUCTIONS,
+    HOST_CACHE_MISSES,
+    HOST_BRANCH_MISSES,
+    HOST_COUNTER_NUM
+};
+
+// The counters of all the runs of a phase with the same name
+struct HostPhase
+{
+    string name;
+    uint64 runs;
+    double seconds;
+    uint64 values[ HOST_COUNTER_NUM];
+    // the host shared the counters with other events in some of the runs,
+    // so the values are scaled to the whole time of the runs
+    bool scaled;
+};
+
+class HostPerf
+{
+        // a counter which could not be opened has the descriptor -1;
+        // the others are one group read at once, the 1st of them leads it,
+        // so all of them count the same instructions
+        int fds[ HOST_COUNTER_NUM];
+        int leader;
+        size_t group_index[ HOST_COUNTER_NUM]; // the place of the value in a read of the group
+        size_t group_size;
+        string error;
+
+        vector<HostPhase> phases;
+        size_t current; // the index of the running phase
+        bool running;
+        uint64 start_values[ HOST_COUNTER_NUM];
+        uint64 start_enabled;
+        uint64 start_running;
+        double start_time;
+
+        // The times the group was enabled and actually counting on the host
+        bool readCounters( uint64 values[ HOST_COUNTER_NUM] /*used as output*/,
+                           uint64& enabled_time /*used as output*/,
+                           uint64& running_time /*used as output*/) const;
+
+        // no copies, the descriptors are owned
+        HostPerf( const HostPerf&);
+        HostPerf& operator=( const HostPerf&);
+
+    public:
+        // Opens the counters of the calling thread, user mode only.
+        // The counters which the host does not provide (a virtual machine,
+        // a restrictive perf_event_paranoid) are reported as unavailable,
+        // the time of the phases is measured anyway.
+        HostPerf();
+        virtual ~HostPerf();
+
+        bool isAvailable( HostCounter counter) const { return fds[ counter] != -1; }
+        // Why some counters are unavailable, empty if all are available
+        const string& getError() const { return error; }
+
+        // Phases do not nest, begin() of a new one ends the running one
+        void begin( const string& name);
+        void end();
+
+        const vector<HostPhase>& getPhases() const { return phases; }
+
+        // A table with a row per phase, "n/a" for the unavailable counters
+        void report( ostream& out) const;
+
+        static const char* counterName( HostCounter counter);
+
+        // The estimate of the count of the whole time the counter was enabled
+        // from the count of the time it was running. 0 if it was not running at all.
+        static uint64 scaleCount( uint64 count, uint64 enabled, uint64 running);
+};
+
+// Runs a phase for the lifetime of the object, nothing is done without counters
+class HostPerfScope
+{
+        HostPerf* const perf;
+
+    public:
+        HostPerfScope( HostPerf* perf, const string& name) : perf( perf)
+        {
+            if ( perf != NULL)
+                perf->begin( name);
+        }
+        ~HostPerfScope()
+        {
+            if ( perf != NULL)
+                perf->end();
+        }
+};
+
+#endif // #ifndef HOST_PERF__HOST_PERF_H
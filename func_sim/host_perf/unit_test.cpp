@@ -0,0 +1,101 @@
+// generic C
+#include <cassert>
+#include <cstdlib>
+
+// Generic C++
+#include <sstream>
+
+// Google Test library
+#include <gtest/gtest.h>
+
+// uArchSim modules
+#include <host_perf.h>
+
+static volatile uint64 sink;
+
+static void busyLoop( uint64 num)
+{
+    for ( uint64 i = 0; i < num; ++i)
+        sink = sink + i;
+}
+
+TEST( Host_perf, Phases)
+{
+    HostPerf perf;
+
+    perf.begin( "load");
+    busyLoop( 1000);
+    perf.begin( "run"); // ends "load"
+    busyLoop( 100000);
+    perf.end();
+    {
+        HostPerfScope scope( &perf, "load");
+        busyLoop( 1000);
+    }
+    perf.end(); // nothing is running
+
+    const vector<HostPhase>& phases = perf.getPhases();
+    ASSERT_EQ( phases.size(), 2u);
+    ASSERT_EQ( phases[ 0].name, "load");
+    ASSERT_EQ( phases[ 0].runs, 2u);
+    ASSERT_EQ( phases[ 1].name, "run");
+    ASSERT_EQ( phases[ 1].runs, 1u);
+    ASSERT_GT( phases[ 1].seconds, 0);
+
+    // the counters are not provided by every host
+    if ( perf.isAvailable( HOST_INSTRUCTIONS))
+    {
+        ASSERT_GT( phases[ 1].values[ HOST_INSTRUCTIONS], 100000u);
+        ASSERT_GT( phases[ 1].values[ HOST_INSTRUCTIONS],
+                   phases[ 0].values[ HOST_INSTRUCTIONS]);
+    } else
+    {
+        ASSERT_EQ( phases[ 1].values[ HOST_INSTRUCTIONS], 0u);
+        ASSERT_FALSE( perf.getError().empty());
+    }
+}
+
+TEST( Host_perf, Scaling)
+{
+    // the counters ran the whole time, a half of it and not at all
+    ASSERT_EQ( HostPerf::scaleCount( 1000, 50, 50), 1000u);
+    ASSERT_EQ( HostPerf::scaleCount( 1000, 100, 50), 2000u);
+    ASSERT_EQ( HostPerf::scaleCount( 1000, 100, 0), 0u);
+    ASSERT_EQ( HostPerf::scaleCount( 0, 0, 0), 0u);
+
+    HostPerf perf;
+    {
+        HostPerfScope scope( &perf, "run");
+        busyLoop( 1000);
+    }
+    ostringstream report;
+    perf.report( report);
+    ASSERT_EQ( perf.getPhases()[ 0].scaled, report.str().find( "scaled") != string::npos);
+}
+
+TEST( Host_perf, Report)
+{
+    HostPerf perf;
+    {
+        HostPerfScope scope( &perf, "elf_load");
+        busyLoop( 1000);
+    }
+    // without the counters the scope does nothing
+    HostPerfScope scope( NULL, "dump");
+
+    ostringstream report;
+    perf.report( report);
+    ASSERT_NE( report.str().find( "elf_load"), string::npos);
+    ASSERT_NE( report.str().find( "branch_misses"), string::npos);
+    ASSERT_EQ( report.str().find( "dump"), string::npos);
+    ASSERT_EQ( report.str().find( "n/a") != string::npos, !perf.isAvailable( HOST_CYCLES)
+               || !perf.isAvailable( HOST_INSTRUCTIONS) || !perf.isAvailable( HOST_CACHE_MISSES)
+               || !perf.isAvailable( HOST_BRANCH_MISSES));
+}
+
+int main( int argc, char* argv[])
+{
+    ::testing::InitGoogleTest( &argc, argv);
+    ::testing::FLAGS_gtest_death_test_style = "threadsafe";
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,57 @@
+/**
+ * rf.h - the MIPS register file: 32 general purpose registers, HI and LO.
+ * Copyright 2015 MIPT-MIPS iLab project
+ */
+
+// protection from multi-include
+#ifndef RF__RF_H
+#define RF__RF_H
+
+// Generic C
+#include <cassert>
+#include <cstring>
+
+// uArchSim modules
+#include <types.h>
+
+enum RegNum
+{
+    REG_ZERO = 0,
+    REG_AT,
+    REG_V0, REG_V1,
+    REG_A0, REG_A1, REG_A2, REG_A3,
+    REG_T0, REG_T1, REG_T2, REG_T3, REG_T4, REG_T5, REG_T6, REG_T7,
+    REG_S0, REG_S1, REG_S2, REG_S3, REG_S4, REG_S5, REG_S6, REG_S7,
+    REG_T8, REG_T9,
+    REG_K0, REG_K1,
+    REG_GP, REG_SP, REG_FP, REG_RA,
+    REG_HI, REG_LO,
+    REG_NUM
+};
+
+class RF
+{
+        uint32 regs[ REG_NUM];
+
+    public:
+        RF() { reset(); }
+
+        inline uint32 read( RegNum num) const
+        {
+            assert( num < REG_NUM);
+            return regs[ num];
+        }
+
+        // writes to $zero are ignored
+        inline void write( RegNum num, uint32 value)
+        {
+            assert( num < REG_NUM);
+            if ( num != REG_ZERO)
+                regs[ num] = value;
+        }
+
+        // sets all the registers to zero
+        inline void reset() { memset( regs, 0, sizeof( regs)); }
+};
+
+#endif // #ifndef RF__RF_H
@@ -0,0 +1,68 @@
+// Generic C
+#include <string.h>
+#include <stdlib.h>
+
+// Generic C++
+#include <iostream>
+#include <fstream>
+
+// uArchSim modules
+#include <simpoint.h>
+
+using namespace std;
+
+int main ( int argc, char* argv[])
+{
+    const int num_of_args = 4;
+
+    if ( argc == 2 && !strcmp( argv[ 1], "--help"))
+    {
+        cout << "This program picks representative intervals of a run" << endl
+             << "from its basic block vectors given in SimPoint format." << endl
+             << "The picks and their weights are written to <output>.simpoints" << endl
+             << "and <output>.weights files." << endl
+             << endl
+             << "Usage: \"" << argv[ 0] << " <BBV file> <max number of phases> <output>\"" << endl;
+        return 0;
+    }
+
+    if ( argc != num_of_args)
+    {
+        cerr << "ERROR: wrong number of arguments!" << endl
+             << "Type \"" << argv[ 0] << " --help\" for usage." << endl;
+        exit( EXIT_FAILURE);
+    }
+
+    ifstream bbv_file( argv[ 1]);
+    if ( !bbv_file)
+    {
+        cerr << "ERROR: Could not open file " << argv[ 1] << endl;
+        exit( EXIT_FAILURE);
+    }
+
+    vector<BasicBlockVector> intervals;
+    string error;
+    if ( !readBbv( bbv_file, intervals, error))
+    {
+        cerr << "ERROR: " << argv[ 1] << ": " << error << endl;
+        exit( EXIT_FAILURE);
+    }
+
+    SimPointClustering clustering;
+    clusterIntervals( intervals, strtoul( argv[ 2], NULL, 10), clustering);
+
+    string output = argv[ 3];
+    ofstream simpoints( ( output + ".simpoints").c_str());
+    ofstream weights( ( output + ".weights").c_str());
+    if ( !simpoints || !weights)
+    {
+        cerr << "ERROR: Could not create output files " << output << ".*" << endl;
+        exit( EXIT_FAILURE);
+    }
+    writeSimPoints( clustering, simpoints, weights);
+
+    cout << intervals.size() << " intervals, " << clustering.picks.size()
+         << " phases, BIC " << clustering.bic << endl;
+
+    return 0;
+}
@@ -0,0 +1,359 @@
+/**
+ * simpoint.cpp - Implementation of the sampled simulation support
+ * in SimPoint style.
+ * Copyright 2015 MIPT-MIPS iLab project
+ */
+
+// Generic C
+#include <cmath>
+#include <cstdlib>
+#include <cstdio>
+
+// Generic C++
+#include <sstream>
+#include <algorithm>
+#include <limits>
+
+// uArchSim modules
+#include <simpoint.h>
+
+using namespace std;
+
+BbvCollector::BbvCollector( uint64 interval_size)
+    : interval_size( interval_size),
+      block_start( 0), block_length( 0), interval_length( 0), in_block( false)
+{ }
+
+void BbvCollector::flushBlock()
+{
+    if ( block_length == 0)
+        return;
+
+    unordered_map<uint64, uint32>::iterator it = block_ids.find( block_start);
+    if ( it == block_ids.end())
+        it = block_ids.insert( make_pair( block_start, ( uint32)block_ids.size() + 1)).first;
+
+    current[ it->second] += block_length;
+    block_length = 0;
+}
+
+void BbvCollector::step( uint64 pc, uint64 next_pc)
+{
+    if ( !in_block)
+    {
+        block_start = pc;
+        in_block = true;
+    }
+    ++block_length;
+    ++interval_length;
+
+    // the counts are added to the vector only at the end of a block,
+    // so the common case is a couple of increments
+    if ( next_pc != pc + 4)
+    {
+        flushBlock();
+        in_block = false;
+    }
+
+    if ( interval_length == interval_size)
+    {
+        // a block crossing the interval border is counted in both intervals
+        flushBlock();
+        finish();
+    }
+}
+
+void BbvCollector::finish()
+{
+    flushBlock();
+    if ( interval_length == 0)
+        return;
+
+    BasicBlockVector bbv( current.begin(), current.end());
+    sort( bbv.begin(), bbv.end());
+    intervals.push_back( bbv);
+
+    current.clear();
+    interval_length = 0;
+}
+
+void BbvCollector::write( ostream& out) const
+{
+    for ( size_t i = 0; i < intervals.size(); ++i)
+    {
+        out << 'T';
+        for ( size_t j = 0; j < intervals[ i].size(); ++j)
+            out << ':' << intervals[ i][ j].first << ':' << intervals[ i][ j].second << ' ';
+        out << endl;
+    }
+}
+
+bool readBbv( istream& in, vector<BasicBlockVector>& intervals, string& error)
+{
+    string line;
+    for ( size_t line_num = 1; getline( in, line); ++line_num)
+    {
+        if ( line.empty() || line[ 0] != 'T')
+            continue;
+
+        BasicBlockVector bbv;
+        istringstream iss( line.substr( 1));
+        string token;
+        while ( iss >> token)
+        {
+            unsigned long long id = 0, count = 0;
+            char tail = 0;
+            if ( sscanf( token.c_str(), ":%llu:%llu%c", &id, &count, &tail) != 2 || id == 0)
+            {
+                ostringstream oss;
+                oss << "line " << line_num << ": wrong entry \"" << token << "\"";
+                error = oss.str();
+                return false;
+            }
+            bbv.push_back( make_pair( ( uint32)id, ( uint64)count));
+        }
+        intervals.push_back( bbv);
+    }
+    return true;
+}
+
+// A random number in [-1, 1) which is the same for the same block and dimension,
+// so the projection matrix is never stored
+static double projection( uint32 block, uint32 dimension, uint64 seed)
+{
+    // splitmix64 finalizer
+    uint64 x = seed + ( ( uint64)block << 32 | dimension) * 0x9e3779b97f4a7c15ull;
+    x = ( x ^ ( x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = ( x ^ ( x >> 27)) * 0x94d049bb133111ebull;
+    x = x ^ ( x >> 31);
+    return ( double)( x >> 11) / ( double)( 1ull << 52) - 1.0;
+}
+
+static double distance2( const double* a, const double* b, uint32 dimensions)
+{
+    double sum = 0;
+    for ( uint32 d = 0; d < dimensions; ++d)
+        sum += ( a[ d] - b[ d]) * ( a[ d] - b[ d]);
+    return sum;
+}
+
+struct KMeans
+{
+    vector<double> centers;
+    vector<uint32> cluster_of;
+    vector<uint64> sizes;
+    double sse;
+};
+
+static void runKMeans( const vector<double>& points, uint32 dimensions, uint32 k,
+                       uint64 seed, KMeans& result)
+{
+    size_t num = points.size() / dimensions;
+
+    // k-means++ initialization with a deterministic random sequence
+    result.centers.assign( points.begin(), points.begin() + dimensions);
+    vector<double> nearest( num, numeric_limits<double>::max());
+    for ( uint32 c = 1; c < k; ++c)
+    {
+        double total = 0;
+        for ( size_t i = 0; i < num; ++i)
+        {
+            nearest[ i] = min( nearest[ i], distance2( &points[ i * dimensions],
+                                                       &result.centers[ ( c - 1) * dimensions],
+                                                       dimensions));
+            total += nearest[ i];
+        }
+
+        double target = ( projection( c, 0, seed) + 1) / 2 * total;
+        size_t chosen = num - 1;
+        for ( size_t i = 0; i < num; ++i)
+        {
+            target -= nearest[ i];
+            if ( target <= 0)
+            {
+                chosen = i;
+                break;
+            }
+        }
+        result.centers.insert( result.centers.end(), points.begin() + chosen * dimensions,
+                               points.begin() + ( chosen + 1) * dimensions);
+    }
+
+    result.cluster_of.assign( num, 0);
+    const uint32 max_iterations = 100;
+    for ( uint32 iteration = 0; iteration < max_iterations; ++iteration)
+    {
+        bool changed = false;
+        result.sse = 0;
+        for ( size_t i = 0; i < num; ++i)
+        {
+            double best = numeric_limits<double>::max();
+            uint32 best_c = 0;
+            for ( uint32 c = 0; c < k; ++c)
+            {
+                double dist = distance2( &points[ i * dimensions],
+                                         &result.centers[ c * dimensions], dimensions);
+                if ( dist < best)
+                {
+                    best = dist;
+                    best_c = c;
+                }
+            }
+            changed = changed || result.cluster_of[ i] != best_c;
+            result.cluster_of[ i] = best_c;
+            result.sse += best;
+        }
+
+        result.sizes.assign( k, 0);
+        vector<double> sums( k * dimensions, 0);
+        for ( size_t i = 0; i < num; ++i)
+        {
+            ++result.sizes[ result.cluster_of[ i]];
+            for ( uint32 d = 0; d < dimensions; ++d)
+                sums[ result.cluster_of[ i] * dimensions + d] += points[ i * dimensions + d];
+        }
+        for ( uint32 c = 0; c < k; ++c)
+            if ( result.sizes[ c] != 0)
+                for ( uint32 d = 0; d < dimensions; ++d)
+                    result.centers[ c * dimensions + d] = sums[ c * dimensions + d] / result.sizes[ c];
+
+        if ( !changed && iteration != 0)
+            break;
+    }
+}
+
+// Bayesian information criterion of the clustering under the identical
+// spherical Gaussian assumption (Pelleg and Moore, X-means)
+static double bicScore( const KMeans& kmeans, size_t num, uint32 dimensions)
+{
+    double k = kmeans.sizes.size();
+    // the variance is floored to keep the score finite for the perfect clustering
+    double variance = num > k ? kmeans.sse / ( num - k) : 0;
+    if ( variance < 1e-12)
+        variance = 1e-12;
+
+    double likelihood = 0;
+    for ( size_t c = 0; c < kmeans.sizes.size(); ++c)
+    {
+        double n = kmeans.sizes[ c];
+        if ( n == 0)
+            continue;
+        likelihood += n * log( n) - n * log( ( double)num)
+                      - n / 2 * log( 2 * M_PI)
+                      - n * dimensions / 2 * log( variance)
+                      - ( n - k) / 2;
+    }
+
+    double parameters = ( k - 1) + dimensions * k + 1;
+    return likelihood - parameters / 2 * log( ( double)num);
+}
+
+void clusterIntervals( const vector<BasicBlockVector>& intervals,
+                       uint32 max_k,
+                       SimPointClustering& result,
+                       double bic_threshold,
+                       uint32 dimensions,
+                       uint64 seed)
+{
+    result.picks.clear();
+    result.cluster_of.clear();
+    result.bic = 0;
+
+    size_t num = intervals.size();
+    if ( num == 0 || max_k == 0)
+        return;
+
+    // normalize each vector to the interval size and project it
+    vector<double> points( num * dimensions, 0);
+    for ( size_t i = 0; i < num; ++i)
+    {
+        double total = 0;
+        for ( size_t j = 0; j < intervals[ i].size(); ++j)
+            total += intervals[ i][ j].second;
+        if ( total == 0)
+            continue;
+
+        for ( size_t j = 0; j < intervals[ i].size(); ++j)
+            for ( uint32 d = 0; d < dimensions; ++d)
+                points[ i * dimensions + d] += intervals[ i][ j].second / total
+                                               * projection( intervals[ i][ j].first, d, seed);
+    }
+
+    // the variance cannot be estimated if each interval is a cluster
+    if ( max_k >= num)
+        max_k = num > 1 ? num - 1 : 1;
+
+    vector<KMeans> runs( max_k);
+    vector<double> scores( max_k);
+    for ( uint32 k = 1; k <= max_k; ++k)
+    {
+        runKMeans( points, dimensions, k, seed, runs[ k - 1]);
+        scores[ k - 1] = bicScore( runs[ k - 1], num, dimensions);
+    }
+
+    double best = *max_element( scores.begin(), scores.end());
+    double worst = *min_element( scores.begin(), scores.end());
+    uint32 chosen = 0;
+    while ( scores[ chosen] < worst + bic_threshold * ( best - worst))
+        ++chosen;
+
+    const KMeans& kmeans = runs[ chosen];
+    result.cluster_of = kmeans.cluster_of;
+    result.bic = scores[ chosen];
+
+    // the representative of a phase is the interval closest to its center
+    for ( uint32 c = 0; c < kmeans.sizes.size(); ++c)
+    {
+        if ( kmeans.sizes[ c] == 0)
+            continue;
+
+        SimPointPick pick;
+        pick.cluster = c;
+        pick.weight = ( double)kmeans.sizes[ c] / num;
+        pick.interval = 0;
+
+        double closest = numeric_limits<double>::max();
+        for ( size_t i = 0; i < num; ++i)
+        {
+            if ( kmeans.cluster_of[ i] != c)
+                continue;
+            double dist = distance2( &points[ i * dimensions],
+                                     &kmeans.centers[ c * dimensions], dimensions);
+            if ( dist < closest)
+            {
+                closest = dist;
+                pick.interval = i;
+            }
+        }
+        result.picks.push_back( pick);
+    }
+}
+
+void writeSimPoints( const SimPointClustering& clustering,
+                     ostream& simpoints, ostream& weights)
+{
+    for ( size_t i = 0; i < clustering.picks.size(); ++i)
+    {
+        simpoints << clustering.picks[ i].interval << ' ' << clustering.picks[ i].cluster << endl;
+        weights << clustering.picks[ i].weight << ' ' << clustering.picks[ i].cluster << endl;
+    }
+}
+
+void estimatePerformance( const SimPointClustering& clustering,
+                          uint64 interval_size, SampledTiming& timing,
+                          SampledEstimate& estimate)
+{
+    estimate.cpi = 0;
+    estimate.pick_cpi.clear();
+
+    // CPI is additive over instructions, so the phases are weighted
+    // in CPI and only the final result is converted to IPC
+    for ( size_t i = 0; i < clustering.picks.size(); ++i)
+    {
+        double cpi = timing.measureCpi( clustering.picks[ i].interval, interval_size);
+        estimate.pick_cpi.push_back( cpi);
+        estimate.cpi += clustering.picks[ i].weight * cpi;
+    }
+
+    estimate.ipc = estimate.cpi > 0 ? 1 / estimate.cpi : 0;
+}
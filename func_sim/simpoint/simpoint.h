@@ -0,0 +1,132 @@
+/**
+ * simpoint.h - Header of the sampled simulation support in SimPoint style.
+ * The functional simulator collects basic block vectors (BBV) per fixed-size
+ * interval, the clustering picks one representative interval per phase,
+ * and the timing model runs only the picked intervals.
+ * Copyright 2015 MIPT-MIPS iLab project
+ */
+
+// protection from multi-include
+#ifndef SIMPOINT__SIMPOINT_H
+#define SIMPOINT__SIMPOINT_H
+
+// Generic C++
+#include <string>
+#include <vector>
+#include <iostream>
+#include <unordered_map>
+
+// uArchSim modules
+#include <types.h>
+#include <trace_record.h>
+
+using namespace std;
+
+// Number of instructions executed in each basic block during one interval.
+// The blocks are identified by numbers starting from 1 as in SimPoint files.
+typedef vector<pair<uint32, uint64> > BasicBlockVector;
+
+//
+// Builds BBVs from the stream of executed instructions.
+// A basic block ends at every instruction whose next PC is not PC + 4.
+//
+class BbvCollector
+{
+        const uint64 interval_size;
+
+        unordered_map<uint64, uint32> block_ids; // start PC -> block number
+        unordered_map<uint32, uint64> current;   // counts of the current interval
+        vector<BasicBlockVector> intervals;
+
+        uint64 block_start;  // start PC of the current block
+        uint64 block_length; // instructions executed in the current block so far
+        uint64 interval_length;
+        bool in_block;
+
+        void flushBlock();
+
+    public:
+        BbvCollector( uint64 interval_size);
+
+        void step( uint64 pc, uint64 next_pc);
+
+        // allows to use the collector as a consumer of the trace queue
+        inline bool consume( const TraceRecord& record)
+        {
+            step( record.pc, record.next_pc);
+            return true;
+        }
+
+        // closes the last incomplete interval, if any
+        void finish();
+
+        inline const vector<BasicBlockVector>& getIntervals() const { return intervals; }
+        inline uint64 intervalSize() const { return interval_size; }
+
+        // Writes the BBVs in SimPoint format: "T:<block>:<count> :<block>:<count> ..."
+        void write( ostream& out) const;
+};
+
+// Reads BBVs in SimPoint format
+bool readBbv( istream& in, vector<BasicBlockVector>& intervals /*used as output*/,
+              string& error /*used as output*/);
+
+struct SimPointPick
+{
+    uint64 interval; // index of the representative interval
+    uint32 cluster;  // phase it represents
+    double weight;   // fraction of all the intervals in the phase
+};
+
+struct SimPointClustering
+{
+    vector<SimPointPick> picks;
+    vector<uint32> cluster_of; // phase of each interval
+    double bic;                // BIC score of the chosen clustering
+};
+
+//
+// Projects the BBVs to a low dimension and clusters them by k-means
+// for k from 1 to max_k. The smallest k whose BIC score reaches
+// bic_threshold of the best score range is chosen, as SimPoint does.
+//
+void clusterIntervals( const vector<BasicBlockVector>& intervals,
+                       uint32 max_k,
+                       SimPointClustering& result /*used as output*/,
+                       double bic_threshold = 0.9,
+                       uint32 dimensions = 15,
+                       uint64 seed = 1);
+
+// Writes the picks as SimPoint ".simpoints" and ".weights" files do:
+// "<interval> <cluster>" and "<weight> <cluster>" per line
+void writeSimPoints( const SimPointClustering& clustering,
+                     ostream& simpoints, ostream& weights);
+
+// The timing model run on one interval, usually restored from a checkpoint
+// taken at the start of the interval
+class SampledTiming
+{
+    public:
+        virtual ~SampledTiming() { }
+        virtual double measureCpi( uint64 interval, uint64 interval_size) = 0;
+};
+
+struct SampledEstimate
+{
+    double cpi;             // weighted CPI of the whole run
+    double ipc;             // 1 / cpi
+    vector<double> pick_cpi; // measured CPI of each pick
+};
+
+// Runs the timing model on the picked intervals and extrapolates the CPI
+void estimatePerformance( const SimPointClustering& clustering,
+                          uint64 interval_size, SampledTiming& timing,
+                          SampledEstimate& estimate /*used as output*/);
+
+// Relative error of the estimate against a reference measured by a full run
+inline double relativeError( double estimated, double reference)
+{
+    return reference != 0 ? ( estimated - reference) / reference : 0;
+}
+
+#endif // #ifndef SIMPOINT__SIMPOINT_H
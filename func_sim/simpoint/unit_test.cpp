@@ -0,0 +1,135 @@
+// generic C
+#include <cassert>
+#include <cstdlib>
+#include <cmath>
+
+// Generic C++
+#include <sstream>
+
+// Google Test library
+#include <gtest/gtest.h>
+
+// uArchSim modules
+#include <simpoint.h>
+
+static const uint64 interval_size = 100;
+
+//
+// Executes a loop of loop_size instructions starting from start_pc
+// until num instructions are executed
+//
+static void runLoop( BbvCollector& collector, uint64 start_pc,
+                     uint64 loop_size, uint64 num)
+{
+    for ( uint64 i = 0; i < num; ++i)
+    {
+        uint64 pc = start_pc + 4 * ( i % loop_size);
+        uint64 next_pc = ( i % loop_size == loop_size - 1) ? start_pc : pc + 4;
+        collector.step( pc, next_pc);
+    }
+}
+
+//
+// Two phases: a loop of 5 instructions and a loop of 10 instructions
+// at different addresses, each running for 10 intervals
+//
+static void collectTwoPhases( BbvCollector& collector)
+{
+    runLoop( collector, 0x400000, 5, 10 * interval_size);
+    runLoop( collector, 0x401000, 10, 10 * interval_size);
+    collector.finish();
+}
+
+// CPI of the 1st phase is 1, CPI of the 2nd one is 3
+class PhaseTiming : public SampledTiming
+{
+    public:
+        uint32 runs;
+        PhaseTiming() : runs( 0) { }
+
+        double measureCpi( uint64 interval, uint64 /* interval_size */)
+        {
+            ++runs;
+            return interval < 10 ? 1.0 : 3.0;
+        }
+};
+
+TEST( Bbv_collector, Collect_Intervals)
+{
+    BbvCollector collector( interval_size);
+    collectTwoPhases( collector);
+
+    const vector<BasicBlockVector>& intervals = collector.getIntervals();
+    ASSERT_EQ( intervals.size(), 20u);
+
+    // each interval has exactly interval_size instructions
+    for ( size_t i = 0; i < intervals.size(); ++i)
+    {
+        uint64 total = 0;
+        for ( size_t j = 0; j < intervals[ i].size(); ++j)
+            total += intervals[ i][ j].second;
+        ASSERT_EQ( total, interval_size);
+    }
+
+    // one block per phase
+    ASSERT_EQ( intervals[ 0].size(), 1u);
+    ASSERT_EQ( intervals[ 0][ 0].first, 1u);
+    ASSERT_EQ( intervals[ 19][ 0].first, 2u);
+}
+
+TEST( Bbv_collector, Write_And_Read)
+{
+    BbvCollector collector( interval_size);
+    collectTwoPhases( collector);
+
+    stringstream file;
+    collector.write( file);
+
+    vector<BasicBlockVector> intervals;
+    string error;
+    ASSERT_TRUE( readBbv( file, intervals, error));
+    ASSERT_TRUE( intervals == collector.getIntervals());
+
+    istringstream broken( "T:1:10 :2\n");
+    ASSERT_FALSE( readBbv( broken, intervals, error));
+}
+
+TEST( SimPoint, Cluster_And_Estimate)
+{
+    BbvCollector collector( interval_size);
+    collectTwoPhases( collector);
+
+    SimPointClustering clustering;
+    clusterIntervals( collector.getIntervals(), 5, clustering);
+
+    // one pick per phase, each one represents half of the run
+    ASSERT_EQ( clustering.picks.size(), 2u);
+    ASSERT_NE( clustering.picks[ 0].interval < 10, clustering.picks[ 1].interval < 10);
+    ASSERT_DOUBLE_EQ( clustering.picks[ 0].weight, 0.5);
+    ASSERT_DOUBLE_EQ( clustering.picks[ 1].weight, 0.5);
+
+    // the timing model runs only on the picks
+    PhaseTiming timing;
+    SampledEstimate estimate;
+    estimatePerformance( clustering, interval_size, timing, estimate);
+    ASSERT_EQ( timing.runs, 2u);
+    ASSERT_DOUBLE_EQ( estimate.cpi, 2.0);
+    ASSERT_DOUBLE_EQ( estimate.ipc, 0.5);
+
+    // the full run gives the same CPI
+    ASSERT_DOUBLE_EQ( relativeError( estimate.cpi, 2.0), 0);
+
+    stringstream simpoints, weights;
+    writeSimPoints( clustering, simpoints, weights);
+    uint64 interval = 0;
+    uint32 cluster = 0;
+    simpoints >> interval >> cluster;
+    ASSERT_EQ( interval, clustering.picks[ 0].interval);
+}
+
+int main( int argc, char* argv[])
+{
+    ::testing::InitGoogleTest( &argc, argv);
+    ::testing::FLAGS_gtest_death_test_style = "threadsafe";
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,288 @@
+/**
+ * stats.cpp - Implementation of the registry of the simulator statistics.
+ * Copyright 2015 MIPT-MIPS iLab project
+ */
+
+// Generic C
+#include <cstdlib>
+#include <cstring>
+
+// Generic C++
+#include <iostream>
+#include <sstream>
+#include <algorithm>
+
+// uArchSim modules
+#include <stats.h>
+
+// the values of a block are followed by a cache line of padding,
+// so the blocks of two threads never share a line
+static const uint32 BLOCK_PADDING = 64 / sizeof( uint64);
+
+StatsBlock::StatsBlock( uint32 num_values)
+    : values( new uint64[ num_values + BLOCK_PADDING]), num_values( num_values)
+{
+    memset( values, 0, ( num_values + BLOCK_PADDING) * sizeof( uint64));
+}
+
+StatsBlock::~StatsBlock()
+{
+    delete [] values;
+}
+
+StatsRegistry::StatsRegistry() : num_values( 0) { }
+
+StatsRegistry::~StatsRegistry()
+{
+    for ( size_t i = 0; i < blocks.size(); ++i)
+        delete blocks[ i];
+}
+
+static bool isValidName( const string& name)
+{
+    if ( name.empty() || name[ 0] == '.' || name[ name.size() - 1] == '.')
+        return false;
+    for ( size_t i = 0; i < name.size(); ++i)
+    {
+        char c = name[ i];
+        bool valid = ( c >= 'a' && c <= 'z') || ( c >= 'A' && c <= 'Z')
+                     || ( c >= '0' && c <= '9') || c == '_'
+                     || ( c == '.' && name[ i - 1] != '.');
+        if ( !valid)
+            return false;
+    }
+    return true;
+}
+
+// "a.b" cannot be both a statistic and a group of "a.b.c"
+static bool isGroupOf( const string& group, const string& name)
+{
+    return name.size() > group.size() && name.compare( 0, group.size(), group) == 0
+           && name[ group.size()] == '.';
+}
+
+void StatsRegistry::add( const string& name, const string& description,
+                         uint32 num_buckets, uint64 bucket_size)
+{
+    string error;
+    if ( !blocks.empty())
+        error = "registered after the blocks are created";
+    else if ( !isValidName( name))
+        error = "wrong name";
+
+    for ( size_t i = 0; error.empty() && i < stats.size(); ++i)
+    {
+        if ( stats[ i].name == name)
+            error = "registered twice";
+        else if ( isGroupOf( stats[ i].name, name) || isGroupOf( name, stats[ i].name))
+            error = "conflicts with " + stats[ i].name;
+    }
+
+    if ( !error.empty())
+    {
+        cerr << "ERROR: statistic \"" << name << "\": " << error << endl;
+        exit( EXIT_FAILURE);
+    }
+
+    Stat stat;
+    stat.name = name;
+    stat.description = description;
+    stat.offset = num_values;
+    stat.num_buckets = num_buckets;
+    stat.bucket_size = bucket_size;
+    stats.push_back( stat);
+    num_values += num_buckets == 0 ? 1 : num_buckets;
+}
+
+uint32 StatsRegistry::addCounter( const string& name, const string& description)
+{
+    add( name, description, 0, 0);
+    return stats.back().offset;
+}
+
+StatsHistogram StatsRegistry::addHistogram( const string& name, uint32 num_buckets,
+                                            uint64 bucket_size, const string& description)
+{
+    if ( num_buckets == 0 || bucket_size == 0)
+    {
+        cerr << "ERROR: statistic \"" << name << "\": empty histogram" << endl;
+        exit( EXIT_FAILURE);
+    }
+    add( name, description, num_buckets, bucket_size);
+
+    StatsHistogram histogram;
+    histogram.offset = stats.back().offset;
+    histogram.num_buckets = num_buckets;
+    histogram.bucket_size = bucket_size;
+    return histogram;
+}
+
+StatsBlock* StatsRegistry::createBlock()
+{
+    lock_guard<mutex> lock( blocks_mutex);
+    blocks.push_back( new StatsBlock( num_values));
+    return blocks.back();
+}
+
+void StatsRegistry::aggregate( vector<uint64>& values) const
+{
+    values.assign( num_values, 0);
+    lock_guard<mutex> lock( blocks_mutex);
+    for ( size_t b = 0; b < blocks.size(); ++b)
+        for ( uint32 i = 0; i < num_values; ++i)
+            values[ i] += blocks[ b]->values[ i];
+}
+
+void StatsRegistry::reset()
+{
+    lock_guard<mutex> lock( blocks_mutex);
+    for ( size_t b = 0; b < blocks.size(); ++b)
+        memset( blocks[ b]->values, 0, num_values * sizeof( uint64));
+}
+
+void StatsRegistry::sortedStats( vector<size_t>& order) const
+{
+    vector<pair<string, size_t> > names;
+    for ( size_t i = 0; i < stats.size(); ++i)
+        names.push_back( make_pair( stats[ i].name, i));
+    sort( names.begin(), names.end());
+
+    order.clear();
+    for ( size_t i = 0; i < names.size(); ++i)
+        order.push_back( names[ i].second);
+}
+
+// "name::low-high", the last bucket is "name::low+"
+static string bucketName( const string& name, uint32 bucket,
+                          uint32 num_buckets, uint64 bucket_size)
+{
+    ostringstream oss;
+    oss << name << "::" << bucket * bucket_size;
+    if ( bucket + 1 == num_buckets)
+        oss << '+';
+    else
+        oss << '-' << ( bucket + 1) * bucket_size - 1;
+    return oss.str();
+}
+
+void StatsRegistry::valueNames( vector<string>& names) const
+{
+    names.clear();
+    for ( size_t i = 0; i < stats.size(); ++i)
+    {
+        if ( stats[ i].num_buckets == 0)
+            names.push_back( stats[ i].name);
+        for ( uint32 b = 0; b < stats[ i].num_buckets; ++b)
+            names.push_back( bucketName( stats[ i].name, b, stats[ i].num_buckets,
+                                         stats[ i].bucket_size));
+    }
+}
+
+void StatsRegistry::writeText( ostream& out) const
+{
+    vector<uint64> values;
+    aggregate( values);
+    vector<size_t> order;
+    sortedStats( order);
+
+    for ( size_t i = 0; i < order.size(); ++i)
+    {
+        const Stat& stat = stats[ order[ i]];
+        if ( stat.num_buckets == 0)
+        {
+            out << stat.name << ' ' << values[ stat.offset];
+            if ( !stat.description.empty())
+                out << " # " << stat.description;
+            out << endl;
+            continue;
+        }
+
+        if ( !stat.description.empty())
+            out << "# " << stat.name << ": " << stat.description << endl;
+        for ( uint32 b = 0; b < stat.num_buckets; ++b)
+            out << bucketName( stat.name, b, stat.num_buckets, stat.bucket_size)
+                << ' ' << values[ stat.offset + b] << endl;
+    }
+}
+
+void StatsRegistry::writeCsv( ostream& out) const
+{
+    vector<uint64> values;
+    aggregate( values);
+    vector<size_t> order;
+    sortedStats( order);
+
+    out << "name,value" << endl;
+    for ( size_t i = 0; i < order.size(); ++i)
+    {
+        const Stat& stat = stats[ order[ i]];
+        if ( stat.num_buckets == 0)
+            out << stat.name << ',' << values[ stat.offset] << endl;
+        for ( uint32 b = 0; b < stat.num_buckets; ++b)
+            out << bucketName( stat.name, b, stat.num_buckets, stat.bucket_size)
+                << ',' << values[ stat.offset + b] << endl;
+    }
+}
+
+static void splitName( const string& name, vector<string>& parts)
+{
+    parts.clear();
+    istringstream iss( name);
+    string part;
+    while ( getline( iss, part, '.'))
+        parts.push_back( part);
+}
+
+void StatsRegistry::writeJson( ostream& out) const
+{
+    vector<uint64> values;
+    aggregate( values);
+    vector<size_t> order;
+    sortedStats( order);
+
+    // the groups of the sorted names are opened and closed as in a tree walk,
+    // "first" tells that nothing is written yet to the innermost object
+    vector<string> open_groups;
+    vector<string> parts;
+    bool first = true;
+
+    out << '{';
+    for ( size_t i = 0; i < order.size(); ++i)
+    {
+        const Stat& stat = stats[ order[ i]];
+        splitName( stat.name, parts);
+
+        size_t common = 0;
+        while ( common < open_groups.size() && common + 1 < parts.size()
+                && open_groups[ common] == parts[ common])
+            ++common;
+        for ( ; open_groups.size() > common; open_groups.pop_back())
+        {
+            out << endl << string( 2 * open_groups.size(), ' ') << '}';
+            first = false;
+        }
+
+        for ( ; open_groups.size() + 1 < parts.size(); first = true)
+        {
+            out << ( first ? "" : ",") << endl << string( 2 * open_groups.size() + 2, ' ')
+                << '"' << parts[ open_groups.size()] << "\": {";
+            open_groups.push_back( parts[ open_groups.size()]);
+        }
+
+        out << ( first ? "" : ",");
+        first = false;
+        out << endl << string( 2 * open_groups.size() + 2, ' ') << '"' << parts.back() << "\": ";
+        if ( stat.num_buckets == 0)
+        {
+            out << values[ stat.offset];
+            continue;
+        }
+        out << "{\"bucket_size\": " << stat.bucket_size << ", \"buckets\": [";
+        for ( uint32 b = 0; b < stat.num_buckets; ++b)
+            out << ( b == 0 ? "" : ", ") << values[ stat.offset + b];
+        out << "]}";
+    }
+    for ( ; !open_groups.empty(); open_groups.pop_back())
+        out << endl << string( 2 * open_groups.size(), ' ') << '}';
+    out << endl << '}' << endl;
+}
@@ -0,0 +1,119 @@
+/**
+ * stats.h - Header of the registry of the simulator statistics:
+ * counters and histograms with hierarchical names like "core0.l1d.misses".
+ * Each thread increments plain integers of its own block, the blocks
+ * are summed up only when the statistics are written.
+ * Copyright 2015 MIPT-MIPS iLab project
+ */
+
+// protection from multi-include
+#ifndef STATS__STATS_H
+#define STATS__STATS_H
+
+// Generic C++
+#include <string>
+#include <vector>
+#include <ostream>
+#include <mutex>
+
+// uArchSim modules
+#include <types.h>
+
+using namespace std;
+
+// A histogram takes num_buckets values of the block from the offset,
+// the last bucket counts all the samples above the range
+struct StatsHistogram
+{
+    uint32 offset;
+    uint32 num_buckets;
+    uint64 bucket_size;
+};
+
+// The values of the statistics of one thread
+class StatsBlock
+{
+        uint64* values;
+        const uint32 num_values;
+
+        friend class StatsRegistry;
+        explicit StatsBlock( uint32 num_values);
+        ~StatsBlock();
+
+        // no copies, the values are owned
+        StatsBlock( const StatsBlock&);
+        StatsBlock& operator=( const StatsBlock&);
+
+    public:
+        inline void inc( uint32 counter, uint64 num = 1) { values[ counter] += num; }
+
+        inline void sample( const StatsHistogram& histogram, uint64 value)
+        {
+            uint64 bucket = value / histogram.bucket_size;
+            if ( bucket >= histogram.num_buckets)
+                bucket = histogram.num_buckets - 1;
+            ++values[ histogram.offset + bucket];
+        }
+
+        inline uint64 get( uint32 counter) const { return values[ counter]; }
+};
+
+class StatsRegistry
+{
+        struct Stat
+        {
+            string name;
+            string description;
+            uint32 offset;
+            uint32 num_buckets; // 0 for a counter
+            uint64 bucket_size;
+        };
+
+        vector<Stat> stats;  // in the order of registration
+        uint32 num_values;
+
+        // the blocks are only added, so the lock is not taken on increments
+        vector<StatsBlock*> blocks;
+        mutable mutex blocks_mutex;
+
+        void add( const string& name, const string& description,
+                  uint32 num_buckets, uint64 bucket_size);
+
+        // the indices of the statistics sorted by name, so the groups are contiguous
+        void sortedStats( vector<size_t>& order /*used as output*/) const;
+
+        // no copies, the blocks are owned
+        StatsRegistry( const StatsRegistry&);
+        StatsRegistry& operator=( const StatsRegistry&);
+
+    public:
+        StatsRegistry();
+        virtual ~StatsRegistry();
+
+        // The names are dot-separated parts of letters, digits and '_'.
+        // All the statistics are registered before the first block is created,
+        // a wrong or duplicated name terminates the program.
+        uint32 addCounter( const string& name, const string& description = "");
+        StatsHistogram addHistogram( const string& name, uint32 num_buckets,
+                                     uint64 bucket_size, const string& description = "");
+
+        // A block for the calling thread, it lives as long as the registry
+        StatsBlock* createBlock();
+
+        uint32 numValues() const { return num_values; }
+        // The names of the values in the order of the blocks, see writeText() for the buckets
+        void valueNames( vector<string>& names /*used as output*/) const;
+        // The values summed over the blocks, indexed as in the blocks.
+        // The threads are to be stopped, so the sum is consistent.
+        void aggregate( vector<uint64>& values /*used as output*/) const;
+        void reset();
+
+        // "name value # description", a line per histogram bucket "name::low-high value"
+        void writeText( ostream& out) const;
+        // An object per group: {"core0": {"l1d": {"misses": 5}}}
+        void writeJson( ostream& out) const;
+        // "name,value" rows with the buckets as in the text
+        void writeCsv( ostream& out) const;
+};
+
+#endif // #ifndef STATS__STATS_H
@@ -0,0 +1,242 @@
+/**
+ * stats_sampler.cpp - Implementation of the sampling of the statistics over time.
+ * Copyright 2015 MIPT-MIPS iLab project
+ */
+
+// Generic C
+#include <cstdlib>
+#include <cstring>
+
+// Generic C++
+#include <iostream>
+#include <iomanip>
+
+// uArchSim modules
+#include <stats_sampler.h>
+
+// The binary stream is the magic, the header and a record per sample.
+// All the numbers are unsigned LEB128, so the small changes of the values
+// in an interval take a byte or two each.
+static const char SAMPLES_MAGIC[ 8] = { 'M', 'I', 'P', 'S', 'S', 'A', 'M', 'P'};
+static const uint64 SAMPLES_VERSION = 1;
+
+static void writeNumber( ostream& out, uint64 value)
+{
+    char bytes[ 10];
+    size_t size = 0;
+    do
+    {
+        bytes[ size] = value & 0x7f;
+        value >>= 7;
+        if ( value != 0)
+            bytes[ size] |= 0x80;
+        ++size;
+    } while ( value != 0);
+    out.write( bytes, size);
+}
+
+static void writeString( ostream& out, const string& value)
+{
+    writeNumber( out, value.size());
+    out.write( value.data(), value.size());
+}
+
+static bool readNumber( istream& in, uint64& value)
+{
+    value = 0;
+    for ( uint32 shift = 0; shift < 64; shift += 7)
+    {
+        int byte = in.get();
+        if ( byte == EOF)
+            return false;
+        value |= ( uint64)( byte & 0x7f) << shift;
+        if ( ( byte & 0x80) == 0)
+            return true;
+    }
+    return false;
+}
+
+static bool readString( istream& in, string& value)
+{
+    uint64 size = 0;
+    if ( !readNumber( in, size) || size > ( 1 << 20))
+        return false;
+    value.resize( size);
+    return size == 0 || in.read( &value[ 0], size);
+}
+
+StatsSampler::StatsSampler( const StatsRegistry& registry, uint64 interval, ostream& out,
+                            StatsSampleFormat format)
+    : registry( registry), interval( interval == 0 ? 1 : interval), out( out), format( format),
+      next_sample( this->interval), interval_start( 0), num_samples( 0)
+{ }
+
+void StatsSampler::addRatio( const string& name, uint32 numerator, uint32 denominator)
+{
+    if ( num_samples != 0 || numerator >= registry.numValues()
+         || denominator >= registry.numValues())
+    {
+        cerr << "ERROR: ratio \"" << name << "\": wrong values or added after sampling" << endl;
+        exit( EXIT_FAILURE);
+    }
+
+    StatsRatio ratio;
+    ratio.name = name;
+    ratio.numerator = numerator;
+    ratio.denominator = denominator;
+    ratios.push_back( ratio);
+}
+
+void StatsSampler::writeHeader()
+{
+    vector<string> names;
+    registry.valueNames( names);
+
+    if ( format == STATS_SAMPLES_CSV)
+    {
+        out << "start,end";
+        for ( size_t i = 0; i < names.size(); ++i)
+            out << ',' << names[ i];
+        for ( size_t i = 0; i < ratios.size(); ++i)
+            out << ',' << ratios[ i].name;
+        out << endl;
+        return;
+    }
+
+    out.write( SAMPLES_MAGIC, sizeof( SAMPLES_MAGIC));
+    writeNumber( out, SAMPLES_VERSION);
+    writeNumber( out, interval);
+    writeNumber( out, names.size());
+    for ( size_t i = 0; i < names.size(); ++i)
+        writeString( out, names[ i]);
+    writeNumber( out, ratios.size());
+    for ( size_t i = 0; i < ratios.size(); ++i)
+    {
+        writeString( out, ratios[ i].name);
+        writeNumber( out, ratios[ i].numerator);
+        writeNumber( out, ratios[ i].denominator);
+    }
+}
+
+void StatsSampler::writeSample( uint64 end)
+{
+    if ( num_samples == 0)
+    {
+        writeHeader();
+        last.assign( registry.numValues(), 0);
+    }
+
+    registry.aggregate( current);
+    deltas.resize( current.size());
+    for ( size_t i = 0; i < current.size(); ++i)
+        // the values start from zero after a reset of the registry
+        deltas[ i] = current[ i] >= last[ i] ? current[ i] - last[ i] : current[ i];
+    last.swap( current);
+
+    if ( format == STATS_SAMPLES_CSV)
+    {
+        out << interval_start << ',' << end;
+        for ( size_t i = 0; i < deltas.size(); ++i)
+            out << ',' << deltas[ i];
+        // the stream is the caller's, its precision is given back
+        streamsize precision = out.precision( 4);
+        for ( size_t i = 0; i < ratios.size(); ++i)
+        {
+            uint64 denominator = deltas[ ratios[ i].denominator];
+            out << ','
+                << ( denominator == 0 ? 0.0 : ( double)deltas[ ratios[ i].numerator] / denominator);
+        }
+        out.precision( precision);
+        out << '\n';
+    } else
+    {
+        writeNumber( out, end - interval_start);
+        for ( size_t i = 0; i < deltas.size(); ++i)
+            writeNumber( out, deltas[ i]);
+    }
+
+    ++num_samples;
+    interval_start = end;
+}
+
+void StatsSampler::sample( uint64 now)
+{
+    writeSample( now);
+    next_sample = ( now / interval + 1) * interval;
+}
+
+void StatsSampler::finish( uint64 now)
+{
+    if ( now > interval_start || num_samples == 0)
+        writeSample( now);
+    next_sample = ( now / interval + 1) * interval;
+    out.flush();
+}
+
+double StatsSeries::ratio( size_t sample, size_t ratio_num) const
+{
+    uint64 denominator = deltas[ sample][ ratios[ ratio_num].denominator];
+    return denominator == 0 ? 0.0
+                            : ( double)deltas[ sample][ ratios[ ratio_num].numerator] / denominator;
+}
+
+bool readStatsSamples( istream& in, StatsSeries& series, string& error)
+{
+    char magic[ sizeof( SAMPLES_MAGIC)];
+    uint64 version = 0, num_names = 0, num_ratios = 0;
+    if ( !in.read( magic, sizeof( magic))
+         || memcmp( magic, SAMPLES_MAGIC, sizeof( magic)) != 0
+         || !readNumber( in, version) || version != SAMPLES_VERSION)
+    {
+        error = "not a stream of samples of a supported version";
+        return false;
+    }
+
+    series.names.clear();
+    series.ratios.clear();
+    series.ends.clear();
+    series.deltas.clear();
+
+    bool ok = readNumber( in, series.interval) && readNumber( in, num_names);
+    for ( uint64 i = 0; ok && i < num_names; ++i)
+    {
+        string name;
+        ok = readString( in, name);
+        series.names.push_back( name);
+    }
+    ok = ok && readNumber( in, num_ratios);
+    for ( uint64 i = 0; ok && i < num_ratios; ++i)
+    {
+        StatsRatio ratio;
+        uint64 numerator = 0, denominator = 0;
+        ok = readString( in, ratio.name) && readNumber( in, numerator)
+             && readNumber( in, denominator)
+             && numerator < num_names && denominator < num_names;
+        ratio.numerator = numerator;
+        ratio.denominator = denominator;
+        series.ratios.push_back( ratio);
+    }
+    if ( !ok)
+    {
+        error = "broken header";
+        return false;
+    }
+
+    uint64 end = 0;
+    for ( uint64 length = 0; readNumber( in, length); )
+    {
+        vector<uint64> deltas( num_names);
+        for ( uint64 i = 0; i < num_names; ++i)
+        {
+            if ( !readNumber( in, deltas[ i]))
+            {
+                error = "unexpected end of the stream";
+                return false;
+            }
+        }
+        end += length;
+        series.ends.push_back( end);
+        series.deltas.push_back( deltas);
+    }
+    return true;
+}
@@ -0,0 +1,94 @@
+/**
+ * stats_sampler.h - Header of the sampling of the statistics over time.
+ * Every interval of instructions or cycles the changes of all the values
+ * of the registry are written as a row of CSV or of a compact binary stream,
+ * so the phases of long runs are seen.
+ * Copyright 2015 MIPT-MIPS iLab project
+ */
+
+// protection from multi-include
+#ifndef STATS__STATS_SAMPLER_H
+#define STATS__STATS_SAMPLER_H
+
+// Generic C++
+#include <string>
+#include <vector>
+#include <ostream>
+#include <istream>
+
+// uArchSim modules
+#include <types.h>
+#include <stats.h>
+
+using namespace std;
+
+enum StatsSampleFormat
+{
+    STATS_SAMPLES_CSV,
+    STATS_SAMPLES_BINARY
+};
+
+// A metric of an interval computed from the changes of two values,
+// e.g. IPC is instructions by cycles, a miss rate is misses by accesses
+struct StatsRatio
+{
+    string name;
+    uint32 numerator;
+    uint32 denominator;
+};
+
+class StatsSampler
+{
+        const StatsRegistry& registry;
+        const uint64 interval;
+        ostream& out;
+        const StatsSampleFormat format;
+
+        vector<StatsRatio> ratios;
+        vector<uint64> last;    // the values at the start of the interval
+        vector<uint64> current;
+        vector<uint64> deltas;
+        uint64 next_sample;
+        uint64 interval_start;
+        uint64 num_samples;
+
+        void writeHeader();
+        void writeSample( uint64 end);
+
+    public:
+        // The time is counted in the units given to tick(): instructions or cycles
+        StatsSampler( const StatsRegistry& registry, uint64 interval, ostream& out,
+                      StatsSampleFormat format = STATS_SAMPLES_CSV);
+
+        // The ratios are added before the first sample
+        void addRatio( const string& name, uint32 numerator, uint32 denominator);
+
+        // Called by the simulation as often as it likes, a sample is taken
+        // only at the end of an interval, so the check is the common case
+        inline void tick( uint64 now)
+        {
+            if ( now >= next_sample)
+                sample( now);
+        }
+        void sample( uint64 now);
+        // Writes the last partial interval
+        void finish( uint64 now);
+
+        uint64 numSamples() const { return num_samples; }
+};
+
+// The content of a binary stream of samples
+struct StatsSeries
+{
+    uint64 interval;
+    vector<string> names;
+    vector<StatsRatio> ratios;
+    vector<uint64> ends;            // the time at the end of each sample
+    vector<vector<uint64> > deltas; // the changes of the values in each sample
+
+    double ratio( size_t sample, size_t ratio_num) const;
+};
+
+bool readStatsSamples( istream& in, StatsSeries& series, string& error /*used as output*/);
+
+#endif // #ifndef STATS__STATS_SAMPLER_H
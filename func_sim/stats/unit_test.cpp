@@ -0,0 +1,237 @@
+// generic C
+#include <cassert>
+#include <cstdlib>
+
+// Generic C++
+#include <sstream>
+#include <thread>
+
+// Google Test library
+#include <gtest/gtest.h>
+
+// uArchSim modules
+#include <stats.h>
+#include <stats_sampler.h>
+
+TEST( Stats, Counters_Of_Threads)
+{
+    StatsRegistry registry;
+    uint32 accesses = registry.addCounter( "core0.l1d.accesses");
+    uint32 misses = registry.addCounter( "core0.l1d.misses");
+
+    // each thread increments its own block
+    const uint32 num_threads = 4;
+    const uint64 num = 100000;
+    vector<thread> threads;
+    for ( uint32 t = 0; t < num_threads; ++t)
+        threads.push_back( thread( [ & ]()
+        {
+            StatsBlock* block = registry.createBlock();
+            for ( uint64 i = 0; i < num; ++i)
+            {
+                block->inc( accesses);
+                if ( i % 10 == 0)
+                    block->inc( misses);
+            }
+        }));
+    for ( uint32 t = 0; t < num_threads; ++t)
+        threads[ t].join();
+
+    vector<uint64> values;
+    registry.aggregate( values);
+    ASSERT_EQ( values.size(), 2u);
+    ASSERT_EQ( values[ accesses], num_threads * num);
+    ASSERT_EQ( values[ misses], num_threads * num / 10);
+
+    registry.reset();
+    registry.aggregate( values);
+    ASSERT_EQ( values[ accesses], 0u);
+}
+
+TEST( Stats, Histograms)
+{
+    StatsRegistry registry;
+    StatsHistogram latency = registry.addHistogram( "mem.latency", 4, 10);
+    StatsBlock* block = registry.createBlock();
+
+    block->sample( latency, 0);
+    block->sample( latency, 9);
+    block->sample( latency, 25);
+    block->sample( latency, 1000); // above the range
+
+    ASSERT_EQ( block->get( latency.offset), 2u);
+    ASSERT_EQ( block->get( latency.offset + 1), 0u);
+    ASSERT_EQ( block->get( latency.offset + 2), 1u);
+    ASSERT_EQ( block->get( latency.offset + 3), 1u);
+}
+
+static void fillRegistry( StatsRegistry& registry)
+{
+    uint32 branches = registry.addCounter( "core0.bp.branches", "conditional branches");
+    uint32 misses = registry.addCounter( "core0.l1d.misses");
+    uint32 pages = registry.addCounter( "memory.pages");
+    StatsHistogram hist = registry.addHistogram( "core0.l1d.latency", 2, 4);
+
+    StatsBlock* block = registry.createBlock();
+    block->inc( branches, 7);
+    block->inc( misses, 3);
+    block->inc( pages, 12);
+    block->sample( hist, 1);
+    block->sample( hist, 5);
+    block->sample( hist, 6);
+}
+
+TEST( Stats, Output)
+{
+    StatsRegistry registry;
+    fillRegistry( registry);
+
+    ostringstream text;
+    registry.writeText( text);
+    ASSERT_EQ( text.str(), "core0.bp.branches 7 # conditional branches\n"
+                           "core0.l1d.latency::0-3 1\n"
+                           "core0.l1d.latency::4+ 2\n"
+                           "core0.l1d.misses 3\n"
+                           "memory.pages 12\n");
+
+    ostringstream csv;
+    registry.writeCsv( csv);
+    ASSERT_EQ( csv.str(), "name,value\n"
+                          "core0.bp.branches,7\n"
+                          "core0.l1d.latency::0-3,1\n"
+                          "core0.l1d.latency::4+,2\n"
+                          "core0.l1d.misses,3\n"
+                          "memory.pages,12\n");
+
+    ostringstream json;
+    registry.writeJson( json);
+    ASSERT_EQ( json.str(), "{\n"
+                           "  \"core0\": {\n"
+                           "    \"bp\": {\n"
+                           "      \"branches\": 7\n"
+                           "    },\n"
+                           "    \"l1d\": {\n"
+                           "      \"latency\": {\"bucket_size\": 4, \"buckets\": [1, 2]},\n"
+                           "      \"misses\": 3\n"
+                           "    }\n"
+                           "  },\n"
+                           "  \"memory\": {\n"
+                           "    \"pages\": 12\n"
+                           "  }\n"
+                           "}\n");
+}
+
+TEST( Stats, Wrong_Names)
+{
+    StatsRegistry registry;
+    registry.addCounter( "core0.l1d");
+
+    ASSERT_EXIT( registry.addCounter( "core0.l1d"), ::testing::ExitedWithCode( EXIT_FAILURE), "twice");
+    ASSERT_EXIT( registry.addCounter( "core0.l1d.misses"), ::testing::ExitedWithCode( EXIT_FAILURE), "conflicts");
+    ASSERT_EXIT( registry.addCounter( "core0..misses"), ::testing::ExitedWithCode( EXIT_FAILURE), "wrong name");
+    ASSERT_EXIT( registry.addCounter( "core0.l1d-misses"), ::testing::ExitedWithCode( EXIT_FAILURE), "wrong name");
+
+    registry.createBlock();
+    ASSERT_EXIT( registry.addCounter( "core1.l1d"), ::testing::ExitedWithCode( EXIT_FAILURE), "after");
+}
+
+//
+// Two phases of 3 intervals: IPC 1 with no misses and IPC 0.5 with
+// a miss per 10 instructions, the cycles are the time of the sampler
+//
+static void runPhases( StatsSampler& sampler, StatsBlock* block,
+                       uint32 instructions, uint32 cycles, uint32 misses)
+{
+    const uint64 interval = 1000;
+    uint64 cycle = 0;
+    for ( uint64 i = 0; cycle < 6 * interval; ++i)
+    {
+        bool second = cycle >= 3 * interval;
+        block->inc( instructions);
+        block->inc( cycles, second ? 2 : 1);
+        cycle += second ? 2 : 1;
+        if ( second && i % 10 == 0)
+            block->inc( misses);
+        sampler.tick( cycle);
+    }
+    sampler.finish( cycle + 100);
+}
+
+TEST( Stats_sampler, Csv)
+{
+    StatsRegistry registry;
+    uint32 instructions = registry.addCounter( "core0.instructions");
+    uint32 cycles = registry.addCounter( "core0.cycles");
+    uint32 misses = registry.addCounter( "core0.l1d.misses");
+    StatsBlock* block = registry.createBlock();
+
+    ostringstream csv;
+    csv.precision( 10);
+    StatsSampler sampler( registry, 1000, csv);
+    sampler.addRatio( "ipc", instructions, cycles);
+    runPhases( sampler, block, instructions, cycles, misses);
+    ASSERT_EQ( csv.precision(), 10);
+
+    // 6 full intervals and the partial one of the end without changes
+    ASSERT_EQ( sampler.numSamples(), 7u);
+
+    istringstream lines( csv.str());
+    string line;
+    getline( lines, line);
+    ASSERT_EQ( line, "start,end,core0.instructions,core0.cycles,core0.l1d.misses,ipc");
+    getline( lines, line);
+    ASSERT_EQ( line, "0,1000,1000,1000,0,1");
+    for ( uint32 i = 0; i < 3; ++i)
+        getline( lines, line);
+    ASSERT_EQ( line, "3000,4000,500,1000,50,0.5");
+    for ( uint32 i = 0; i < 3; ++i)
+        getline( lines, line);
+    ASSERT_EQ( line, "6000,6100,0,0,0,0");
+}
+
+TEST( Stats_sampler, Binary)
+{
+    StatsRegistry registry;
+    uint32 instructions = registry.addCounter( "core0.instructions");
+    uint32 cycles = registry.addCounter( "core0.cycles");
+    uint32 misses = registry.addCounter( "core0.l1d.misses");
+    StatsBlock* block = registry.createBlock();
+
+    stringstream stream;
+    StatsSampler sampler( registry, 1000, stream, STATS_SAMPLES_BINARY);
+    sampler.addRatio( "ipc", instructions, cycles);
+    runPhases( sampler, block, instructions, cycles, misses);
+
+    // a couple of bytes per value of a sample
+    ASSERT_LT( stream.str().size(), 200u);
+
+    StatsSeries series;
+    string error;
+    ASSERT_TRUE( readStatsSamples( stream, series, error)) << error;
+    ASSERT_EQ( series.interval, 1000u);
+    ASSERT_EQ( series.names.size(), 3u);
+    ASSERT_EQ( series.names[ 2], "core0.l1d.misses");
+    ASSERT_EQ( series.ratios.size(), 1u);
+    ASSERT_EQ( series.ends.size(), 7u);
+    ASSERT_EQ( series.ends[ 0], 1000u);
+    ASSERT_EQ( series.ends[ 6], 6100u);
+    ASSERT_DOUBLE_EQ( series.ratio( 0, 0), 1.0);
+    ASSERT_DOUBLE_EQ( series.ratio( 4, 0), 0.5);
+    ASSERT_EQ( series.deltas[ 4][ misses], 50u);
+
+    // the totals are the sums of the samples
+    uint64 total = 0;
+    for ( size_t i = 0; i < series.deltas.size(); ++i)
+        total += series.deltas[ i][ instructions];
+    ASSERT_EQ( total, block->get( instructions));
+
+    istringstream broken( "MIPSSAMP");
+    ASSERT_FALSE( readStatsSamples( broken, series, error));
+}
+
+int main( int argc, char* argv[])
+{
+    ::testing::InitGoogleTest( &argc, argv);
+    ::testing::FLAGS_gtest_death_test_style = "threadsafe";
+    return RUN_ALL_TESTS();
+}
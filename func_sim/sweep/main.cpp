@@ -0,0 +1,75 @@
+// Generic C
+#include <string.h>
+#include <stdlib.h>
+
+// Generic C++
+#include <iostream>
+#include <fstream>
+#include <thread>
+
+// uArchSim modules
+#include <sweep.h>
+
+using namespace std;
+
+static void printUsage( const char* program)
+{
+    cout << "This program runs every configuration from the given file" << endl
+         << "on every given ELF binary and prints one CSV row per run." << endl
+         << "Each line of the configurations file is \"<name> <key>=<value> ...\"." << endl
+         << endl
+         << "Usage: \"" << program << " [-j <threads>] <configurations file>"
+         << " <ELF binary> [<ELF binary> ...]\"" << endl;
+}
+
+int main ( int argc, char* argv[])
+{
+    if ( argc == 2 && !strcmp( argv[ 1], "--help"))
+    {
+        printUsage( argv[ 0]);
+        return 0;
+    }
+
+    size_t num_threads = thread::hardware_concurrency();
+    int arg = 1;
+    if ( arg + 1 < argc && !strcmp( argv[ arg], "-j"))
+    {
+        num_threads = strtoul( argv[ arg + 1], NULL, 10);
+        arg += 2;
+    }
+    if ( num_threads == 0)
+        num_threads = 1;
+
+    if ( argc - arg < 2)
+    {
+        cerr << "ERROR: too few arguments!" << endl
+             << "Type \"" << argv[ 0] << " --help\" for usage." << endl;
+        exit( EXIT_FAILURE);
+    }
+
+    Sweep sweep;
+
+    ifstream configs_file( argv[ arg]);
+    string error;
+    if ( !configs_file)
+    {
+        cerr << "ERROR: Could not open file " << argv[ arg] << endl;
+        exit( EXIT_FAILURE);
+    }
+    if ( !sweep.readConfigs( configs_file, error))
+    {
+        cerr << "ERROR: " << argv[ arg] << ": " << error << endl;
+        exit( EXIT_FAILURE);
+    }
+
+    // each binary is parsed only once for all the configurations
+    for ( ++arg; arg < argc; ++arg)
+        sweep.addBinary( argv[ arg]);
+
+    FuncMemorySimulation simulation;
+    vector<SweepResult> results;
+    sweep.run( simulation, num_threads, results);
+    sweep.writeCsv( simulation, results, cout);
+
+    return 0;
+}
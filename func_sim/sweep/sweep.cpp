@@ -0,0 +1,233 @@
+/**
+ * sweep.cpp - Implementation of the configuration sweep runner.
+ * Copyright 2015 MIPT-MIPS iLab project
+ */
+
+// Generic C
+#include <cstdlib>
+
+// Generic C++
+#include <sstream>
+#include <chrono>
+#include <algorithm>
+#include <new>
+
+// uArchSim modules
+#include <sweep.h>
+#include <work_stealing_pool.h>
+#include <func_memory.h>
+
+using namespace std;
+
+uint64 SweepConfig::getUint( const string& key, uint64 default_value, bool& ok) const
+{
+    map<string, string>::const_iterator it = params.find( key);
+    if ( it == params.end())
+        return default_value;
+
+    char* end = NULL;
+    uint64 value = strtoull( it->second.c_str(), &end, 0);
+    if ( it->second.empty() || *end != '\0')
+        ok = false;
+
+    return value;
+}
+
+bool SweepConfig::parse( const string& line, SweepConfig& config, string& error)
+{
+    istringstream iss( line);
+
+    config.params.clear();
+    if ( !( iss >> config.name))
+    {
+        error = "configuration has no name";
+        return false;
+    }
+
+    string param;
+    while ( iss >> param)
+    {
+        size_t eq = param.find( '=');
+        if ( eq == string::npos || eq == 0)
+        {
+            error = "parameter \"" + param + "\" of configuration \""
+                    + config.name + "\" is not in form <key>=<value>";
+            return false;
+        }
+        config.params[ param.substr( 0, eq)] = param.substr( eq + 1);
+    }
+    return true;
+}
+
+vector<string> FuncMemorySimulation::columns() const
+{
+    vector<string> names;
+    names.push_back( "start_pc");
+    names.push_back( "bytes");
+    names.push_back( "checksum");
+    names.push_back( "host_seconds");
+    return names;
+}
+
+void FuncMemorySimulation::run( const SweepConfig& config,
+                                const vector<ElfSection>& sections,
+                                bool big_endian,
+                                SweepResult& result) const
+{
+    bool ok = true;
+    uint64 addr_bits = config.getUint( "addr_bits", 32, ok);
+    uint64 page_bits = config.getUint( "page_bits", 10, ok);
+    uint64 offset_bits = config.getUint( "offset_bits", 12, ok);
+
+    if ( !ok)
+    {
+        result.error = "memory geometry parameters must be numbers";
+        return;
+    }
+    if ( !FuncMemory::checkGeometry( addr_bits, page_bits, offset_bits, result.error))
+        return;
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+    FuncMemory func_mem( sections, addr_bits, page_bits, offset_bits, big_endian);
+
+    uint64 bytes = 0;
+    uint64 checksum = 0;
+    for ( size_t i = 0; i < sections.size(); ++i)
+    {
+        for ( uint64 offset = 0; offset < sections[ i].size; offset += sizeof( uint32))
+        {
+            unsigned short num = sections[ i].size - offset < sizeof( uint32)
+                                 ? sections[ i].size - offset
+                                 : sizeof( uint32);
+            checksum = checksum * 31 + func_mem.read( sections[ i].start_addr + offset, num);
+            bytes += num;
+        }
+    }
+
+    double seconds = chrono::duration<double>( chrono::steady_clock::now() - start).count();
+
+    ostringstream oss;
+    oss << hex << "0x" << func_mem.startPC();
+    result.values.push_back( oss.str());
+
+    oss.str( "");
+    oss << dec << bytes;
+    result.values.push_back( oss.str());
+
+    oss.str( "");
+    oss << hex << "0x" << checksum;
+    result.values.push_back( oss.str());
+
+    oss.str( "");
+    oss << dec << seconds;
+    result.values.push_back( oss.str());
+
+    result.ok = true;
+}
+
+Sweep::~Sweep()
+{
+    for ( size_t i = 0; i < binaries.size(); ++i)
+        delete binaries[ i];
+}
+
+void Sweep::addConfig( const SweepConfig& config)
+{
+    configs.push_back( config);
+}
+
+bool Sweep::readConfigs( istream& in, string& error)
+{
+    string line;
+    for ( size_t line_num = 1; getline( in, line); ++line_num)
+    {
+        size_t first = line.find_first_not_of( " \t\r");
+        if ( first == string::npos || line[ first] == '#')
+            continue;
+
+        SweepConfig config;
+        if ( !SweepConfig::parse( line, config, error))
+        {
+            ostringstream oss;
+            oss << "line " << line_num << ": " << error;
+            error = oss.str();
+            return false;
+        }
+        addConfig( config);
+    }
+    return true;
+}
+
+void Sweep::addBinary( const char* elf_file_name)
+{
+    Binary* binary = new Binary;
+    binary->name = elf_file_name;
+    binary->big_endian = false;
+    if ( !ElfSection::tryGetAllElfSections( elf_file_name, binary->sections, binary->error)
+         || !ElfSection::tryGetDataEncoding( elf_file_name, binary->big_endian, binary->error))
+        binary->sections.clear();
+    binaries.push_back( binary);
+}
+
+void Sweep::run( const SweepSimulation& simulation, size_t num_threads,
+                 vector<SweepResult>& results) const
+{
+    results.assign( jobs(), SweepResult());
+
+    WorkStealingPool pool( num_threads);
+    pool.run( jobs(), [ this, &simulation, &results]( size_t job)
+    {
+        const SweepConfig& config = configs[ job / binaries.size()];
+        const Binary* binary = binaries[ job % binaries.size()];
+        if ( !binary->error.empty())
+        {
+            results[ job].error = binary->error;
+            return;
+        }
+
+        // the host running out of memory fails the job, not the whole sweep
+        try
+        {
+            simulation.run( config, binary->sections, binary->big_endian, results[ job]);
+        } catch ( const bad_alloc&)
+        {
+            results[ job] = SweepResult();
+            results[ job].error = "not enough host memory";
+        }
+    });
+}
+
+void Sweep::writeCsv( const SweepSimulation& simulation,
+                      const vector<SweepResult>& results, ostream& out) const
+{
+    vector<string> columns = simulation.columns();
+
+    out << "config,binary,status";
+    for ( size_t i = 0; i < columns.size(); ++i)
+        out << ',' << columns[ i];
+    out << endl;
+
+    for ( size_t job = 0; job < results.size(); ++job)
+    {
+        out << configs[ job / binaries.size()].name << ','
+            << binaries[ job % binaries.size()]->name << ',';
+
+        if ( results[ job].ok)
+        {
+            out << "ok";
+            for ( size_t i = 0; i < results[ job].values.size(); ++i)
+                out << ',' << results[ job].values[ i];
+        } else
+        {
+            // the error goes to the 1st value column and the rest is empty;
+            // commas in the error would split it into columns
+            string error = results[ job].error;
+            replace( error.begin(), error.end(), ',', ';');
+            out << "failed," << error;
+            for ( size_t i = 1; i < columns.size(); ++i)
+                out << ',';
+        }
+        out << endl;
+    }
+}
@@ -0,0 +1,120 @@
+/**
+ * sweep.h - Header of the configuration sweep runner.
+ * It runs every configuration on every binary as a separate job
+ * and writes one result row per job.
+ * Copyright 2015 MIPT-MIPS iLab project
+ */
+
+// protection from multi-include
+#ifndef SWEEP__SWEEP_H
+#define SWEEP__SWEEP_H
+
+// Generic C++
+#include <string>
+#include <vector>
+#include <map>
+#include <iostream>
+
+// uArchSim modules
+#include <types.h>
+#include <elf_parser.h>
+
+struct SweepConfig
+{
+    string name;
+    map<string, string> params;
+
+    // Returns the parameter value or default_value if it is not specified.
+    // Sets ok to false if the value is not a number.
+    uint64 getUint( const string& key, uint64 default_value, bool& ok) const;
+
+    // Parses a line of the form "<name> <key>=<value> <key>=<value> ..."
+    static bool parse( const string& line, SweepConfig& config /*used as output*/,
+                       string& error /*used as output*/);
+};
+
+struct SweepResult
+{
+    bool ok;
+    string error;          // the reason of the failure if not ok
+    vector<string> values; // in the order of SweepSimulation::columns()
+
+    SweepResult() : ok( false) { }
+};
+
+// The model run by each job
+class SweepSimulation
+{
+    public:
+        virtual ~SweepSimulation() { }
+
+        // names of the values reported by run()
+        virtual vector<string> columns() const = 0;
+
+        // Runs one job. It is called from many threads at once,
+        // so it must not change any state shared between the jobs.
+        virtual void run( const SweepConfig& config,
+                          const vector<ElfSection>& sections,
+                          bool big_endian,
+                          SweepResult& result /*used as output*/) const = 0;
+};
+
+//
+// Builds the functional memory with the geometry given by the
+// "addr_bits", "page_bits" and "offset_bits" parameters
+// and reads the whole loaded image through it.
+//
+class FuncMemorySimulation : public SweepSimulation
+{
+    public:
+        vector<string> columns() const;
+        void run( const SweepConfig& config,
+                  const vector<ElfSection>& sections,
+                  bool big_endian,
+                  SweepResult& result) const;
+};
+
+class Sweep
+{
+        struct Binary
+        {
+            string name;
+            vector<ElfSection> sections;
+            bool big_endian;
+            string error; // why the binary could not be loaded, empty if it is loaded
+        };
+
+        vector<SweepConfig> configs;
+        vector<Binary*> binaries;
+
+        // the sweep is not copyable
+        Sweep( const Sweep&);
+        Sweep& operator=( const Sweep&);
+
+    public:
+        Sweep() { }
+        virtual ~Sweep();
+
+        void addConfig( const SweepConfig& config);
+
+        // Reads configurations one per line, empty lines and lines
+        // starting with '#' are skipped.
+        bool readConfigs( istream& in, string& error /*used as output*/);
+
+        // The binary is parsed once here and shared by all its jobs.
+        // If it cannot be loaded, all its jobs fail with the loading error.
+        void addBinary( const char* elf_file_name);
+
+        inline size_t jobs() const { return configs.size() * binaries.size(); }
+
+        // Runs all the jobs on num_threads threads and returns
+        // the results in order "all binaries for the 1st config, ...".
+        void run( const SweepSimulation& simulation, size_t num_threads,
+                  vector<SweepResult>& results /*used as output*/) const;
+
+        // Writes the results as CSV, one row per job.
+        void writeCsv( const SweepSimulation& simulation,
+                       const vector<SweepResult>& results, ostream& out) const;
+};
+
+#endif // #ifndef SWEEP__SWEEP_H
@@ -0,0 +1,160 @@
+// generic C
+#include <cassert>
+#include <cstdlib>
+
+// Generic C++
+#include <sstream>
+#include <atomic>
+#include <new>
+
+// Google Test library
+#include <gtest/gtest.h>
+
+// uArchSim modules
+#include <sweep.h>
+#include <work_stealing_pool.h>
+
+static const char * valid_elf_file = "./mips_bin_exmpl.out";
+
+TEST( Work_stealing_pool, Runs_Each_Job_Once)
+{
+    const size_t num_jobs = 1000;
+    std::vector<std::atomic<int> > runs( num_jobs);
+    for ( size_t i = 0; i < num_jobs; ++i)
+        runs[ i] = 0;
+
+    WorkStealingPool pool( 4);
+    pool.run( num_jobs, [ &runs]( size_t job) { ++runs[ job]; });
+
+    for ( size_t i = 0; i < num_jobs; ++i)
+        ASSERT_EQ( runs[ i], 1);
+}
+
+TEST( Sweep_config, Parse)
+{
+    SweepConfig config;
+    string error;
+
+    ASSERT_TRUE( SweepConfig::parse( "small page_bits=8 offset_bits=0x8", config, error));
+    ASSERT_EQ( config.name, "small");
+
+    bool ok = true;
+    ASSERT_EQ( config.getUint( "page_bits", 10, ok), 8ull);
+    ASSERT_EQ( config.getUint( "offset_bits", 12, ok), 8ull);
+    ASSERT_EQ( config.getUint( "addr_bits", 32, ok), 32ull);
+    ASSERT_TRUE( ok);
+
+    ASSERT_TRUE( SweepConfig::parse( "bad page_bits=big", config, error));
+    config.getUint( "page_bits", 10, ok);
+    ASSERT_FALSE( ok);
+
+    ASSERT_FALSE( SweepConfig::parse( "broken page_bits", config, error));
+    ASSERT_FALSE( SweepConfig::parse( "   ", config, error));
+}
+
+TEST( Sweep, Run_All_Jobs)
+{
+    Sweep sweep;
+    string error;
+    istringstream configs( "# name and memory geometry\n"
+                           "default\n"
+                           "\n"
+                           "small_pages page_bits=12 offset_bits=8\n"
+                           "too_big page_bits=20 offset_bits=20\n"
+                           "huge_sets page_bits=1 offset_bits=2\n");
+    ASSERT_TRUE( sweep.readConfigs( configs, error));
+
+    sweep.addBinary( valid_elf_file);
+    sweep.addBinary( valid_elf_file);
+    ASSERT_EQ( sweep.jobs(), 8u);
+
+    FuncMemorySimulation simulation;
+    vector<SweepResult> results;
+    sweep.run( simulation, 3, results);
+    ASSERT_EQ( results.size(), 8u);
+
+    // the same binary gives the same result with any memory geometry
+    for ( size_t i = 0; i < 4; ++i)
+    {
+        ASSERT_TRUE( results[ i].ok);
+        ASSERT_EQ( results[ i].values[ 0], "0x4000b0");
+        ASSERT_EQ( results[ i].values[ 1], results[ 0].values[ 1]);
+        ASSERT_EQ( results[ i].values[ 2], results[ 0].values[ 2]);
+    }
+
+    // a bad configuration fails only its own jobs
+    ASSERT_FALSE( results[ 4].ok);
+    ASSERT_FALSE( results[ 5].ok);
+
+    // the table of the sets would take 4 GB
+    ASSERT_FALSE( results[ 6].ok);
+    ASSERT_NE( results[ 6].error.find( "too large"), string::npos);
+
+    ostringstream csv;
+    sweep.writeCsv( simulation, results, csv);
+    string first_line = csv.str().substr( 0, csv.str().find( '\n'));
+    ASSERT_EQ( first_line, "config,binary,status,start_pc,bytes,checksum,host_seconds");
+    ASSERT_NE( csv.str().find( "too_big,./mips_bin_exmpl.out,failed,"), string::npos);
+}
+
+TEST( Sweep, Bad_Binary_Fails_Only_Its_Jobs)
+{
+    Sweep sweep;
+    SweepConfig config;
+    string error;
+    ASSERT_TRUE( SweepConfig::parse( "default", config, error));
+    sweep.addConfig( config);
+
+    sweep.addBinary( "./1234567890/qwertyuiop");
+    sweep.addBinary( valid_elf_file);
+
+    FuncMemorySimulation simulation;
+    vector<SweepResult> results;
+    sweep.run( simulation, 2, results);
+
+    ASSERT_FALSE( results[ 0].ok);
+    ASSERT_NE( results[ 0].error.find( "Could not open file"), string::npos);
+    ASSERT_TRUE( results[ 1].ok);
+}
+
+//
+// A simulation that runs out of the host memory in its 1st job
+//
+class OutOfMemorySimulation : public SweepSimulation
+{
+    public:
+        vector<string> columns() const { return vector<string>( 1, "value"); }
+
+        void run( const SweepConfig& config, const vector<ElfSection>& sections,
+                  bool big_endian, SweepResult& result) const
+        {
+            if ( config.name == "greedy")
+                throw std::bad_alloc();
+            result.values.push_back( "1");
+            result.ok = true;
+        }
+};
+
+TEST( Sweep, Out_Of_Memory_Fails_Only_Its_Jobs)
+{
+    Sweep sweep;
+    istringstream configs( "greedy\nmodest\n");
+    string error;
+    ASSERT_TRUE( sweep.readConfigs( configs, error));
+    sweep.addBinary( valid_elf_file);
+
+    OutOfMemorySimulation simulation;
+    vector<SweepResult> results;
+    sweep.run( simulation, 2, results);
+
+    ASSERT_FALSE( results[ 0].ok);
+    ASSERT_NE( results[ 0].error.find( "memory"), string::npos);
+    ASSERT_TRUE( results[ 1].ok);
+}
+
+int main( int argc, char* argv[])
+{
+    ::testing::InitGoogleTest( &argc, argv);
+    ::testing::FLAGS_gtest_death_test_style = "threadsafe";
+    return RUN_ALL_TESTS();
+}
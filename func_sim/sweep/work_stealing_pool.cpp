@@ -0,0 +1,87 @@
+/**
+ * work_stealing_pool.cpp - thread pool running a fixed set of jobs.
+ * Copyright 2015 MIPT-MIPS iLab project
+ */
+
+// Generic C
+#include <cassert>
+
+// Generic C++
+#include <thread>
+
+// uArchSim modules
+#include <work_stealing_pool.h>
+
+WorkStealingPool::WorkStealingPool( size_t num_threads)
+    : num_threads( num_threads), num_steals( 0)
+{
+    assert( num_threads != 0);
+
+    for ( size_t i = 0; i < num_threads; ++i)
+        workers.push_back( new Worker);
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+    for ( size_t i = 0; i < num_threads; ++i)
+        delete workers[ i];
+}
+
+bool WorkStealingPool::takeOwn( size_t worker, size_t& job)
+{
+    std::lock_guard<std::mutex> guard( workers[ worker]->lock);
+    if ( workers[ worker]->jobs.empty())
+        return false;
+
+    // the owner takes jobs from the back...
+    job = workers[ worker]->jobs.back();
+    workers[ worker]->jobs.pop_back();
+    return true;
+}
+
+bool WorkStealingPool::steal( size_t thief, size_t& job)
+{
+    for ( size_t i = 1; i < num_threads; ++i)
+    {
+        Worker* victim = workers[ ( thief + i) % num_threads];
+        std::lock_guard<std::mutex> guard( victim->lock);
+        if ( !victim->jobs.empty())
+        {
+            // ...and the thieves from the front
+            job = victim->jobs.front();
+            victim->jobs.pop_front();
+
+            std::lock_guard<std::mutex> steals_guard( steals_lock);
+            ++num_steals;
+            return true;
+        }
+    }
+    return false;
+}
+
+void WorkStealingPool::work( size_t worker, const std::function<void( size_t)>& job)
+{
+    // all the jobs are queued before the workers start,
+    // so a worker finishes as soon as it can find nothing to do
+    size_t next;
+    while ( takeOwn( worker, next) || steal( worker, next))
+        job( next);
+}
+
+void WorkStealingPool::run( size_t num_jobs, const std::function<void( size_t)>& job)
+{
+    // distribute the jobs round-robin, so that the neighbour
+    // jobs which are usually of the same size go to different workers
+    for ( size_t i = 0; i < num_jobs; ++i)
+        workers[ i % num_threads]->jobs.push_front( i);
+
+    std::vector<std::thread> threads;
+    for ( size_t i = 1; i < num_threads; ++i)
+        threads.push_back( std::thread( &WorkStealingPool::work, this, i, std::cref( job)));
+
+    // the calling thread is the worker number 0
+    work( 0, job);
+
+    for ( size_t i = 0; i < threads.size(); ++i)
+        threads[ i].join();
+}
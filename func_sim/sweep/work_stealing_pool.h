@@ -0,0 +1,53 @@
+/**
+ * work_stealing_pool.h - thread pool running a fixed set of jobs.
+ * Each worker takes jobs from its own queue and steals from
+ * the other workers' queues when its own one is empty.
+ * Copyright 2015 MIPT-MIPS iLab project
+ */
+
+// protection from multi-include
+#ifndef SWEEP__WORK_STEALING_POOL_H
+#define SWEEP__WORK_STEALING_POOL_H
+
+// Generic C++
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <functional>
+
+// uArchSim modules
+#include <types.h>
+
+class WorkStealingPool
+{
+        struct Worker
+        {
+            std::mutex lock;
+            std::deque<size_t> jobs;
+        };
+
+        const size_t num_threads;
+        std::vector<Worker*> workers;
+        uint64 num_steals;
+        std::mutex steals_lock;
+
+        bool takeOwn( size_t worker, size_t& job);
+        bool steal( size_t thief, size_t& job);
+        void work( size_t worker, const std::function<void( size_t)>& job);
+
+        // the pool is not copyable
+        WorkStealingPool( const WorkStealingPool&);
+        WorkStealingPool& operator=( const WorkStealingPool&);
+
+    public:
+        WorkStealingPool( size_t num_threads);
+        virtual ~WorkStealingPool();
+
+        // Calls job( i) for each i in [0, num_jobs) and returns when all the calls are done.
+        void run( size_t num_jobs, const std::function<void( size_t)>& job);
+
+        inline size_t threads() const { return num_threads; }
+        inline uint64 steals() const { return num_steals; }
+};
+
+#endif // #ifndef SWEEP__WORK_STEALING_POOL_H
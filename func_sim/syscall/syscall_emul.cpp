@@ -0,0 +1,459 @@
+/**
+ * syscall_emul.cpp - Implementation of the emulation of the system calls
+ * of the guest programs.
+ * Copyright 2015 MIPT-MIPS iLab project
+ */
+
+// Generic C
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Generic C++
+#include <sstream>
+#include <algorithm>
+
+// uArchSim modules
+#include <syscall_emul.h>
+
+// the numbers of SPIM calls
+enum SpimCall
+{
+    SPIM_PRINT_INT = 1,
+    SPIM_PRINT_STRING = 4,
+    SPIM_READ_INT = 5,
+    SPIM_READ_STRING = 8,
+    SPIM_SBRK = 9,
+    SPIM_EXIT = 10,
+    SPIM_PRINT_CHAR = 11,
+    SPIM_READ_CHAR = 12,
+    SPIM_OPEN = 13,
+    SPIM_READ = 14,
+    SPIM_WRITE = 15,
+    SPIM_CLOSE = 16,
+    SPIM_EXIT2 = 17
+};
+
+// the numbers of Linux O32 calls
+enum O32Call
+{
+    O32_EXIT = 4001,
+    O32_READ = 4003,
+    O32_WRITE = 4004,
+    O32_OPEN = 4005,
+    O32_CLOSE = 4006,
+    O32_BRK = 4045,
+    O32_IOCTL = 4054,
+    O32_MMAP = 4090,
+    O32_MUNMAP = 4091,
+    O32_MPROTECT = 4125,
+    O32_WRITEV = 4146,
+    O32_EXIT_GROUP = 4246
+};
+
+// the flags of MIPS Linux differ from the ones of the other hosts
+static const uint32 MIPS_O_ACCMODE = 0x0003;
+static const uint32 MIPS_O_APPEND = 0x0008;
+static const uint32 MIPS_O_CREAT = 0x0100;
+static const uint32 MIPS_O_TRUNC = 0x0200;
+static const uint32 MIPS_O_EXCL = 0x0400;
+static const uint32 MIPS_MAP_FIXED = 0x0010;
+static const uint32 MIPS_MAP_ANONYMOUS = 0x0800;
+
+// the PROT_* bits of MIPS Linux are the same as the MEM_* ones
+static const uint32 MIPS_PROT_MASK = MEM_READ | MEM_WRITE | MEM_EXEC;
+// the largest chunk of a copy between the host and the guest
+static const uint64 COPY_CHUNK = 1 << 20;
+
+SyscallEmulator::SyscallEmulator( int stdin_fd, int stdout_fd, int stderr_fd)
+    : exit_code( 0)
+{
+    int standard[] = { stdin_fd, stdout_fd, stderr_fd};
+    for ( size_t i = 0; i < 3; ++i)
+    {
+        GuestFile file = { standard[ i], false};
+        files.push_back( file);
+    }
+}
+
+SyscallEmulator::~SyscallEmulator()
+{
+    for ( size_t i = 0; i < files.size(); ++i)
+        if ( files[ i].owned && files[ i].host_fd != -1)
+            close( files[ i].host_fd);
+}
+
+int SyscallEmulator::hostFd( uint32 fd) const
+{
+    return fd < files.size() ? files[ fd].host_fd : -1;
+}
+
+bool SyscallEmulator::readString( const FuncMemory& memory, uint64 addr, string& value) const
+{
+    // page by page, so the string can end right before an unmapped page
+    value.clear();
+    uint8 chunk[ 256];
+    while ( value.size() < COPY_CHUNK)
+    {
+        uint64 size = min<uint64>( sizeof( chunk), memory.pageSize() - ( addr & ( memory.pageSize() - 1)));
+        if ( !memory.tryReadBlock( addr, chunk, size))
+            return false;
+
+        const uint8* end = ( const uint8*)memchr( chunk, 0, size);
+        value.append( ( const char*)chunk, end != NULL ? end - chunk : size);
+        if ( end != NULL)
+            return true;
+        addr += size;
+    }
+    return false;
+}
+
+bool SyscallEmulator::readLine( uint32 fd, string& line)
+{
+    line.clear();
+    char c = 0;
+    while ( read( hostFd( fd), &c, 1) == 1)
+    {
+        line.push_back( c);
+        if ( c == '\n')
+            break;
+    }
+    return !line.empty();
+}
+
+int64 SyscallEmulator::doRead( FuncMemory& memory, uint32 fd, uint64 addr, uint64 size)
+{
+    int host_fd = hostFd( fd);
+    if ( host_fd == -1)
+        return -EBADF;
+
+    // the host writes directly to the buffer, it is copied to the guest at once
+    uint64 done = 0;
+    while ( done < size)
+    {
+        buffer.resize( min( size - done, COPY_CHUNK));
+        ssize_t num = read( host_fd, &buffer[ 0], buffer.size());
+        if ( num < 0)
+            return done != 0 ? ( int64)done : -errno;
+        if ( !memory.tryWriteBlock( addr + done, &buffer[ 0], num))
+            return done != 0 ? ( int64)done : -EFAULT;
+        done += num;
+        if ( ( uint64)num < buffer.size())
+            break;
+    }
+    return done;
+}
+
+int64 SyscallEmulator::doWrite( const FuncMemory& memory, uint32 fd, uint64 addr, uint64 size)
+{
+    int host_fd = hostFd( fd);
+    if ( host_fd == -1)
+        return -EBADF;
+
+    for ( uint64 done = 0; done < size; )
+    {
+        buffer.resize( min( size - done, COPY_CHUNK));
+        if ( !memory.tryReadBlock( addr + done, &buffer[ 0], buffer.size()))
+            return done != 0 ? ( int64)done : -EFAULT;
+
+        ssize_t num = write( host_fd, &buffer[ 0], buffer.size());
+        if ( num < 0)
+            return done != 0 ? ( int64)done : -errno;
+        done += num;
+        if ( ( uint64)num < buffer.size())
+            return done;
+    }
+    return size;
+}
+
+int64 SyscallEmulator::doWritev( const FuncMemory& memory, uint32 fd, uint64 iov, uint32 num)
+{
+    int64 total = 0;
+    for ( uint32 i = 0; i < num; ++i)
+    {
+        // struct iovec of O32 is a pair of words
+        uint64 base = 0, size = 0;
+        if ( !memory.tryRead( iov + 8 * i, 4, base) || !memory.tryRead( iov + 8 * i + 4, 4, size))
+            return total != 0 ? total : -EFAULT;
+
+        int64 result = doWrite( memory, fd, base, size);
+        if ( result < 0)
+            return total != 0 ? total : result;
+        total += result;
+        if ( ( uint64)result < size)
+            break;
+    }
+    return total;
+}
+
+int64 SyscallEmulator::doOpen( const FuncMemory& memory, uint64 name, uint32 flags, uint32 mode)
+{
+    string file_name;
+    if ( !readString( memory, name, file_name))
+        return -EFAULT;
+
+    int host_flags = ( flags & MIPS_O_ACCMODE) == 0 ? O_RDONLY
+                     : ( flags & MIPS_O_ACCMODE) == 1 ? O_WRONLY : O_RDWR;
+    if ( flags & MIPS_O_APPEND)
+        host_flags |= O_APPEND;
+    if ( flags & MIPS_O_CREAT)
+        host_flags |= O_CREAT;
+    if ( flags & MIPS_O_TRUNC)
+        host_flags |= O_TRUNC;
+    if ( flags & MIPS_O_EXCL)
+        host_flags |= O_EXCL;
+
+    int host_fd = open( file_name.c_str(), host_flags, mode);
+    if ( host_fd == -1)
+        return -errno;
+
+    // the lowest free descriptor, as the kernel does
+    GuestFile file = { host_fd, true};
+    for ( size_t i = 0; i < files.size(); ++i)
+    {
+        if ( files[ i].host_fd == -1)
+        {
+            files[ i] = file;
+            return i;
+        }
+    }
+    files.push_back( file);
+    return files.size() - 1;
+}
+
+int64 SyscallEmulator::doClose( uint32 fd)
+{
+    if ( hostFd( fd) == -1)
+        return -EBADF;
+
+    if ( files[ fd].owned && close( files[ fd].host_fd) == -1)
+        return -errno;
+    files[ fd].host_fd = -1;
+    return 0;
+}
+
+int64 SyscallEmulator::doBrk( FuncMemory& memory, uint64 addr)
+{
+    // a wrong break is not an error, the current one is returned
+    memory.setProgramBreak( addr);
+    return memory.programBreak();
+}
+
+int64 SyscallEmulator::doMmap( FuncMemory& memory, uint64 hint, uint64 size,
+                               uint32 prot, uint32 flags, uint32 fd, uint64 offset)
+{
+    int host_fd = -1;
+    if ( ( flags & MIPS_MAP_ANONYMOUS) == 0)
+    {
+        host_fd = hostFd( fd);
+        if ( host_fd == -1)
+            return -EBADF;
+    }
+
+    uint64 addr = hint;
+    if ( ( flags & MIPS_MAP_FIXED) != 0)
+    {
+        // the mappings of the range are replaced, as the kernel does
+        if ( ( hint & ( memory.pageSize() - 1)) != 0 || size == 0)
+            return -EINVAL;
+        memory.removeRegions( hint, size);
+        uint64 map_size = ( size + memory.pageSize() - 1) & ~( memory.pageSize() - 1);
+        if ( !memory.addRegion( "mmap", hint, map_size, prot & MIPS_PROT_MASK))
+            return -ENOMEM;
+    } else
+    {
+        // otherwise the address is a hint only, the mappings are taken from the top down
+        addr = memory.mapAnonymous( size, prot & MIPS_PROT_MASK);
+        if ( addr == 0)
+            return -ENOMEM;
+    }
+
+    // a file is copied, so the mapping is private
+    for ( uint64 done = 0; host_fd != -1 && done < size; )
+    {
+        buffer.resize( min( size - done, COPY_CHUNK));
+        ssize_t num = pread( host_fd, &buffer[ 0], buffer.size(), offset + done);
+        if ( num < 0)
+        {
+            int error = errno;
+            memory.removeRegions( addr, size);
+            return -error;
+        }
+        if ( num == 0)
+            break;
+        memory.writeBlock( addr + done, &buffer[ 0], num);
+        done += num;
+    }
+    return addr;
+}
+
+int64 SyscallEmulator::doMunmap( FuncMemory& memory, uint64 addr, uint64 size)
+{
+    if ( ( addr & ( memory.pageSize() - 1)) != 0 || size == 0)
+        return -EINVAL;
+
+    // the next mappings take the freed addresses again
+    memory.removeRegions( addr, size);
+    return 0;
+}
+
+int64 SyscallEmulator::doMprotect( FuncMemory& memory, uint64 addr, uint64 size, uint32 prot)
+{
+    if ( ( addr & ( memory.pageSize() - 1)) != 0)
+        return -EINVAL;
+    if ( size == 0)
+        return 0;
+
+    // the code made writable this way is the only one that can change
+    return memory.setProtection( addr, size, prot & MIPS_PROT_MASK) ? 0 : -ENOMEM;
+}
+
+SyscallResult SyscallEmulator::execute( RF& rf, FuncMemory& memory)
+{
+    uint32 number = rf.read( REG_V0);
+    return number < 4000 ? executeSpim( rf, memory, number)
+                         : executeO32( rf, memory, number);
+}
+
+SyscallResult SyscallEmulator::executeSpim( RF& rf, FuncMemory& memory, uint32 number)
+{
+    uint32 a0 = rf.read( REG_A0);
+    uint32 a1 = rf.read( REG_A1);
+    uint32 a2 = rf.read( REG_A2);
+    int64 result = 0;
+    string line;
+
+    switch ( number)
+    {
+        case SPIM_PRINT_INT:
+        {
+            ostringstream oss;
+            oss << ( int32)a0;
+            line = oss.str();
+            result = write( hostFd( 1), line.data(), line.size());
+            return SYSCALL_DONE;
+        }
+        case SPIM_PRINT_STRING:
+            if ( readString( memory, a0, line))
+                result = write( hostFd( 1), line.data(), line.size());
+            return SYSCALL_DONE;
+        case SPIM_PRINT_CHAR:
+            line.assign( 1, ( char)a0);
+            result = write( hostFd( 1), line.data(), 1);
+            return SYSCALL_DONE;
+        case SPIM_READ_INT:
+            readLine( 0, line);
+            rf.write( REG_V0, strtol( line.c_str(), NULL, 10));
+            return SYSCALL_DONE;
+        case SPIM_READ_CHAR:
+            readLine( 0, line);
+            rf.write( REG_V0, line.empty() ? 0 : ( uint8)line[ 0]);
+            return SYSCALL_DONE;
+        case SPIM_READ_STRING:
+            // as fgets: at most a1 - 1 characters and the terminating zero
+            if ( a1 != 0)
+            {
+                readLine( 0, line);
+                line = line.substr( 0, a1 - 1);
+                line.push_back( '\0');
+                memory.tryWriteBlock( a0, ( const uint8*)line.data(), line.size());
+            }
+            return SYSCALL_DONE;
+        case SPIM_SBRK:
+        {
+            uint64 old_end = memory.programBreak();
+            doBrk( memory, old_end + ( int32)a0);
+            rf.write( REG_V0, old_end);
+            return SYSCALL_DONE;
+        }
+        case SPIM_EXIT:
+            exit_code = 0;
+            return SYSCALL_EXIT;
+        case SPIM_EXIT2:
+            exit_code = a0;
+            return SYSCALL_EXIT;
+        case SPIM_OPEN:
+            result = doOpen( memory, a0, a1, a2);
+            break;
+        case SPIM_READ:
+            result = doRead( memory, a0, a1, a2);
+            break;
+        case SPIM_WRITE:
+            result = doWrite( memory, a0, a1, a2);
+            break;
+        case SPIM_CLOSE:
+            result = doClose( a0);
+            break;
+        default:
+            return SYSCALL_UNKNOWN;
+    }
+
+    // SPIM reports all the errors as -1
+    rf.write( REG_V0, result < 0 ? ( uint32)-1 : ( uint32)result);
+    return SYSCALL_DONE;
+}
+
+SyscallResult SyscallEmulator::executeO32( RF& rf, FuncMemory& memory, uint32 number)
+{
+    uint32 a0 = rf.read( REG_A0);
+    uint32 a1 = rf.read( REG_A1);
+    uint32 a2 = rf.read( REG_A2);
+    uint32 a3 = rf.read( REG_A3);
+    int64 result = 0;
+
+    switch ( number)
+    {
+        case O32_EXIT:
+        case O32_EXIT_GROUP:
+            exit_code = a0;
+            return SYSCALL_EXIT;
+        case O32_READ:
+            result = doRead( memory, a0, a1, a2);
+            break;
+        case O32_WRITE:
+            result = doWrite( memory, a0, a1, a2);
+            break;
+        case O32_WRITEV:
+            result = doWritev( memory, a0, a1, a2);
+            break;
+        case O32_OPEN:
+            result = doOpen( memory, a0, a1, a2);
+            break;
+        case O32_CLOSE:
+            result = doClose( a0);
+            break;
+        case O32_BRK:
+            result = doBrk( memory, a0);
+            break;
+        case O32_IOCTL:
+            // no terminals, so the C library buffers the standard output
+            result = hostFd( a0) == -1 ? -EBADF : -ENOTTY;
+            break;
+        case O32_MMAP:
+        {
+            // the 5th and the 6th arguments are on the stack
+            uint64 fd = 0, offset = 0;
+            uint64 sp = rf.read( REG_SP);
+            if ( !memory.tryRead( sp + 16, 4, fd) || !memory.tryRead( sp + 20, 4, offset))
+                result = -EFAULT;
+            else
+                result = doMmap( memory, a0, a1, a2, a3, fd, offset);
+            break;
+        }
+        case O32_MUNMAP:
+            result = doMunmap( memory, a0, a1);
+            break;
+        case O32_MPROTECT:
+            result = doMprotect( memory, a0, a1, a2);
+            break;
+        default:
+            return SYSCALL_UNKNOWN;
+    }
+
+    // the error flag is in $a3 and the error number is in $v0
+    rf.write( REG_V0, result < 0 ? ( uint32)-result : ( uint32)result);
+    rf.write( REG_A3, result < 0 ? 1 : 0);
+    return SYSCALL_DONE;
+}
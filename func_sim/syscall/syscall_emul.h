@@ -0,0 +1,82 @@
+/**
+ * syscall_emul.h - Header of the emulation of the system calls
+ * of the guest programs: SPIM calls (the number in $v0 is below 4000)
+ * and Linux O32 calls (4000 and above). The guest buffers are copied
+ * to and from the functional memory in blocks and passed to the host calls.
+ * Copyright 2015 MIPT-MIPS iLab project
+ */
+
+// protection from multi-include
+#ifndef SYSCALL__SYSCALL_EMUL_H
+#define SYSCALL__SYSCALL_EMUL_H
+
+// Generic C++
+#include <string>
+#include <vector>
+
+// uArchSim modules
+#include <types.h>
+#include <elf_parser.h>
+#include <func_memory.h>
+#include <rf.h>
+
+using namespace std;
+
+enum SyscallResult
+{
+    SYSCALL_DONE,    // the program continues from the next instruction
+    SYSCALL_EXIT,    // the program has finished, see exitCode()
+    SYSCALL_UNKNOWN  // the number in $v0 is not supported, nothing is changed
+};
+
+class SyscallEmulator
+{
+        struct GuestFile
+        {
+            int host_fd; // -1 for a closed descriptor
+            bool owned;  // the standard streams of the host are never closed
+        };
+        vector<GuestFile> files;
+        uint32 exit_code;
+
+        // the host side of the copies
+        vector<uint8> buffer;
+
+        // The calls return the result or -errno
+        int64 doRead( FuncMemory& memory, uint32 fd, uint64 addr, uint64 size);
+        int64 doWrite( const FuncMemory& memory, uint32 fd, uint64 addr, uint64 size);
+        int64 doWritev( const FuncMemory& memory, uint32 fd, uint64 iov, uint32 num);
+        int64 doOpen( const FuncMemory& memory, uint64 name, uint32 flags, uint32 mode);
+        int64 doClose( uint32 fd);
+        int64 doBrk( FuncMemory& memory, uint64 addr);
+        int64 doMmap( FuncMemory& memory, uint64 addr, uint64 size,
+                      uint32 prot, uint32 flags, uint32 fd, uint64 offset);
+        int64 doMunmap( FuncMemory& memory, uint64 addr, uint64 size);
+        int64 doMprotect( FuncMemory& memory, uint64 addr, uint64 size, uint32 prot);
+
+        int hostFd( uint32 fd) const;
+        bool readString( const FuncMemory& memory, uint64 addr,
+                         string& value /*used as output*/) const;
+        bool readLine( uint32 fd, string& line /*used as output*/);
+
+        SyscallResult executeSpim( RF& rf, FuncMemory& memory, uint32 number);
+        SyscallResult executeO32( RF& rf, FuncMemory& memory, uint32 number);
+
+        // no copies, the descriptors are owned
+        SyscallEmulator( const SyscallEmulator&);
+        SyscallEmulator& operator=( const SyscallEmulator&);
+
+    public:
+        // The guest descriptors 0, 1 and 2 are the given host ones.
+        // The heap and the mappings are the regions of the functional memory.
+        SyscallEmulator( int stdin_fd = 0, int stdout_fd = 1, int stderr_fd = 2);
+        virtual ~SyscallEmulator();
+
+        // Executes the call of the "syscall" instruction,
+        // the number and the arguments are taken from the registers
+        SyscallResult execute( RF& rf, FuncMemory& memory);
+
+        inline uint32 exitCode() const { return exit_code; }
+};
+
+#endif // #ifndef SYSCALL__SYSCALL_EMUL_H
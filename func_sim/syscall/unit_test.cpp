@@ -0,0 +1,325 @@
+// generic C
+#include <cassert>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+
+// Google Test library
+#include <gtest/gtest.h>
+
+// uArchSim modules
+#include <syscall_emul.h>
+
+static const char* test_file = "./test_syscall.txt";
+static const char* sample_file = "../../tests/samples/memcpy.out";
+
+// The guest standard streams are pipes, so the output is checked.
+// The memory has the stack and a mapping for the data of the tests.
+class Syscall : public ::testing::Test
+{
+    protected:
+        int input[ 2];
+        int output[ 2];
+        SyscallEmulator* emulator;
+        FuncMemory memory;
+        RF rf;
+        uint64 sp;
+        uint64 data_addr;
+        uint64 initial_break;
+
+        Syscall() : memory( sample_file) { }
+
+        void SetUp()
+        {
+            ASSERT_EQ( pipe( input), 0);
+            ASSERT_EQ( pipe( output), 0);
+            emulator = new SyscallEmulator( input[ 0], output[ 1], output[ 1]);
+
+            sp = memory.setupStack( vector<string>( 1, sample_file), vector<string>());
+            ASSERT_NE( sp, 0u);
+            data_addr = memory.mapAnonymous( 0x2000, MEM_READ | MEM_WRITE);
+            ASSERT_NE( data_addr, 0u);
+            initial_break = memory.programBreak();
+        }
+
+        void TearDown()
+        {
+            delete emulator;
+            close( input[ 0]);
+            close( input[ 1]);
+            close( output[ 0]);
+            close( output[ 1]);
+        }
+
+        SyscallResult call( uint32 number, uint32 a0 = 0, uint32 a1 = 0, uint32 a2 = 0)
+        {
+            rf.write( REG_V0, number);
+            rf.write( REG_A0, a0);
+            rf.write( REG_A1, a1);
+            rf.write( REG_A2, a2);
+            return emulator->execute( rf, memory);
+        }
+
+        string readOutput()
+        {
+            char buf[ 256];
+            ssize_t size = read( output[ 0], buf, sizeof( buf));
+            return string( buf, size > 0 ? size : 0);
+        }
+
+        void putString( uint64 addr, const char* value)
+        {
+            memory.writeBlock( addr, ( const uint8*)value, strlen( value) + 1);
+        }
+};
+
+TEST_F( Syscall, Spim_Console)
+{
+    putString( data_addr, "Hello, MIPS!\n");
+    ASSERT_EQ( call( 4, data_addr), SYSCALL_DONE);
+    ASSERT_EQ( readOutput(), "Hello, MIPS!\n");
+
+    ASSERT_EQ( call( 1, -42), SYSCALL_DONE);
+    ASSERT_EQ( call( 11, '!'), SYSCALL_DONE);
+    ASSERT_EQ( readOutput(), "-42!");
+
+    ASSERT_EQ( write( input[ 1], "2015\nline\n", 10), 10);
+    ASSERT_EQ( call( 5), SYSCALL_DONE);
+    ASSERT_EQ( rf.read( REG_V0), 2015u);
+    ASSERT_EQ( call( 8, data_addr, 3), SYSCALL_DONE);
+    ASSERT_EQ( memory.read( data_addr, 1), ( uint64)'l');
+    ASSERT_EQ( memory.read( data_addr + 2, 1), 0u);
+
+    // sbrk returns the old break
+    ASSERT_EQ( call( 9, 0x100), SYSCALL_DONE);
+    ASSERT_EQ( rf.read( REG_V0), initial_break);
+    ASSERT_EQ( memory.programBreak(), initial_break + 0x100);
+    ASSERT_EQ( memory.read( initial_break + 0xfc), 0u);
+
+    ASSERT_EQ( call( 17, 3), SYSCALL_EXIT);
+    ASSERT_EQ( emulator->exitCode(), 3u);
+    ASSERT_EQ( call( 10), SYSCALL_EXIT);
+    ASSERT_EQ( emulator->exitCode(), 0u);
+    ASSERT_EQ( call( 100), SYSCALL_UNKNOWN);
+}
+
+TEST_F( Syscall, O32_Files)
+{
+    remove( test_file);
+    putString( data_addr, test_file);
+    const char* text = "The data of the file";
+    putString( data_addr + 0x100, text);
+
+    // open( name, O_WRONLY | O_CREAT | O_TRUNC, 0644)
+    ASSERT_EQ( call( 4005, data_addr, 0x1 | 0x100 | 0x200, 0644), SYSCALL_DONE);
+    ASSERT_EQ( rf.read( REG_A3), 0u);
+    uint32 fd = rf.read( REG_V0);
+    ASSERT_EQ( fd, 3u);
+
+    // the buffer crosses a page border
+    uint64 addr = data_addr + memory.pageSize() - 8;
+    memory.writeBlock( addr, ( const uint8*)text, strlen( text));
+    ASSERT_EQ( call( 4004, fd, addr, strlen( text)), SYSCALL_DONE);
+    ASSERT_EQ( rf.read( REG_V0), strlen( text));
+    ASSERT_EQ( call( 4006, fd), SYSCALL_DONE);
+
+    ASSERT_EQ( call( 4005, data_addr, 0, 0), SYSCALL_DONE);
+    fd = rf.read( REG_V0);
+    ASSERT_EQ( call( 4003, fd, data_addr + 0x1000, 100), SYSCALL_DONE);
+    ASSERT_EQ( rf.read( REG_V0), strlen( text));
+    char result[ 64] = { 0};
+    memory.readBlock( data_addr + 0x1000, ( uint8*)result, strlen( text));
+    ASSERT_STREQ( result, text);
+    ASSERT_EQ( call( 4006, fd), SYSCALL_DONE);
+
+    // errors are in $a3 and $v0
+    ASSERT_EQ( call( 4006, fd), SYSCALL_DONE);
+    ASSERT_EQ( rf.read( REG_A3), 1u);
+    ASSERT_EQ( rf.read( REG_V0), ( uint32)EBADF);
+    ASSERT_EQ( call( 4004, 1, 0x20000000, 4), SYSCALL_DONE);
+    ASSERT_EQ( rf.read( REG_A3), 1u);
+    ASSERT_EQ( rf.read( REG_V0), ( uint32)EFAULT);
+
+    // SPIM reports the errors as -1
+    ASSERT_EQ( call( 13, 0x20000000, 0, 0), SYSCALL_DONE);
+    ASSERT_EQ( rf.read( REG_V0), ( uint32)-1);
+
+    remove( test_file);
+}
+
+TEST_F( Syscall, O32_Writev)
+{
+    putString( data_addr, "Hello, ");
+    putString( data_addr + 0x10, "world\n");
+    uint64 iov = data_addr + 0x100;
+    memory.write( data_addr, iov);
+    memory.write( 7, iov + 4);
+    memory.write( data_addr + 0x10, iov + 8);
+    memory.write( 6, iov + 12);
+
+    ASSERT_EQ( call( 4146, 1, iov, 2), SYSCALL_DONE);
+    ASSERT_EQ( rf.read( REG_V0), 13u);
+    ASSERT_EQ( readOutput(), "Hello, world\n");
+
+    ASSERT_EQ( call( 4054, 1, 0x540d, 0), SYSCALL_DONE);
+    ASSERT_EQ( rf.read( REG_A3), 1u);
+}
+
+TEST_F( Syscall, O32_Brk_And_Mmap)
+{
+    // brk( 0) returns the current break
+    ASSERT_EQ( call( 4045, 0), SYSCALL_DONE);
+    ASSERT_EQ( rf.read( REG_V0), initial_break);
+    ASSERT_EQ( call( 4045, initial_break + 0x3000), SYSCALL_DONE);
+    ASSERT_EQ( rf.read( REG_V0), initial_break + 0x3000);
+    ASSERT_EQ( memory.read( initial_break + 0x2ffc), 0u);
+
+    // mmap( NULL, 0x2000, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)
+    sp -= 32;
+    rf.write( REG_SP, sp);
+    memory.write( ( uint32)-1, sp + 16);
+    memory.write( 0, sp + 20);
+    rf.write( REG_A3, 0x2 | 0x800);
+    ASSERT_EQ( call( 4090, 0, 0x1800, 0x3), SYSCALL_DONE);
+    ASSERT_EQ( rf.read( REG_A3), 0u);
+    uint64 addr = rf.read( REG_V0);
+    ASSERT_EQ( addr % 0x1000, 0u);
+    ASSERT_GT( addr, initial_break);
+    ASSERT_EQ( memory.read( addr + 0x1ffc), 0u);
+
+    // mprotect( addr, 0x1000, PROT_READ) makes the guest buffers there read-only
+    ASSERT_EQ( call( 4125, addr, 0x1000, 0x1), SYSCALL_DONE);
+    ASSERT_EQ( rf.read( REG_A3), 0u);
+    ASSERT_EQ( write( input[ 1], "datadata", 8), 8);
+    ASSERT_EQ( call( 4003, 0, addr, 4), SYSCALL_DONE);
+    ASSERT_EQ( rf.read( REG_A3), 1u);
+    ASSERT_EQ( rf.read( REG_V0), ( uint32)EFAULT);
+    ASSERT_EQ( call( 4125, addr, 0x1000, 0x3), SYSCALL_DONE);
+    ASSERT_EQ( call( 4003, 0, addr, 4), SYSCALL_DONE);
+    ASSERT_EQ( rf.read( REG_V0), 4u);
+    ASSERT_EQ( call( 4125, 0x1000, 0x1000, 0x3), SYSCALL_DONE);
+    ASSERT_EQ( rf.read( REG_V0), ( uint32)ENOMEM);
+
+    // a file is copied to the mapping
+    const char* text = "mapped";
+    FILE* file = fopen( test_file, "w");
+    fputs( text, file);
+    fclose( file);
+    putString( data_addr, test_file);
+    ASSERT_EQ( call( 4005, data_addr, 0, 0), SYSCALL_DONE);
+    memory.write( rf.read( REG_V0), sp + 16);
+    rf.write( REG_A3, 0x2);
+    ASSERT_EQ( call( 4090, 0, 0x1000, 0x1), SYSCALL_DONE);
+    uint64 file_addr = rf.read( REG_V0);
+    ASSERT_LT( file_addr, addr);
+    char result[ 8] = { 0};
+    memory.readBlock( file_addr, ( uint8*)result, strlen( text));
+    ASSERT_STREQ( result, text);
+    remove( test_file);
+
+    // the unmapped pages are not accessible any more
+    uint64 value = 0;
+    ASSERT_EQ( call( 4091, addr + 1, 0x1000), SYSCALL_DONE);
+    ASSERT_EQ( rf.read( REG_A3), 1u);
+    ASSERT_EQ( call( 4091, addr, 0x1000), SYSCALL_DONE);
+    ASSERT_EQ( rf.read( REG_A3), 0u);
+    ASSERT_FALSE( memory.tryRead( addr, 4, value));
+    ASSERT_TRUE( memory.tryRead( addr + 0x1000, 4, value));
+
+    // the heap does not grow into the mappings
+    ASSERT_EQ( call( 4045, file_addr + 0x1000), SYSCALL_DONE);
+    ASSERT_EQ( rf.read( REG_V0), initial_break + 0x3000);
+}
+
+TEST_F( Syscall, O32_Mmap_Reuses_Space)
+{
+    // mmap( NULL, 1 MB, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)
+    // and munmap of it more times than the address space holds, as malloc does
+    const uint32 size = 1 << 20;
+    sp -= 32;
+    rf.write( REG_SP, sp);
+    memory.write( ( uint32)-1, sp + 16);
+    memory.write( 0, sp + 20);
+
+    uint64 first = 0;
+    for ( uint32 i = 0; i < 8192; ++i)
+    {
+        rf.write( REG_A3, 0x2 | 0x800);
+        ASSERT_EQ( call( 4090, 0, size, 0x3), SYSCALL_DONE);
+        ASSERT_EQ( rf.read( REG_A3), 0u);
+        uint64 addr = rf.read( REG_V0);
+        if ( i == 0)
+            first = addr;
+        ASSERT_EQ( addr, first);
+        memory.write( i, addr + size - 4);
+
+        ASSERT_EQ( call( 4091, addr, size), SYSCALL_DONE);
+        ASSERT_EQ( rf.read( REG_A3), 0u);
+    }
+
+    // a gap between two mappings is taken by the mapping that fits in it
+    rf.write( REG_A3, 0x2 | 0x800);
+    ASSERT_EQ( call( 4090, 0, 2 * size, 0x3), SYSCALL_DONE);
+    uint64 high = rf.read( REG_V0);
+    rf.write( REG_A3, 0x2 | 0x800);
+    ASSERT_EQ( call( 4090, 0, size, 0x3), SYSCALL_DONE);
+    uint64 low = rf.read( REG_V0);
+    ASSERT_EQ( low, high - size);
+    ASSERT_EQ( call( 4091, high, size), SYSCALL_DONE);
+    rf.write( REG_A3, 0x2 | 0x800);
+    ASSERT_EQ( call( 4090, 0, 2 * size, 0x3), SYSCALL_DONE);
+    ASSERT_EQ( rf.read( REG_V0), low - 2 * size);
+    rf.write( REG_A3, 0x2 | 0x800);
+    ASSERT_EQ( call( 4090, 0, size, 0x3), SYSCALL_DONE);
+    ASSERT_EQ( rf.read( REG_V0), high);
+}
+
+TEST_F( Syscall, O32_Mmap_Fixed_And_Partial_Read)
+{
+    sp -= 32;
+    rf.write( REG_SP, sp);
+    memory.write( ( uint32)-1, sp + 16);
+    memory.write( 0, sp + 20);
+
+    // mmap( NULL, 2 MB, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)
+    const uint32 size = 1 << 20;
+    rf.write( REG_A3, 0x2 | 0x800);
+    ASSERT_EQ( call( 4090, 0, 2 * size, 0x3), SYSCALL_DONE);
+    uint64 addr = rf.read( REG_V0);
+    memory.write( 1, addr + size);
+
+    // MAP_FIXED replaces the pages at the address with zeros
+    rf.write( REG_A3, 0x2 | 0x10 | 0x800);
+    ASSERT_EQ( call( 4090, addr + size, size, 0x1), SYSCALL_DONE);
+    ASSERT_EQ( rf.read( REG_A3), 0u);
+    ASSERT_EQ( rf.read( REG_V0), addr + size);
+    ASSERT_EQ( memory.read( addr + size), 0u);
+    ASSERT_EQ( memory.pageProt( addr + size), ( uint32)MEM_READ);
+    rf.write( REG_A3, 0x2 | 0x10 | 0x800);
+    ASSERT_EQ( call( 4090, addr + 1, size, 0x3), SYSCALL_DONE);
+    ASSERT_EQ( rf.read( REG_A3), 1u);
+    ASSERT_EQ( rf.read( REG_V0), ( uint32)EINVAL);
+
+    // a read that stops at the read-only pages returns the bytes it has copied
+    vector<char> text( size + 8, 'x');
+    FILE* file = fopen( test_file, "w");
+    fwrite( &text[ 0], 1, text.size(), file);
+    fclose( file);
+    putString( data_addr, test_file);
+    ASSERT_EQ( call( 4005, data_addr, 0, 0), SYSCALL_DONE);
+    uint32 fd = rf.read( REG_V0);
+    ASSERT_EQ( call( 4003, fd, addr, text.size()), SYSCALL_DONE);
+    ASSERT_EQ( rf.read( REG_A3), 0u);
+    ASSERT_EQ( rf.read( REG_V0), size);
+    ASSERT_EQ( memory.read( addr + size - 4, 1), ( uint64)'x');
+    ASSERT_EQ( call( 4006, fd), SYSCALL_DONE);
+    remove( test_file);
+}
+
+int main( int argc, char* argv[])
+{
+    ::testing::InitGoogleTest( &argc, argv);
+    ::testing::FLAGS_gtest_death_test_style = "threadsafe";
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,253 @@
+/**
+ * trace_queue.h - single-producer/single-consumer lock-free ring buffer.
+ * The functional simulator runs on one thread and pushes executed-instruction
+ * records into the queue, the timing model pops them on another thread.
+ * Copyright 2015 MIPT-MIPS iLab project
+ */
+
+// protection from multi-include
+#ifndef TRACE__TRACE_QUEUE_H
+#define TRACE__TRACE_QUEUE_H
+
+// Generic C
+#include <cassert>
+
+// Generic C++
+#include <atomic>
+#include <thread>
+#include <chrono>
+
+// uArchSim modules
+#include <types.h>
+
+// What the producer does when the queue is full
+enum TraceBackpressure
+{
+    TRACE_BLOCK, // spin for a while, then yield until the consumer frees a slot
+    TRACE_DROP   // discard the record and count it as dropped
+};
+
+struct TraceQueueStats
+{
+    uint64 pushed;          // records accepted by the queue
+    uint64 popped;          // records taken by the consumer
+    uint64 dropped;         // records discarded because the queue was full
+    uint64 producer_stalls; // times the producer found the queue full
+    uint64 consumer_stalls; // times the consumer found the queue empty
+};
+
+template<typename T>
+class TraceQueue
+{
+        // The producer and the consumer parts are placed on separate cache lines,
+        // so the two threads do not bounce one line between cores on each access.
+        static const size_t CACHE_LINE = 64;
+
+        T* buffer;
+        const uint64 mask;
+        const TraceBackpressure policy;
+        const uint32 spin_limit;
+
+        // written by the producer only
+        alignas( CACHE_LINE) std::atomic<uint64> tail;
+        std::atomic<bool> closed;
+        uint64 cached_head; // producer's view of head, re-read only when the queue looks full
+        uint64 pushed;
+        uint64 dropped;
+        uint64 producer_stalls;
+
+        // written by the consumer only
+        alignas( CACHE_LINE) std::atomic<uint64> head;
+        std::atomic<bool> stopped;
+        uint64 cached_tail; // consumer's view of tail, re-read only when the queue looks empty
+        uint64 popped;
+        uint64 consumer_stalls;
+
+        inline void backoff( uint32& spins) const
+        {
+            if ( spins < spin_limit)
+                ++spins;
+            else
+                std::this_thread::yield();
+        }
+
+        // the queue is not copyable
+        TraceQueue( const TraceQueue&);
+        TraceQueue& operator=( const TraceQueue&);
+
+    public:
+        // The capacity of the queue is ( 1 << size_bits) records.
+        // spin_limit is the number of busy-wait iterations before a blocked
+        // side starts to give its time slice away.
+        TraceQueue( uint32 size_bits = 16,
+                    TraceBackpressure policy = TRACE_BLOCK,
+                    uint32 spin_limit = 1024)
+            : buffer( new T[ 1ull << size_bits]),
+              mask( ( 1ull << size_bits) - 1),
+              policy( policy),
+              spin_limit( spin_limit),
+              tail( 0), closed( false), cached_head( 0),
+              pushed( 0), dropped( 0), producer_stalls( 0),
+              head( 0), stopped( false), cached_tail( 0),
+              popped( 0), consumer_stalls( 0)
+        {
+            assert( size_bits > 0 && size_bits < 32);
+        }
+
+        virtual ~TraceQueue() { delete [] buffer; }
+
+        inline uint64 capacity() const { return mask + 1; }
+
+        // Called by the producer. Returns false if the record was not accepted,
+        // i.e. it was dropped or the consumer has stopped.
+        bool push( const T& record)
+        {
+            uint64 t = tail.load( std::memory_order_relaxed);
+            if ( t - cached_head > mask)
+            {
+                cached_head = head.load( std::memory_order_acquire);
+                if ( t - cached_head > mask)
+                {
+                    if ( policy == TRACE_DROP)
+                    {
+                        ++dropped;
+                        return false;
+                    }
+
+                    ++producer_stalls;
+                    uint32 spins = 0;
+                    do
+                    {
+                        if ( stopped.load( std::memory_order_relaxed))
+                            return false;
+                        backoff( spins);
+                        cached_head = head.load( std::memory_order_acquire);
+                    } while ( t - cached_head > mask);
+                }
+            }
+
+            buffer[ t & mask] = record;
+            tail.store( t + 1, std::memory_order_release);
+            ++pushed;
+            return true;
+        }
+
+        // Called by the producer after the last record is pushed.
+        inline void close() { closed.store( true, std::memory_order_release); }
+
+        // Called by the consumer. Blocks until a record is available.
+        // Returns false if the queue is closed and all records are consumed.
+        bool pop( T& record)
+        {
+            return popBatch( &record, 1) == 1;
+        }
+
+        // Called by the consumer. Blocks until at least one record is available
+        // and takes up to max_num of them. Returns 0 if the queue is closed and
+        // all records are consumed.
+        size_t popBatch( T* records, size_t max_num)
+        {
+            uint64 h = head.load( std::memory_order_relaxed);
+            if ( h == cached_tail)
+            {
+                cached_tail = tail.load( std::memory_order_acquire);
+                if ( h == cached_tail)
+                {
+                    ++consumer_stalls;
+                    uint32 spins = 0;
+                    while ( true)
+                    {
+                        // closed must be read before tail: all the records
+                        // pushed before close() are visible after that
+                        bool was_closed = closed.load( std::memory_order_acquire);
+                        cached_tail = tail.load( std::memory_order_acquire);
+                        if ( h != cached_tail)
+                            break;
+                        if ( was_closed)
+                            return 0;
+                        backoff( spins);
+                    }
+                }
+            }
+
+            size_t num = 0;
+            for ( ; num < max_num && h + num != cached_tail; ++num)
+                records[ num] = buffer[ ( h + num) & mask];
+
+            head.store( h + num, std::memory_order_release);
+            popped += num;
+            return num;
+        }
+
+        // Called by the consumer to tell the producer that no more records
+        // are needed, e.g. the timing model has finished earlier.
+        inline void stop() { stopped.store( true, std::memory_order_relaxed); }
+        inline bool isStopped() const { return stopped.load( std::memory_order_relaxed); }
+
+        // The counters are owned by different threads,
+        // so call it only after both of them are finished.
+        TraceQueueStats stats() const
+        {
+            TraceQueueStats s;
+            s.pushed = pushed;
+            s.popped = popped;
+            s.dropped = dropped;
+            s.producer_stalls = producer_stalls;
+            s.consumer_stalls = consumer_stalls;
+            return s;
+        }
+};
+
+struct TraceRunStats
+{
+    TraceQueueStats queue;
+    double seconds;            // wall-clock time of the run
+    double records_per_second; // throughput of the consumer
+};
+
+//
+// Run the producer and the consumer in parallel connected by the queue.
+// The producer is executed on a new thread and must have
+//     bool step( T& record); // returns false when there is nothing to produce
+// The consumer is executed on the calling thread and must have
+//     bool consume( const T& record); // returns false to stop the run
+//
+template<typename T, typename Producer, typename Consumer>
+TraceRunStats runDecoupled( TraceQueue<T>& queue, Producer& producer, Consumer& consumer)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    std::thread functional_thread( [ &queue, &producer]()
+    {
+        T record;
+        while ( !queue.isStopped() && producer.step( record))
+            queue.push( record);
+        queue.close();
+    });
+
+    T record;
+    while ( queue.pop( record))
+    {
+        if ( !consumer.consume( record))
+        {
+            queue.stop();
+            // drain the queue so the blocked producer can reach close()
+            while ( queue.pop( record))
+                ;
+            break;
+        }
+    }
+
+    functional_thread.join();
+
+    TraceRunStats run_stats;
+    run_stats.queue = queue.stats();
+    run_stats.seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+    run_stats.records_per_second = run_stats.seconds > 0
+                                   ? run_stats.queue.popped / run_stats.seconds
+                                   : 0;
+    return run_stats;
+}
+
+#endif // #ifndef TRACE__TRACE_QUEUE_H
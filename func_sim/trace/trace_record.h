@@ -0,0 +1,38 @@
+/**
+ * trace_record.h - record of one instruction executed by the functional
+ * simulator, passed to the timing model through the trace queue.
+ * Copyright 2015 MIPT-MIPS iLab project
+ */
+
+// protection from multi-include
+#ifndef TRACE__TRACE_RECORD_H
+#define TRACE__TRACE_RECORD_H
+
+// uArchSim modules
+#include <types.h>
+
+// register number used when an instruction has no destination register
+static const uint8 TRACE_NO_REG = NO_VAL8;
+
+struct TraceRecord
+{
+    uint64 pc;        // address of the instruction
+    uint64 next_pc;   // address of the next instruction to be executed
+    uint32 instr;     // raw instruction word
+
+    uint8  dst_reg;   // destination register number or TRACE_NO_REG
+    uint64 dst_value; // value written to the destination register
+
+    uint8  mem_size;  // size of the memory access in bytes, 0 if none
+    bool   is_store;  // true if the memory access is a store
+    uint64 mem_addr;  // address of the memory access
+    uint64 mem_value; // loaded or stored value
+
+    TraceRecord()
+        : pc( 0), next_pc( 0), instr( 0),
+          dst_reg( TRACE_NO_REG), dst_value( 0),
+          mem_size( 0), is_store( false), mem_addr( 0), mem_value( 0)
+    { }
+};
+
+#endif // #ifndef TRACE__TRACE_RECORD_H
@@ -0,0 +1,152 @@
+// generic C
+#include <cassert>
+#include <cstdlib>
+
+// Google Test library
+#include <gtest/gtest.h>
+
+// uArchSim modules
+#include <trace_queue.h>
+#include <trace_record.h>
+
+//
+// Produces records with consecutive PCs
+//
+struct CountingProducer
+{
+    uint64 num;
+    uint64 produced;
+
+    CountingProducer( uint64 num) : num( num), produced( 0) { }
+
+    bool step( TraceRecord& record)
+    {
+        if ( produced == num)
+            return false;
+        record.pc = 0x400000 + 4 * produced;
+        record.next_pc = record.pc + 4;
+        record.dst_value = produced;
+        ++produced;
+        return true;
+    }
+};
+
+//
+// Checks that the records come in order
+//
+struct CheckingConsumer
+{
+    uint64 consumed;
+    uint64 limit;
+    bool in_order;
+
+    CheckingConsumer( uint64 limit = MAX_VAL64)
+        : consumed( 0), limit( limit), in_order( true) { }
+
+    bool consume( const TraceRecord& record)
+    {
+        in_order = in_order && record.dst_value == consumed
+                            && record.pc == 0x400000 + 4 * consumed;
+        return ++consumed < limit;
+    }
+};
+
+TEST( Trace_queue, Push_Pop_In_Order)
+{
+    TraceQueue<uint64> queue( 4);
+    ASSERT_EQ( queue.capacity(), 16ull);
+
+    for ( uint64 i = 0; i < 10; ++i)
+        ASSERT_TRUE( queue.push( i));
+    queue.close();
+
+    uint64 value;
+    for ( uint64 i = 0; i < 10; ++i)
+    {
+        ASSERT_TRUE( queue.pop( value));
+        ASSERT_EQ( value, i);
+    }
+
+    // the queue is closed and empty
+    ASSERT_FALSE( queue.pop( value));
+
+    TraceQueueStats stats = queue.stats();
+    ASSERT_EQ( stats.pushed, 10ull);
+    ASSERT_EQ( stats.popped, 10ull);
+    ASSERT_EQ( stats.dropped, 0ull);
+}
+
+TEST( Trace_queue, Pop_Batch)
+{
+    TraceQueue<uint64> queue( 3);
+    for ( uint64 i = 0; i < 6; ++i)
+        queue.push( i);
+    queue.close();
+
+    uint64 values[ 4];
+    ASSERT_EQ( queue.popBatch( values, 4), 4u);
+    ASSERT_EQ( values[ 3], 3ull);
+    ASSERT_EQ( queue.popBatch( values, 4), 2u);
+    ASSERT_EQ( values[ 1], 5ull);
+    ASSERT_EQ( queue.popBatch( values, 4), 0u);
+}
+
+TEST( Trace_queue, Drop_Policy)
+{
+    TraceQueue<uint64> queue( 2, TRACE_DROP);
+
+    for ( uint64 i = 0; i < 4; ++i)
+        ASSERT_TRUE( queue.push( i));
+
+    // the queue is full, so the records are dropped
+    ASSERT_FALSE( queue.push( 4));
+    ASSERT_FALSE( queue.push( 5));
+
+    uint64 value;
+    ASSERT_TRUE( queue.pop( value));
+    ASSERT_EQ( value, 0ull);
+
+    // one slot is free now
+    ASSERT_TRUE( queue.push( 6));
+
+    TraceQueueStats stats = queue.stats();
+    ASSERT_EQ( stats.pushed, 5ull);
+    ASSERT_EQ( stats.dropped, 2ull);
+}
+
+TEST( Trace_queue, Decoupled_Run)
+{
+    // small queue to make both threads block on each other
+    TraceQueue<TraceRecord> queue( 6, TRACE_BLOCK, 16);
+    CountingProducer producer( 200000);
+    CheckingConsumer consumer;
+
+    TraceRunStats stats = runDecoupled( queue, producer, consumer);
+
+    ASSERT_TRUE( consumer.in_order);
+    ASSERT_EQ( consumer.consumed, 200000ull);
+    ASSERT_EQ( stats.queue.pushed, 200000ull);
+    ASSERT_EQ( stats.queue.popped, 200000ull);
+    ASSERT_EQ( stats.queue.dropped, 0ull);
+    ASSERT_GT( stats.records_per_second, 0);
+}
+
+TEST( Trace_queue, Decoupled_Run_Stopped_By_Consumer)
+{
+    TraceQueue<TraceRecord> queue( 4);
+    CountingProducer producer( MAX_VAL64);
+    CheckingConsumer consumer( 1000);
+
+    // must not hang although the producer is endless
+    runDecoupled( queue, producer, consumer);
+
+    ASSERT_TRUE( consumer.in_order);
+    ASSERT_EQ( consumer.consumed, 1000ull);
+}
+
+int main( int argc, char* argv[])
+{
+    ::testing::InitGoogleTest( &argc, argv);
+    ::testing::FLAGS_gtest_death_test_style = "threadsafe";
+    return RUN_ALL_TESTS();
+}
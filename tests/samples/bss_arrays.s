@@ -0,0 +1,20 @@
+# A program with a big zero-initialized array.
+# The array is placed in the ".bss" section, which takes no space
+# in the binary file, but takes 1 MB in the memory of the program.
+
+    .data
+
+counter: .word 42
+
+    .bss
+
+big_array: .space 1048576 # 1 MB of zeros
+
+    .text
+
+    .global __start
+ __start:
+    la  $t0, big_array
+    la  $t1, counter
+    lw  $t2, 0($t1)
+    sw  $t2, 0($t0)
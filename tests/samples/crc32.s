@@ -0,0 +1,54 @@
+# Bitwise CRC-32 (the reflected polynomial 0xedb88320, as in zlib)
+# of a 1 KB buffer, the byte i of the buffer is ( i * 7 + 3) mod 256.
+# The CRC is written to "result", the program ends
+# with the "exit" system call (10).
+# result = 0x5d3de8ed
+
+    .data
+
+result: .word 0
+
+    .bss
+
+buffer: .space 1024
+
+    .text
+
+    .global __start
+ __start:
+    la    $s0, buffer
+    li    $t0, 0
+fill:
+    sll   $t1, $t0, 3
+    subu  $t1, $t1, $t0
+    addiu $t1, $t1, 3
+    addu  $t2, $s0, $t0
+    sb    $t1, 0($t2)
+    addiu $t0, $t0, 1
+    slti  $t3, $t0, 1024
+    bne   $t3, $zero, fill
+
+    li    $v1, -1              # crc
+    li    $s1, 0xedb88320
+    move  $t0, $s0
+    addiu $s2, $s0, 1024
+next_byte:
+    lbu   $t1, 0($t0)
+    xor   $v1, $v1, $t1
+    li    $t2, 8
+next_bit:
+    andi  $t3, $v1, 1
+    srl   $v1, $v1, 1
+    beq   $t3, $zero, skip_xor
+    xor   $v1, $v1, $s1
+skip_xor:
+    addiu $t2, $t2, -1
+    bgtz  $t2, next_bit
+    addiu $t0, $t0, 1
+    bne   $t0, $s2, next_byte
+    nor   $v1, $v1, $zero
+
+    la    $t0, result
+    sw    $v1, 0($t0)
+    li    $v0, 10
+    syscall
@@ -0,0 +1,56 @@
+# Traversal of a linked list of 256 nodes scattered over an array,
+# so the successive nodes are not adjacent in the memory.
+# A node is a pair of words: the value and the address of the next node.
+# The node i is followed by the node ( i + 97) mod 256, its value is i.
+# The list is traversed 16 times, the sum of the values is written
+# to "result", the program ends with the "exit" system call (10).
+# result = 0x0007f800
+
+    .data
+
+result: .word 0
+
+    .bss
+
+nodes: .space 2048
+
+    .text
+
+    .global __start
+ __start:
+    # the links, the last visited node points to NULL
+    la    $s0, nodes
+    li    $t0, 0               # i
+link:
+    sll   $t1, $t0, 3
+    addu  $t1, $t1, $s0        # &nodes[ i]
+    sw    $t0, 0($t1)
+    addiu $t2, $t0, 97
+    andi  $t2, $t2, 255
+    sll   $t3, $t2, 3
+    addu  $t3, $t3, $s0        # &nodes[ ( i + 97) mod 256]
+    bne   $t2, $zero, store_next
+    li    $t3, 0
+store_next:
+    sw    $t3, 4($t1)
+    addiu $t0, $t0, 1
+    slti  $t4, $t0, 256
+    bne   $t4, $zero, link
+
+    # the traversals
+    li    $v1, 0
+    li    $s1, 16
+traverse:
+    move  $t0, $s0
+visit:
+    lw    $t1, 0($t0)
+    addu  $v1, $v1, $t1
+    lw    $t0, 4($t0)
+    bne   $t0, $zero, visit
+    addiu $s1, $s1, -1
+    bgtz  $s1, traverse
+
+    la    $t0, result
+    sw    $v1, 0($t0)
+    li    $v0, 10
+    syscall
@@ -0,0 +1,79 @@
+# Multiplication of two 16x16 matrices of words:
+# a[ i][ j] = i + j, b[ i][ j] = i - j, c = a * b.
+# The sum of the elements of "c" is written to "result",
+# the program ends with the "exit" system call (10).
+# result = 0x00015400
+
+    .data
+
+result: .word 0
+
+    .bss
+
+a: .space 1024
+b: .space 1024
+c: .space 1024
+
+    .text
+
+    .global __start
+ __start:
+    # the sources
+    la    $t0, a
+    la    $t1, b
+    li    $s0, 0               # i
+init_rows:
+    li    $s1, 0               # j
+init_cols:
+    addu  $t2, $s0, $s1
+    sw    $t2, 0($t0)
+    subu  $t2, $s0, $s1
+    sw    $t2, 0($t1)
+    addiu $t0, $t0, 4
+    addiu $t1, $t1, 4
+    addiu $s1, $s1, 1
+    slti  $t2, $s1, 16
+    bne   $t2, $zero, init_cols
+    addiu $s0, $s0, 1
+    slti  $t2, $s0, 16
+    bne   $t2, $zero, init_rows
+
+    # c[ i][ j] = sum of a[ i][ k] * b[ k][ j]
+    la    $s3, a
+    la    $s4, b
+    la    $s5, c
+    li    $v1, 0
+    li    $s0, 0               # i
+mul_rows:
+    li    $s1, 0               # j
+mul_cols:
+    sll   $t0, $s0, 6
+    addu  $t0, $t0, $s3        # &a[ i][ 0]
+    sll   $t1, $s1, 2
+    addu  $t1, $t1, $s4        # &b[ 0][ j]
+    li    $t2, 0               # the sum
+    li    $s2, 0               # k
+mul_inner:
+    lw    $t3, 0($t0)
+    lw    $t4, 0($t1)
+    mul   $t5, $t3, $t4
+    addu  $t2, $t2, $t5
+    addiu $t0, $t0, 4
+    addiu $t1, $t1, 64
+    addiu $s2, $s2, 1
+    slti  $t6, $s2, 16
+    bne   $t6, $zero, mul_inner
+    sw    $t2, 0($s5)
+    addu  $v1, $v1, $t2
+    addiu $s5, $s5, 4
+    addiu $s1, $s1, 1
+    slti  $t6, $s1, 16
+    bne   $t6, $zero, mul_cols
+    addiu $s0, $s0, 1
+    slti  $t6, $s0, 16
+    bne   $t6, $zero, mul_rows
+
+    la    $t0, result
+    sw    $v1, 0($t0)
+    li    $v0, 10
+    syscall
@@ -0,0 +1,74 @@
+# Copying of a 4 KB buffer: an aligned copy by words unrolled
+# by four and a byte copy of an unaligned tail.
+# The sum of the words of the copy is written to "result",
+# the program ends with the "exit" system call (10).
+# result = 0x0007fe03
+
+    .data
+
+result: .word 0
+
+    .bss
+
+src: .space 4096
+dst: .space 4100
+
+    .text
+
+    .global __start
+ __start:
+    # src[ i] = i for each word
+    la    $t0, src
+    li    $t1, 0
+    li    $t2, 1024
+fill:
+    sw    $t1, 0($t0)
+    addiu $t0, $t0, 4
+    addiu $t1, $t1, 1
+    bne   $t1, $t2, fill
+
+    # the aligned copy, four words per iteration
+    la    $t0, src
+    la    $t1, dst
+    addiu $t2, $t0, 4096
+copy_words:
+    lw    $t3, 0($t0)
+    lw    $t4, 4($t0)
+    lw    $t5, 8($t0)
+    lw    $t6, 12($t0)
+    sw    $t3, 0($t1)
+    sw    $t4, 4($t1)
+    sw    $t5, 8($t1)
+    sw    $t6, 12($t1)
+    addiu $t0, $t0, 16
+    addiu $t1, $t1, 16
+    bne   $t0, $t2, copy_words
+
+    # the last 3 bytes of the source are copied after the end of the copy
+    la    $t0, src
+    addiu $t0, $t0, 4093
+    la    $t1, dst
+    addiu $t1, $t1, 4096
+    li    $t2, 3
+copy_bytes:
+    lbu   $t3, 0($t0)
+    sb    $t3, 0($t1)
+    addiu $t0, $t0, 1
+    addiu $t1, $t1, 1
+    addiu $t2, $t2, -1
+    bgtz  $t2, copy_bytes
+
+    # the sum of the words of the copy
+    la    $t0, dst
+    addiu $t2, $t0, 4100
+    li    $v1, 0
+sum:
+    lw    $t3, 0($t0)
+    addu  $v1, $v1, $t3
+    addiu $t0, $t0, 4
+    bne   $t0, $t2, sum
+
+    la    $t0, result
+    sw    $v1, 0($t0)
+    li    $v0, 10
+    syscall
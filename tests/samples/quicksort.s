@@ -0,0 +1,108 @@
+# Recursive quick sort of 512 pseudo-random words
+# generated by the linear congruential generator x = x * 1103515245 + 12345.
+# The program uses its own stack. After the sort the number of the pairs
+# out of order (0) is written to "result" and the sum of the words
+# weighted by their indices to "checksum", the program ends
+# with the "exit" system call (10).
+# result = 0, checksum = 0x5941d866
+
+    .data
+
+result:   .word 0
+checksum: .word 0
+
+    .bss
+
+array: .space 2048
+stack: .space 4096
+stack_top:
+
+    .text
+
+    .global __start
+ __start:
+    la    $sp, stack_top
+
+    # the input
+    la    $t0, array
+    li    $t1, 512
+    li    $t2, 2015            # x
+    li    $t3, 1103515245
+generate:
+    mul   $t2, $t2, $t3
+    addiu $t2, $t2, 12345
+    sw    $t2, 0($t0)
+    addiu $t0, $t0, 4
+    addiu $t1, $t1, -1
+    bgtz  $t1, generate
+
+    la    $a0, array
+    addiu $a1, $a0, 2044       # the address of the last word
+    jal   quicksort
+
+    # the check and the checksum
+    la    $t0, array
+    li    $t1, 1               # i
+    li    $v1, 0               # pairs out of order
+    lw    $t2, 0($t0)
+    li    $t5, 0               # checksum
+check:
+    lw    $t3, 4($t0)
+    slt   $t4, $t3, $t2
+    addu  $v1, $v1, $t4
+    mul   $t6, $t3, $t1
+    addu  $t5, $t5, $t6
+    move  $t2, $t3
+    addiu $t0, $t0, 4
+    addiu $t1, $t1, 1
+    slti  $t4, $t1, 512
+    bne   $t4, $zero, check
+
+    la    $t0, result
+    sw    $v1, 0($t0)
+    sw    $t5, 4($t0)
+    li    $v0, 10
+    syscall
+
+# Sorts the signed words from $a0 to $a1 inclusive (Lomuto partition)
+quicksort:
+    slt   $t0, $a0, $a1
+    beq   $t0, $zero, quicksort_end
+
+    addiu $sp, $sp, -12
+    sw    $ra, 0($sp)
+    sw    $a1, 4($sp)
+
+    lw    $t1, 0($a1)          # the pivot
+    move  $t2, $a0             # the border of the lesser words
+    move  $t3, $a0
+partition:
+    lw    $t4, 0($t3)
+    slt   $t5, $t4, $t1
+    beq   $t5, $zero, partition_next
+    lw    $t6, 0($t2)
+    sw    $t4, 0($t2)
+    sw    $t6, 0($t3)
+    addiu $t2, $t2, 4
+partition_next:
+    addiu $t3, $t3, 4
+    bne   $t3, $a1, partition
+
+    # the pivot goes to the border
+    lw    $t6, 0($t2)
+    sw    $t1, 0($t2)
+    sw    $t6, 0($a1)
+
+    # the left part, then the right one by the jump to the start
+    sw    $t2, 8($sp)
+    addiu $a1, $t2, -4
+    jal   quicksort
+    lw    $a0, 8($sp)
+    addiu $a0, $a0, 4
+    lw    $a1, 4($sp)
+    lw    $ra, 0($sp)
+    addiu $sp, $sp, 12
+    j     quicksort
+
+quicksort_end:
+    jr    $ra
@@ -0,0 +1,55 @@
+# Naive search of all the occurrences of a pattern in a text.
+# The number of the occurrences is written to "result" and the offset
+# of the last one to "last", the program ends with the "exit"
+# system call (10).
+# result = 5, last = 0x107
+
+    .data
+
+result: .word 0
+last:   .word -1
+
+pattern: .asciiz "simulator"
+
+text:
+    .ascii  "A functional simulator executes the instructions of a program "
+    .ascii  "and changes the architectural state. A performance simulator "
+    .ascii  "models the timing of the pipeline; a cycle-accurate simulator "
+    .ascii  "is slow, so a sampled simulation runs a fast simulator most of "
+    .asciiz "the time and a simulator of the timing only on the samples."
+
+    .text
+
+    .global __start
+ __start:
+    la    $s0, text
+    la    $s1, pattern
+    li    $v1, 0               # the number of the occurrences
+    li    $s2, -1              # the last offset
+    move  $t0, $s0             # the current position
+search:
+    lbu   $t1, 0($t0)
+    beq   $t1, $zero, done
+    move  $t2, $t0
+    move  $t3, $s1
+compare:
+    lbu   $t4, 0($t3)
+    beq   $t4, $zero, found    # the whole pattern matched
+    lbu   $t5, 0($t2)
+    bne   $t4, $t5, next
+    addiu $t2, $t2, 1
+    addiu $t3, $t3, 1
+    j     compare
+found:
+    addiu $v1, $v1, 1
+    subu  $s2, $t0, $s0
+next:
+    addiu $t0, $t0, 1
+    j     search
+
+done:
+    la    $t0, result
+    sw    $v1, 0($t0)
+    sw    $s2, 4($t0)
+    li    $v0, 10
+    syscall